@@ -0,0 +1,59 @@
+/***************************************************************************
+ * mbstatic.c
+ *
+ * Wrappers making static functions of libslink callable by the
+ * microbenchmarks.  The library sources are compiled into this file,
+ * the wrapped functions are exactly those used by the library, and the
+ * corresponding members of libslink.a are not linked.
+ ***************************************************************************/
+
+#include "../libslink/slutils.c"
+#include "../libslink/unpack.c"
+
+#include "microbench.h"
+
+
+int
+mb_detect (const char *record, uint64_t recbuflen, SLpacket *slpack, SLstat *stat)
+{
+  return detect (record, recbuflen, slpack, stat, 1);
+}
+
+int
+mb_update_stream (SLCD *slconn, const SLpacket *slpack)
+{
+  return update_stream (slconn, slpack);
+}
+
+int
+mb_decode_steim1 (int32_t *input, int inputlength, int samplecount,
+		  int32_t *output, int outputlength, int swapflag)
+{
+  return decode_steim1 (input, inputlength, samplecount, output, outputlength,
+			"", swapflag, NULL);
+}
+
+int
+mb_decode_steim2 (int32_t *input, int inputlength, int samplecount,
+		  int32_t *output, int outputlength, int swapflag)
+{
+  return decode_steim2 (input, inputlength, samplecount, output, outputlength,
+			"", swapflag, NULL);
+}
+
+/* The decoders used by the library, SSE4.1 versions if supported */
+int
+mb_decode_steim1_host (int32_t *input, int inputlength, int samplecount,
+		       int32_t *output, int outputlength, int swapflag)
+{
+  return decode_samples (NULL, DE_STEIM1, (const char *) input, inputlength,
+			 samplecount, output, outputlength, "", swapflag);
+}
+
+int
+mb_decode_steim2_host (int32_t *input, int inputlength, int samplecount,
+		       int32_t *output, int outputlength, int swapflag)
+{
+  return decode_samples (NULL, DE_STEIM2, (const char *) input, inputlength,
+			 samplecount, output, outputlength, "", swapflag);
+}
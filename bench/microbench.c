@@ -0,0 +1,1039 @@
+/***************************************************************************
+ * microbench.c
+ *
+ * Microbenchmarks of the libslink and dsarchive functions on the path
+ * of every received record.
+ *
+ * Each benchmark runs over a corpus of synthetic miniSEED 2 records,
+ * Steim compressed random walks, with a number of records for each of
+ * a configurable number of streams in the interleaved order of a real
+ * time feed.  The iterations are calibrated to a minimum run time and
+ * the median of several runs is reported as ns/op, together with the
+ * heap allocations per op counted by wrapping malloc(), calloc() and
+ * realloc() at link time (allocations inside the C library itself,
+ * e.g. by strdup(), are not counted).
+ *
+ * ds_streamproc() is run with write() stubbed out, it measures the
+ * path expansion and stream lookup, the files are created in a
+ * temporary directory when a stream is first seen.
+ *
+ * While building the corpus every record is checked to decode to the
+ * original samples, and the Steim decoders selected for the host CPU
+ * are compared with the reference decoders, see checkdecoders().
+ *
+ * The results are printed as a table or as JSON for comparing across
+ * commits.
+ ***************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <sys/stat.h>
+
+#include <libslink.h>
+#include <globmatch.h>
+
+#include "../src/dsarchive.h"
+#include "microbench.h"
+
+#define PACKAGE   "microbench"
+
+#define MAXCOUNTS  16           /* maximum number of stream counts */
+#define RECORDS    4            /* records per stream in a corpus */
+#define SAMPRATE   100          /* sample rate of all streams */
+#define STARTTIME  1792368000   /* 2026-10-19T00:00:00Z, start of all streams */
+
+/* A corpus of SeedLink packets */
+typedef struct Corpus_s
+{
+  char     *buffer;       /* SeedLink header and record of all packets */
+  SLpacket *packets;      /* packet descriptions as returned by sl_collect() */
+  int      *samplecounts; /* samples in each record */
+  char    (*stations)[6]; /* station code of each stream */
+  int       count;        /* number of packets */
+  int       streams;      /* number of streams */
+  int       encoding;     /* Steim encoding, 10 or 11 */
+}
+Corpus;
+
+/* A benchmark, 'run' performs 'iterations' ops and returns a value
+ * depending on the results so they cannot be optimized away */
+typedef struct Bench_s
+{
+  const char *name;
+  int         encoding;   /* Steim encoding of the corpus */
+  int       (*setup) (Corpus *corpus);
+  uint64_t  (*run) (Corpus *corpus, uint64_t iterations);
+  void      (*teardown) (Corpus *corpus);
+}
+Bench;
+
+static int  buildcorpus (Corpus *corpus, int streams, int encoding);
+static void freecorpus (Corpus *corpus);
+static int  encodesteim (const int32_t *samples, int count, int32_t previous,
+			 int encoding, uint8_t *frames, int framecount);
+static int  checkdecoders (const char *record, int count, int encoding);
+static void runbench (const Bench *bench, Corpus *corpus);
+static double nowns (void);
+static int  removefile (const char *path, const struct stat *sb,
+			int flag, struct FTW *ftw);
+static int  parameter_proc (int argcount, char **argvec);
+static void usage (void);
+
+static int setup_slconn (Corpus *corpus);
+static int setup_streams (Corpus *corpus);
+static int setup_wildcards (Corpus *corpus);
+static void teardown_slconn (Corpus *corpus);
+static int setup_archive (Corpus *corpus);
+static void teardown_archive (Corpus *corpus);
+static uint64_t run_detect (Corpus *corpus, uint64_t iterations);
+static uint64_t run_sequence (Corpus *corpus, uint64_t iterations);
+static uint64_t run_packettype (Corpus *corpus, uint64_t iterations);
+static uint64_t run_parse (Corpus *corpus, uint64_t iterations);
+static uint64_t run_parse_unpack (Corpus *corpus, uint64_t iterations);
+static uint64_t run_steim1 (Corpus *corpus, uint64_t iterations);
+static uint64_t run_steim2 (Corpus *corpus, uint64_t iterations);
+static uint64_t run_steim1_host (Corpus *corpus, uint64_t iterations);
+static uint64_t run_steim2_host (Corpus *corpus, uint64_t iterations);
+static uint64_t run_crc32c (Corpus *corpus, uint64_t iterations);
+static uint64_t run_globmatch (Corpus *corpus, uint64_t iterations);
+static uint64_t run_update_stream (Corpus *corpus, uint64_t iterations);
+static uint64_t run_streamproc (Corpus *corpus, uint64_t iterations);
+
+static const Bench benches[] = {
+  { "detect", 11, setup_slconn, run_detect, teardown_slconn },
+  { "sl_sequence", 11, NULL, run_sequence, NULL },
+  { "sl_packettype", 11, NULL, run_packettype, NULL },
+  { "sl_msr_parse_size", 11, NULL, run_parse, NULL },
+  { "sl_msr_parse_size_unpack", 11, NULL, run_parse_unpack, NULL },
+  { "decode_steim1", 10, NULL, run_steim1, NULL },
+  { "decode_steim2", 11, NULL, run_steim2, NULL },
+  { "decode_steim1_host", 10, NULL, run_steim1_host, NULL },
+  { "decode_steim2_host", 11, NULL, run_steim2_host, NULL },
+  { "sl_crc32c", 11, NULL, run_crc32c, NULL },
+  { "sl_globmatch", 11, NULL, run_globmatch, NULL },
+  { "update_stream", 11, setup_streams, run_update_stream, teardown_slconn },
+  { "update_stream_wildcard", 11, setup_wildcards, run_update_stream, teardown_slconn },
+  { "ds_streamproc", 11, setup_archive, run_streamproc, teardown_archive },
+};
+#define BENCHES (int)(sizeof (benches) / sizeof (benches[0]))
+
+static int    streamcounts[MAXCOUNTS] = { 1, 100, 10000 };
+static int    countcount   = 3;
+static int    reclen       = 512;
+static double mintime      = 0.1;  /* minimum time of a run (seconds) */
+static int    repetitions  = 5;    /* runs of each benchmark, median reported */
+static const char *filter  = NULL; /* only run benchmarks containing this */
+static const char *basedir = "/dev/shm";
+static int    jsonflag     = 0;
+static int    jsoncount    = 0;
+
+/* State of the running benchmark */
+static SLCD       *slconn = NULL;
+static SLMSrecord *msr = NULL;
+static DataStream  datastream;
+static char        archivedir[1024];
+static int         swapflag;
+static int32_t     samples[SLRECSIZEMAX];
+
+/* Allocation counters and write() stub, see the __wrap_ functions */
+static uint64_t allocations = 0;
+static int      stubwrites  = 0;
+
+extern void *__real_malloc (size_t size);
+extern void *__real_calloc (size_t nmemb, size_t size);
+extern void *__real_realloc (void *ptr, size_t size);
+extern ssize_t __real_write (int fd, const void *buf, size_t count);
+
+void *
+__wrap_malloc (size_t size)
+{
+  allocations++;
+  return __real_malloc (size);
+}
+
+void *
+__wrap_calloc (size_t nmemb, size_t size)
+{
+  allocations++;
+  return __real_calloc (nmemb, size);
+}
+
+void *
+__wrap_realloc (void *ptr, size_t size)
+{
+  allocations++;
+  return __real_realloc (ptr, size);
+}
+
+ssize_t
+__wrap_write (int fd, const void *buf, size_t count)
+{
+  if ( stubwrites )
+    return count;
+
+  return __real_write (fd, buf, count);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  Corpus corpora[2];
+  Corpus *corpus;
+  int countidx;
+  int idx;
+
+  if ( parameter_proc (argc, argv) < 0 )
+    return 1;
+
+  /* Records are big endian, swap on little endian hosts */
+  swapflag = sl_littleendianhost ();
+
+  if ( jsonflag )
+    printf ("{\n  \"libslink_version\": \"%s\",\n  \"record_length\": %d,\n"
+	    "  \"benchmarks\": [", LIBSLINK_VERSION, reclen);
+  else
+    printf ("%-26s %8s %12s %12s %12s\n", "benchmark", "streams",
+	    "iterations", "ns/op", "allocs/op");
+
+  for ( countidx = 0; countidx < countcount; countidx++ )
+    {
+      if ( buildcorpus (&corpora[0], streamcounts[countidx], 10) ||
+	   buildcorpus (&corpora[1], streamcounts[countidx], 11) )
+	return 1;
+
+      for ( idx = 0; idx < BENCHES; idx++ )
+	{
+	  if ( filter && ! strstr (benches[idx].name, filter) )
+	    continue;
+
+	  corpus = ( benches[idx].encoding == 10 ) ? &corpora[0] : &corpora[1];
+
+	  if ( benches[idx].setup && benches[idx].setup (corpus) )
+	    {
+	      fprintf (stderr, "%s: cannot set up %s\n", PACKAGE, benches[idx].name);
+	      return 1;
+	    }
+
+	  runbench (&benches[idx], corpus);
+
+	  if ( benches[idx].teardown )
+	    benches[idx].teardown (corpus);
+	}
+
+      freecorpus (&corpora[0]);
+      freecorpus (&corpora[1]);
+    }
+
+  if ( jsonflag )
+    printf ("\n  ]\n}\n");
+
+  sl_msr_free (&msr);
+
+  return 0;
+}  /* End of main() */
+
+
+/***************************************************************************
+ * runbench:
+ *
+ * Calibrate the iterations of a benchmark to the minimum run time, run
+ * it 'repetitions' times and print the median time per op and the
+ * allocations per op.
+ ***************************************************************************/
+static void
+runbench (const Bench *bench, Corpus *corpus)
+{
+  double times[64];
+  double start, elapsed, swap;
+  uint64_t iterations = corpus->count;
+  uint64_t allocstart;
+  uint64_t alloctotal = 0;
+  int runs = ( repetitions < 64 ) ? repetitions : 64;
+  int idx, jdx;
+
+  /* Warm up and calibrate, at least one pass over the corpus */
+  for (;;)
+    {
+      start = nowns ();
+      bench->run (corpus, iterations);
+      elapsed = (nowns () - start) / 1e9;
+
+      if ( elapsed >= mintime )
+	break;
+
+      if ( elapsed < mintime / 10 )
+	iterations *= 10;
+      else
+	iterations = (uint64_t) (iterations * mintime / elapsed * 1.1) + 1;
+    }
+
+  for ( idx = 0; idx < runs; idx++ )
+    {
+      allocstart = allocations;
+      start = nowns ();
+      bench->run (corpus, iterations);
+      times[idx] = (nowns () - start) / iterations;
+      alloctotal += allocations - allocstart;
+    }
+
+  for ( idx = 1; idx < runs; idx++ )
+    for ( jdx = idx; jdx > 0 && times[jdx - 1] > times[jdx]; jdx-- )
+      {
+	swap = times[jdx];
+	times[jdx] = times[jdx - 1];
+	times[jdx - 1] = swap;
+      }
+
+  if ( jsonflag )
+    printf ("%s\n    {\"name\": \"%s\", \"streams\": %d, \"iterations\": %llu, "
+	    "\"ns_per_op\": %.2f, \"allocs_per_op\": %.4f}",
+	    ( jsoncount++ ) ? "," : "", bench->name, corpus->streams,
+	    (unsigned long long) iterations, times[runs / 2],
+	    (double) alloctotal / (iterations * runs));
+  else
+    printf ("%-26s %8d %12llu %12.2f %12.4f\n", bench->name, corpus->streams,
+	    (unsigned long long) iterations, times[runs / 2],
+	    (double) alloctotal / (iterations * runs));
+
+  fflush (stdout);
+}  /* End of runbench() */
+
+
+/***************************************************************************
+ * Benchmark setup and teardown.
+ ***************************************************************************/
+static int
+setup_slconn (Corpus *corpus)
+{
+  return ( slconn = sl_newslcd () ) ? 0 : -1;
+}
+
+static int
+setup_streams (Corpus *corpus)
+{
+  int idx;
+
+  if ( setup_slconn (corpus) )
+    return -1;
+
+  for ( idx = 0; idx < corpus->streams; idx++ )
+    if ( sl_addstream (slconn, "XX", corpus->stations[idx], NULL, -1, NULL) )
+      return -1;
+
+  return 0;
+}
+
+static int
+setup_wildcards (Corpus *corpus)
+{
+  if ( setup_streams (corpus) ||
+       sl_addstream (slconn, "XX", "S00*", NULL, -1, NULL) ||
+       sl_addstream (slconn, "XX", "S?1??", NULL, -1, NULL) )
+    return -1;
+
+  return 0;
+}
+
+static void
+teardown_slconn (Corpus *corpus)
+{
+  sl_freeslcd (slconn);
+  slconn = NULL;
+}
+
+static int
+setup_archive (Corpus *corpus)
+{
+  static char path[1100];
+
+  snprintf (archivedir, sizeof (archivedir), "%s/microbench.XXXXXX", basedir);
+  if ( ! mkdtemp (archivedir) )
+    {
+      fprintf (stderr, "%s: cannot create directory in %s: %s\n",
+	       PACKAGE, basedir, strerror (errno));
+      return -1;
+    }
+
+  snprintf (path, sizeof (path), "%s/%s", archivedir, SDSLAYOUT);
+
+  memset (&datastream, 0, sizeof (DataStream));
+  datastream.path = path;
+  datastream.packettype = SLDATA;
+  datastream.idletimeout = 300;
+
+  /* Keep a file open for every stream */
+  ds_maxopenfiles = corpus->streams + 64;
+  stubwrites = 1;
+
+  return 0;
+}
+
+static void
+teardown_archive (Corpus *corpus)
+{
+  ds_streamproc (&datastream, NULL, 0);
+  stubwrites = 0;
+
+  nftw (archivedir, removefile, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+
+/***************************************************************************
+ * Benchmarks, each op processes the next packet of the corpus.
+ ***************************************************************************/
+static uint64_t
+run_detect (Corpus *corpus, uint64_t iterations)
+{
+  SLpacket slpack;
+  uint64_t result = 0;
+  uint64_t idx;
+
+  for ( idx = 0; idx < iterations; idx++ )
+    result += mb_detect (corpus->packets[idx % corpus->count].msrecord, reclen,
+			 &slpack, slconn->stat);
+
+  return result;
+}
+
+static uint64_t
+run_sequence (Corpus *corpus, uint64_t iterations)
+{
+  uint64_t result = 0;
+  uint64_t idx;
+
+  for ( idx = 0; idx < iterations; idx++ )
+    result += sl_sequence (&corpus->packets[idx % corpus->count]);
+
+  return result;
+}
+
+static uint64_t
+run_packettype (Corpus *corpus, uint64_t iterations)
+{
+  uint64_t result = 0;
+  uint64_t idx;
+
+  for ( idx = 0; idx < iterations; idx++ )
+    result += sl_packettype (&corpus->packets[idx % corpus->count]);
+
+  return result;
+}
+
+static uint64_t
+run_parse (Corpus *corpus, uint64_t iterations)
+{
+  uint64_t result = 0;
+  uint64_t idx;
+
+  for ( idx = 0; idx < iterations; idx++ )
+    if ( sl_msr_parse_size (NULL, corpus->packets[idx % corpus->count].msrecord,
+			    &msr, 1, 0, reclen) )
+      result += msr->fsdh.num_samples;
+
+  return result;
+}
+
+static uint64_t
+run_parse_unpack (Corpus *corpus, uint64_t iterations)
+{
+  uint64_t result = 0;
+  uint64_t idx;
+
+  for ( idx = 0; idx < iterations; idx++ )
+    if ( sl_msr_parse_size (NULL, corpus->packets[idx % corpus->count].msrecord,
+			    &msr, 1, 1, reclen) )
+      result += msr->numsamples;
+
+  return result;
+}
+
+static uint64_t
+run_steim1 (Corpus *corpus, uint64_t iterations)
+{
+  uint64_t result = 0;
+  uint64_t idx;
+  int pidx;
+
+  for ( idx = 0; idx < iterations; idx++ )
+    {
+      pidx = idx % corpus->count;
+      result += mb_decode_steim1 ((int32_t *) (corpus->packets[pidx].msrecord + 64),
+				  reclen - 64, corpus->samplecounts[pidx],
+				  samples, SLRECSIZEMAX, swapflag);
+    }
+
+  return result;
+}
+
+static uint64_t
+run_steim2 (Corpus *corpus, uint64_t iterations)
+{
+  uint64_t result = 0;
+  uint64_t idx;
+  int pidx;
+
+  for ( idx = 0; idx < iterations; idx++ )
+    {
+      pidx = idx % corpus->count;
+      result += mb_decode_steim2 ((int32_t *) (corpus->packets[pidx].msrecord + 64),
+				  reclen - 64, corpus->samplecounts[pidx],
+				  samples, SLRECSIZEMAX, swapflag);
+    }
+
+  return result;
+}
+
+static uint64_t
+run_steim1_host (Corpus *corpus, uint64_t iterations)
+{
+  uint64_t result = 0;
+  uint64_t idx;
+  int pidx;
+
+  for ( idx = 0; idx < iterations; idx++ )
+    {
+      pidx = idx % corpus->count;
+      result += mb_decode_steim1_host ((int32_t *) (corpus->packets[pidx].msrecord + 64),
+				       reclen - 64, corpus->samplecounts[pidx],
+				       samples, SLRECSIZEMAX, swapflag);
+    }
+
+  return result;
+}
+
+static uint64_t
+run_steim2_host (Corpus *corpus, uint64_t iterations)
+{
+  uint64_t result = 0;
+  uint64_t idx;
+  int pidx;
+
+  for ( idx = 0; idx < iterations; idx++ )
+    {
+      pidx = idx % corpus->count;
+      result += mb_decode_steim2_host ((int32_t *) (corpus->packets[pidx].msrecord + 64),
+				       reclen - 64, corpus->samplecounts[pidx],
+				       samples, SLRECSIZEMAX, swapflag);
+    }
+
+  return result;
+}
+
+static uint64_t
+run_crc32c (Corpus *corpus, uint64_t iterations)
+{
+  uint64_t result = 0;
+  uint64_t idx;
+
+  for ( idx = 0; idx < iterations; idx++ )
+    result += sl_crc32c (corpus->packets[idx % corpus->count].msrecord, reclen, 0);
+
+  return result;
+}
+
+static uint64_t
+run_globmatch (Corpus *corpus, uint64_t iterations)
+{
+  static char *patterns[] = { "*", "S00??", "S[0-7]*", "S?1?A", "*F", "S0[!0]*" };
+  uint64_t result = 0;
+  uint64_t idx;
+
+  for ( idx = 0; idx < iterations; idx++ )
+    result += sl_globmatch (corpus->stations[idx % corpus->streams],
+			    patterns[idx % (sizeof (patterns) / sizeof (patterns[0]))]);
+
+  return result;
+}
+
+static uint64_t
+run_update_stream (Corpus *corpus, uint64_t iterations)
+{
+  uint64_t result = 0;
+  uint64_t idx;
+
+  for ( idx = 0; idx < iterations; idx++ )
+    result += mb_update_stream (slconn, &corpus->packets[idx % corpus->count]);
+
+  return result;
+}
+
+static uint64_t
+run_streamproc (Corpus *corpus, uint64_t iterations)
+{
+  SLRecordView view;
+  uint64_t result = 0;
+  uint64_t idx;
+
+  for ( idx = 0; idx < iterations; idx++ )
+    {
+      sl_view_packet (&view, &corpus->packets[idx % corpus->count]);
+      result += ds_streamproc (&datastream, &view, 0);
+    }
+
+  return result;
+}
+
+
+/***************************************************************************
+ * buildcorpus:
+ *
+ * Build a corpus of RECORDS miniSEED 2 records of 'reclen' bytes for
+ * each of 'streams' streams, ordered round robin over the streams.
+ * The samples of each stream are a random walk with occasional steps,
+ * seeded by the stream number so the corpus is always the same.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+buildcorpus (Corpus *corpus, int streams, int encoding)
+{
+  SLstat stat;
+  struct tm tms;
+  time_t seconds;
+  int32_t *series;
+  int32_t previous;
+  uint32_t random;
+  char *packet;
+  char *record;
+  int framecount = (reclen - 64) / 64;
+  int maxsamples = framecount * 15 * 7;
+  int offset;
+  int count;
+  int stream;
+  int recidx;
+  int idx;
+
+  memset (corpus, 0, sizeof (Corpus));
+  memset (&stat, 0, sizeof (SLstat));
+  corpus->count = streams * RECORDS;
+  corpus->streams = streams;
+  corpus->encoding = encoding;
+
+  corpus->buffer = (char *) calloc (corpus->count, SLHEADSIZE + reclen);
+  corpus->packets = (SLpacket *) calloc (corpus->count, sizeof (SLpacket));
+  corpus->samplecounts = (int *) calloc (corpus->count, sizeof (int));
+  corpus->stations = calloc (streams, sizeof (*corpus->stations));
+  series = (int32_t *) malloc (sizeof (int32_t) * maxsamples * RECORDS);
+
+  if ( ! corpus->buffer || ! corpus->packets || ! corpus->samplecounts ||
+       ! corpus->stations || ! series )
+    {
+      fprintf (stderr, "%s: cannot allocate corpus of %d streams\n", PACKAGE, streams);
+      return -1;
+    }
+
+  for ( stream = 0; stream < streams; stream++ )
+    {
+      snprintf (corpus->stations[stream], 6, "S%04X", stream & 0xFFFF);
+
+      /* Random walk, xorshift32 steps of up to +-64 with 1% up to +-4096 */
+      random = stream + 1;
+      previous = 0;
+      for ( idx = 0; idx < maxsamples * RECORDS; idx++ )
+	{
+	  random ^= random << 13;
+	  random ^= random >> 17;
+	  random ^= random << 5;
+
+	  previous += ( random % 100 == 0 ) ?
+	    (int32_t) (random >> 8) % 4097 - 2048 : (int32_t) (random >> 8) % 129 - 64;
+	  series[idx] = previous;
+	}
+
+      offset = 0;
+      previous = 0;
+      for ( recidx = 0; recidx < RECORDS; recidx++ )
+	{
+	  idx = recidx * streams + stream;
+	  packet = corpus->buffer + (size_t) idx * (SLHEADSIZE + reclen);
+	  record = packet + SLHEADSIZE;
+
+	  snprintf (packet, SLHEADSIZE + 1, "SL%06X", (stream * RECORDS + recidx) & 0xFFFFFF);
+
+	  count = encodesteim (series + offset, maxsamples * RECORDS - offset, previous,
+			       encoding, (uint8_t *) record + 64, framecount);
+
+	  seconds = STARTTIME + offset / SAMPRATE;
+	  gmtime_r (&seconds, &tms);
+
+	  /* Fixed header, big endian */
+	  snprintf (record, 9, "%06dD ", (recidx + 1) % 1000000);
+	  memset (record + 8, ' ', 12);
+	  memcpy (record + 8, corpus->stations[stream], 5);
+	  memcpy (record + 13, "00BHZXX", 7);
+	  record[20] = (char) ((tms.tm_year + 1900) >> 8);
+	  record[21] = (char) (tms.tm_year + 1900);
+	  record[22] = (char) ((tms.tm_yday + 1) >> 8);
+	  record[23] = (char) (tms.tm_yday + 1);
+	  record[24] = (char) tms.tm_hour;
+	  record[25] = (char) tms.tm_min;
+	  record[26] = (char) tms.tm_sec;
+	  record[28] = (char) (((offset % SAMPRATE) * (10000 / SAMPRATE)) >> 8);
+	  record[29] = (char) ((offset % SAMPRATE) * (10000 / SAMPRATE));
+	  record[30] = (char) (count >> 8);
+	  record[31] = (char) count;
+	  record[33] = SAMPRATE;
+	  record[35] = 1;
+	  record[39] = 2;                /* blockettes 1000 and 1001 */
+	  record[45] = 64;               /* data offset */
+	  record[47] = 48;               /* first blockette offset */
+
+	  /* Blockette 1000 */
+	  record[48] = (char) (1000 >> 8);
+	  record[49] = (char) (1000 & 0xFF);
+	  record[51] = 56;
+	  record[52] = (char) encoding;
+	  record[53] = 1;
+	  for ( record[54] = 7; (1 << record[54]) < reclen; record[54]++ );
+
+	  /* Blockette 1001 */
+	  record[56] = (char) (1001 >> 8);
+	  record[57] = (char) (1001 & 0xFF);
+	  record[60] = 100;              /* timing quality */
+	  record[63] = (char) framecount;
+
+	  /* Describe the packet as sl_collect() does */
+	  corpus->packets[idx].slhead = packet;
+	  corpus->packets[idx].msrecord = record;
+	  corpus->packets[idx].reclen = mb_detect (record, reclen, &corpus->packets[idx], &stat);
+	  corpus->packets[idx].seqnum = sl_sequence (&corpus->packets[idx]);
+	  corpus->samplecounts[idx] = count;
+
+	  if ( corpus->packets[idx].reclen != reclen )
+	    {
+	      fprintf (stderr, "%s: corpus record not detected\n", PACKAGE);
+	      return -1;
+	    }
+
+	  /* The records must decode to the original samples */
+	  if ( ( ( encoding == 10 ) ?
+		 mb_decode_steim1 ((int32_t *) (record + 64), reclen - 64, count,
+				   samples, SLRECSIZEMAX, swapflag) :
+		 mb_decode_steim2 ((int32_t *) (record + 64), reclen - 64, count,
+				   samples, SLRECSIZEMAX, swapflag) ) != count ||
+	       memcmp (samples, series + offset, sizeof (int32_t) * count) )
+	    {
+	      fprintf (stderr, "%s: corpus record does not decode\n", PACKAGE);
+	      return -1;
+	    }
+
+	  if ( checkdecoders (record, count, encoding) )
+	    {
+	      fprintf (stderr, "%s: host decoder differs from the reference decoder\n", PACKAGE);
+	      return -1;
+	    }
+
+	  previous = series[offset + count - 1];
+	  offset += count;
+	}
+    }
+
+  free (series);
+
+  return 0;
+}  /* End of buildcorpus() */
+
+
+/***************************************************************************
+ * freecorpus:
+ ***************************************************************************/
+static void
+freecorpus (Corpus *corpus)
+{
+  free (corpus->buffer);
+  free (corpus->packets);
+  free (corpus->samplecounts);
+  free (corpus->stations);
+}  /* End of freecorpus() */
+
+
+/***************************************************************************
+ * checkdecoders:
+ *
+ * Compare the Steim decoder used by the library on the host CPU (the
+ * SSE4.1 version if supported) with the portable reference decoder for
+ * a corpus record: decoding all samples and stopping early within a
+ * frame, with the frames in big endian and swapped to little endian
+ * byte order.
+ *
+ * Returns 0 if both decoders return the same samples and -1 otherwise.
+ ***************************************************************************/
+static int
+checkdecoders (const char *record, int count, int encoding)
+{
+  static int32_t reference[SLRECSIZEMAX];
+  static int32_t host[SLRECSIZEMAX];
+  static int32_t frames[SLRECSIZEMAX / 4];
+  int32_t *input;
+  int counts[3];
+  int refcount;
+  int hostcount;
+  int order;
+  int cidx;
+  int idx;
+  int retval = 0;
+
+  counts[0] = count;
+  counts[1] = count / 3 + 1;
+  counts[2] = 1;
+
+  /* Frames in the opposite byte order of the record */
+  memcpy (frames, record + 64, reclen - 64);
+  for ( idx = 0; idx < (reclen - 64) / 4; idx++ )
+    sl_gswap4a (&frames[idx]);
+
+  /* Stopping early fails the integrity check, do not log it */
+  sl_loginit (-1, NULL, NULL, NULL, NULL);
+
+  for ( order = 0; order < 2 && ! retval; order++ )
+    {
+      input = ( order ) ? frames : (int32_t *) (record + 64);
+
+      for ( cidx = 0; cidx < 3 && ! retval; cidx++ )
+	{
+	  memset (reference, 0, sizeof (reference));
+	  memset (host, 0, sizeof (host));
+
+	  if ( encoding == 10 )
+	    {
+	      refcount = mb_decode_steim1 (input, reclen - 64, counts[cidx], reference,
+					   sizeof (reference), swapflag ^ order);
+	      hostcount = mb_decode_steim1_host (input, reclen - 64, counts[cidx], host,
+						 sizeof (host), swapflag ^ order);
+	    }
+	  else
+	    {
+	      refcount = mb_decode_steim2 (input, reclen - 64, counts[cidx], reference,
+					   sizeof (reference), swapflag ^ order);
+	      hostcount = mb_decode_steim2_host (input, reclen - 64, counts[cidx], host,
+						 sizeof (host), swapflag ^ order);
+	    }
+
+	  if ( refcount != counts[cidx] || hostcount != refcount ||
+	       memcmp (reference, host, sizeof (reference)) )
+	    retval = -1;
+	}
+    }
+
+  sl_loginit (0, NULL, NULL, NULL, NULL);
+
+  return retval;
+}  /* End of checkdecoders() */
+
+
+/***************************************************************************
+ * encodesteim:
+ *
+ * Encode samples as Steim1 (encoding 10) or Steim2 (encoding 11)
+ * frames, big endian, greedily packing as many differences into each
+ * word as fit.  'previous' is the sample before the first, for the
+ * first difference.
+ *
+ * Returns the number of samples encoded.
+ ***************************************************************************/
+static int
+encodesteim (const int32_t *samples, int count, int32_t previous,
+	     int encoding, uint8_t *frames, int framecount)
+{
+  /* Word layouts: differences, bits per difference, nibble, dnib */
+  static const int steim1[][4] = { {4, 8, 1, 0}, {2, 16, 2, 0}, {1, 32, 3, 0} };
+  static const int steim2[][4] = { {7, 4, 3, 2}, {6, 5, 3, 1}, {5, 6, 3, 0}, {4, 8, 1, -1},
+				   {3, 10, 2, 3}, {2, 15, 2, 2}, {1, 30, 2, 1} };
+  const int (*layouts)[4] = ( encoding == 10 ) ? steim1 : steim2;
+  int layoutcount = ( encoding == 10 ) ? 3 : 7;
+  uint32_t words[16];
+  int32_t diffs[7];
+  int64_t limit;
+  int sampleidx = 0;
+  int frameidx, widx, lidx, didx;
+  int available;
+
+  for ( frameidx = 0; frameidx < framecount; frameidx++ )
+    {
+      memset (words, 0, sizeof (words));
+
+      for ( widx = ( frameidx ) ? 1 : 3; widx < 16 && sampleidx < count; widx++ )
+	{
+	  available = ( count - sampleidx < 7 ) ? count - sampleidx : 7;
+
+	  for ( didx = 0; didx < available; didx++ )
+	    diffs[didx] = samples[sampleidx + didx] -
+	      ( ( sampleidx + didx ) ? samples[sampleidx + didx - 1] : previous );
+
+	  /* The first layout with enough differences that all fit */
+	  for ( lidx = 0; lidx < layoutcount; lidx++ )
+	    {
+	      if ( layouts[lidx][0] > available )
+		continue;
+
+	      limit = (int64_t) 1 << (layouts[lidx][1] - 1);
+	      for ( didx = 0; didx < layouts[lidx][0]; didx++ )
+		if ( diffs[didx] < -limit || diffs[didx] >= limit )
+		  break;
+
+	      if ( didx == layouts[lidx][0] )
+		break;
+	    }
+
+	  if ( lidx == layoutcount )
+	    return sampleidx;
+
+	  for ( didx = 0; didx < layouts[lidx][0]; didx++ )
+	    words[widx] |= ((uint32_t) diffs[didx] &
+			    (uint32_t) (((uint64_t) 1 << layouts[lidx][1]) - 1))
+	      << (layouts[lidx][1] * (layouts[lidx][0] - 1 - didx));
+
+	  if ( layouts[lidx][3] >= 0 && encoding == 11 )
+	    words[widx] |= (uint32_t) layouts[lidx][3] << 30;
+
+	  words[0] |= (uint32_t) layouts[lidx][2] << (30 - 2 * widx);
+	  sampleidx += layouts[lidx][0];
+	}
+
+      if ( frameidx == 0 )
+	words[1] = (uint32_t) samples[0];
+
+      for ( widx = 0; widx < 16; widx++ )
+	{
+	  frames[frameidx * 64 + widx * 4]     = (uint8_t) (words[widx] >> 24);
+	  frames[frameidx * 64 + widx * 4 + 1] = (uint8_t) (words[widx] >> 16);
+	  frames[frameidx * 64 + widx * 4 + 2] = (uint8_t) (words[widx] >> 8);
+	  frames[frameidx * 64 + widx * 4 + 3] = (uint8_t) words[widx];
+	}
+    }
+
+  /* The reverse integration constant, the last sample */
+  frames[8]  = (uint8_t) ((uint32_t) samples[sampleidx - 1] >> 24);
+  frames[9]  = (uint8_t) ((uint32_t) samples[sampleidx - 1] >> 16);
+  frames[10] = (uint8_t) ((uint32_t) samples[sampleidx - 1] >> 8);
+  frames[11] = (uint8_t) samples[sampleidx - 1];
+
+  return sampleidx;
+}  /* End of encodesteim() */
+
+
+/***************************************************************************
+ * nowns:
+ *
+ * Return a monotonic time in nanoseconds.
+ ***************************************************************************/
+static double
+nowns (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec * 1e9 + now.tv_nsec;
+}  /* End of nowns() */
+
+
+/***************************************************************************
+ * removefile:
+ *
+ * nftw() callback to remove the temporary directory tree.
+ ***************************************************************************/
+static int
+removefile (const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+  remove (path);
+
+  return 0;
+}  /* End of removefile() */
+
+
+/***************************************************************************
+ * parameter_proc:
+ *
+ * Process the command line parameters.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+parameter_proc (int argcount, char **argvec)
+{
+  char *tptr;
+  int optind;
+
+  for (optind = 1; optind < argcount; optind++)
+    {
+      if (strcmp (argvec[optind], "-h") == 0)
+	{
+	  usage ();
+	  exit (0);
+	}
+      else if (strcmp (argvec[optind], "-j") == 0)
+	jsonflag = 1;
+      else if (optind + 1 < argcount && strcmp (argvec[optind], "-s") == 0)
+	{
+	  countcount = 0;
+	  for ( tptr = strtok (argvec[++optind], ","); tptr && countcount < MAXCOUNTS;
+		tptr = strtok (NULL, ",") )
+	    if ( (streamcounts[countcount++] = atoi (tptr)) <= 0 )
+	      {
+		fprintf (stderr, "%s: invalid stream count: %s\n", PACKAGE, tptr);
+		return -1;
+	      }
+	}
+      else if (optind + 1 < argcount && strcmp (argvec[optind], "-l") == 0)
+	reclen = atoi (argvec[++optind]);
+      else if (optind + 1 < argcount && strcmp (argvec[optind], "-t") == 0)
+	mintime = atof (argvec[++optind]);
+      else if (optind + 1 < argcount && strcmp (argvec[optind], "-r") == 0)
+	repetitions = atoi (argvec[++optind]);
+      else if (optind + 1 < argcount && strcmp (argvec[optind], "-b") == 0)
+	filter = argvec[++optind];
+      else if (optind + 1 < argcount && strcmp (argvec[optind], "-d") == 0)
+	basedir = argvec[++optind];
+      else
+	{
+	  fprintf (stderr, "%s: unknown option or missing value: %s\n",
+		   PACKAGE, argvec[optind]);
+	  usage ();
+	  return -1;
+	}
+    }
+
+  if ( reclen < 128 || reclen > SLRECSIZEMAX || (reclen & (reclen - 1)) )
+    {
+      fprintf (stderr, "%s: record length must be a power of 2 from 128 to %d\n",
+	       PACKAGE, SLRECSIZEMAX);
+      return -1;
+    }
+
+  if ( repetitions < 1 || mintime <= 0.0 )
+    {
+      fprintf (stderr, "%s: repetitions and minimum time must be positive\n", PACKAGE);
+      return -1;
+    }
+
+  return 0;
+}  /* End of parameter_proc() */
+
+
+/***************************************************************************
+ * usage:
+ * Print the usage message.
+ ***************************************************************************/
+static void
+usage (void)
+{
+  fprintf (stderr, "Usage: %s [options]\n\n", PACKAGE);
+  fprintf (stderr,
+	   " -h             Print this usage message\n"
+	   " -j             Print results as JSON\n"
+	   " -s counts      Comma separated stream counts, default 1,100,10000\n"
+	   " -l bytes       Record length, default 512\n"
+	   " -t seconds     Minimum time of each run, default 0.1\n"
+	   " -r runs        Runs of each benchmark, the median is reported, default 5\n"
+	   " -b name        Only run benchmarks with names containing this\n"
+	   " -d dir         Directory for the temporary archive, default /dev/shm\n");
+}  /* End of usage() */
@@ -0,0 +1,20 @@
+
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+#include <stdint.h>
+#include <libslink.h>
+
+/* Static libslink functions, see mbstatic.c */
+extern int mb_detect (const char *record, uint64_t recbuflen, SLpacket *slpack, SLstat *stat);
+extern int mb_update_stream (SLCD *slconn, const SLpacket *slpack);
+extern int mb_decode_steim1 (int32_t *input, int inputlength, int samplecount,
+			     int32_t *output, int outputlength, int swapflag);
+extern int mb_decode_steim2 (int32_t *input, int inputlength, int samplecount,
+			     int32_t *output, int outputlength, int swapflag);
+extern int mb_decode_steim1_host (int32_t *input, int inputlength, int samplecount,
+				  int32_t *output, int outputlength, int swapflag);
+extern int mb_decode_steim2_host (int32_t *input, int inputlength, int samplecount,
+				  int32_t *output, int outputlength, int swapflag);
+
+#endif
@@ -0,0 +1,556 @@
+/***************************************************************************
+ * slbench.c
+ *
+ * End-to-end ingest benchmark of slarchive.
+ *
+ * Starts the slserver stand-in, runs slarchive against it writing an
+ * SDS archive into a temporary directory (on tmpfs by default) until
+ * the server has sent all records, and reports:
+ *
+ * records/s: data records archived per second of wall clock time,
+ *   excluding the time needed for stream negotiation
+ * CPU/record: user plus system time of slarchive per record
+ * syscalls/record: file read and write system calls per record from
+ *   /proc/<pid>/io (socket calls are not included), and all system
+ *   calls if strace is requested
+ * latency p50/p99: wall clock minus last sample time when a record has
+ *   been written, from the latency histogram of the slarchive metrics
+ *
+ * Arguments after -- are passed to slarchive, the options not known
+ * to slbench are passed to slserver.
+ ***************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define PACKAGE   "slbench"
+
+#define MAXARGS   64
+
+/* Results of one slarchive run */
+typedef struct BenchRun_s
+{
+  double   wall;          /* wall clock time (seconds) */
+  double   cpuuser;       /* user CPU time (seconds) */
+  double   cpusystem;     /* system CPU time (seconds) */
+  uint64_t syscr;         /* read type system calls */
+  uint64_t syscw;         /* write type system calls */
+  uint64_t syscalls;      /* all system calls counted by strace */
+  long     cswitches;     /* voluntary plus involuntary context switches */
+  int      status;        /* wait status */
+}
+BenchRun;
+
+static pid_t startserver (int *port);
+static int  runarchiver (const char *tracefile, BenchRun *run);
+static int  readprocio (pid_t pid, BenchRun *run);
+static uint64_t readstrace (const char *tracefile);
+static int  readmetrics (const char *filename, double *records,
+			 double *negotiation, double *p50, double *p99);
+static int  removefile (const char *path, const struct stat *sb,
+			int flag, struct FTW *ftw);
+static void usage (void);
+
+static const char *archiver = "../slarchive";
+static const char *server   = "./slserver";
+static const char *basedir  = "/dev/shm";
+static int uniflag   = 0;   /* uni-station mode, no stream list */
+static int traceflag = 0;   /* count all system calls with strace */
+static int keepflag  = 0;   /* keep the temporary directory */
+static int stations  = 10;
+
+static char workdir[1024];
+static char listfile[1100];
+static char archivedir[1100];
+static char metricsfile[1100];
+static char logfile[1100];
+
+static char *serverargs[MAXARGS];
+static int   serverargc = 0;
+static char *archiverargs[MAXARGS];
+static int   archiverargc = 0;
+
+int
+main (int argc, char **argv)
+{
+  BenchRun run;
+  BenchRun traced;
+  FILE *fp;
+  pid_t serverpid;
+  char tracefile[1100];
+  char portstr[32];
+  double records = 0.0;
+  double negotiation = 0.0;
+  double p50 = 0.0;
+  double p99 = 0.0;
+  int port;
+  int idx;
+  int extraidx = 0;
+
+  serverargs[serverargc++] = (char *) server;
+
+  for ( idx = 1; idx < argc; idx++ )
+    {
+      if ( strcmp (argv[idx], "-h") == 0 )
+	{
+	  usage ();
+	  return 0;
+	}
+      else if ( strcmp (argv[idx], "--") == 0 )
+	{
+	  extraidx = idx + 1;
+	  break;
+	}
+      else if ( strcmp (argv[idx], "-u") == 0 )
+	uniflag = 1;
+      else if ( strcmp (argv[idx], "-t") == 0 )
+	traceflag = 1;
+      else if ( strcmp (argv[idx], "-k") == 0 )
+	keepflag = 1;
+      else if ( idx + 1 < argc && strcmp (argv[idx], "-A") == 0 )
+	archiver = argv[++idx];
+      else if ( idx + 1 < argc && strcmp (argv[idx], "-X") == 0 )
+	serverargs[0] = (char *) (server = argv[++idx]);
+      else if ( idx + 1 < argc && strcmp (argv[idx], "-d") == 0 )
+	basedir = argv[++idx];
+      else if ( serverargc < MAXARGS - 4 )
+	{
+	  if ( strcmp (argv[idx], "-s") == 0 && idx + 1 < argc )
+	    stations = atoi (argv[idx + 1]);
+
+	  serverargs[serverargc++] = argv[idx];
+	}
+    }
+
+  serverargs[serverargc++] = "-p";
+  serverargs[serverargc++] = "0";
+  serverargs[serverargc] = NULL;
+
+  /* Temporary directory for the archive, stream list and metrics */
+  snprintf (workdir, sizeof (workdir), "%s/slbench.XXXXXX", basedir);
+  if ( ! mkdtemp (workdir) )
+    {
+      fprintf (stderr, "%s: cannot create directory in %s: %s\n",
+	       PACKAGE, basedir, strerror (errno));
+      return 1;
+    }
+
+  snprintf (listfile, sizeof (listfile), "%s/streams.list", workdir);
+  snprintf (archivedir, sizeof (archivedir), "%s/archive", workdir);
+  snprintf (metricsfile, sizeof (metricsfile), "%s/metrics.prom", workdir);
+  snprintf (logfile, sizeof (logfile), "%s/slarchive.log", workdir);
+  snprintf (tracefile, sizeof (tracefile), "%s/strace.txt", workdir);
+
+  if ( ! uniflag )
+    {
+      if ( ! (fp = fopen (listfile, "w")) )
+	{
+	  fprintf (stderr, "%s: cannot create %s: %s\n", PACKAGE, listfile, strerror (errno));
+	  return 1;
+	}
+
+      for ( idx = 0; idx < stations; idx++ )
+	fprintf (fp, "XX S%04X\n", idx & 0xFFFF);
+
+      fclose (fp);
+    }
+
+  if ( (serverpid = startserver (&port)) < 0 )
+    return 1;
+
+  snprintf (portstr, sizeof (portstr), "127.0.0.1:%d", port);
+
+  /* slarchive arguments, any strace prefix is inserted by runarchiver() */
+  archiverargs[archiverargc++] = (char *) archiver;
+  if ( ! uniflag )
+    {
+      archiverargs[archiverargc++] = "-l";
+      archiverargs[archiverargc++] = listfile;
+    }
+  archiverargs[archiverargc++] = "-SDS";
+  archiverargs[archiverargc++] = archivedir;
+  archiverargs[archiverargc++] = "-cs";
+  archiverargs[archiverargc++] = "-M";
+  archiverargs[archiverargc++] = metricsfile;
+  for ( idx = extraidx; extraidx && idx < argc && archiverargc < MAXARGS - 2; idx++ )
+    archiverargs[archiverargc++] = argv[idx];
+  archiverargs[archiverargc++] = portstr;
+  archiverargs[archiverargc] = NULL;
+
+  if ( runarchiver (NULL, &run) ||
+       readmetrics (metricsfile, &records, &negotiation, &p50, &p99) )
+    {
+      kill (serverpid, SIGTERM);
+      waitpid (serverpid, NULL, 0);
+      fprintf (stderr, "%s: benchmark run failed, see %s\n", PACKAGE, logfile);
+      return 1;
+    }
+
+  /* A second run under strace, not timed */
+  if ( traceflag && runarchiver (tracefile, &traced) == 0 )
+    run.syscalls = readstrace (tracefile);
+
+  kill (serverpid, SIGTERM);
+  waitpid (serverpid, NULL, 0);
+
+  if ( records <= 0.0 )
+    {
+      fprintf (stderr, "%s: no records archived, see %s\n", PACKAGE, logfile);
+      return 1;
+    }
+
+  printf ("records:              %.0f\n", records);
+  printf ("wall time:            %.3f s (negotiation %.3f s)\n", run.wall, negotiation);
+  printf ("records/s:            %.1f\n", records / (run.wall - negotiation));
+  printf ("CPU/record:           %.2f us (user %.2f, system %.2f)\n",
+	  (run.cpuuser + run.cpusystem) * 1e6 / records,
+	  run.cpuuser * 1e6 / records, run.cpusystem * 1e6 / records);
+  printf ("file syscalls/record: %.3f (read %.3f, write %.3f)\n",
+	  (run.syscr + run.syscw) / records,
+	  run.syscr / records, run.syscw / records);
+  if ( run.syscalls )
+    printf ("syscalls/record:      %.3f (strace)\n", run.syscalls / records);
+  printf ("ctx switches/record:  %.3f\n", run.cswitches / records);
+  printf ("latency p50:          %.3f ms\n", p50 * 1e3);
+  printf ("latency p99:          %.3f ms\n", p99 * 1e3);
+
+  if ( keepflag )
+    printf ("output in:            %s\n", workdir);
+  else
+    nftw (workdir, removefile, 16, FTW_DEPTH | FTW_PHYS);
+
+  return 0;
+}  /* End of main() */
+
+
+/***************************************************************************
+ * startserver:
+ *
+ * Start the server and read the port it listens on from its output.
+ *
+ * Returns the process ID of the server on success and -1 on error.
+ ***************************************************************************/
+static pid_t
+startserver (int *port)
+{
+  char line[32];
+  FILE *fp;
+  pid_t pid;
+  int fds[2];
+
+  if ( pipe (fds) )
+    return -1;
+
+  if ( (pid = fork ()) == 0 )
+    {
+      dup2 (fds[1], STDOUT_FILENO);
+      close (fds[0]);
+      close (fds[1]);
+      execv (server, serverargs);
+      fprintf (stderr, "%s: cannot execute %s: %s\n", PACKAGE, server, strerror (errno));
+      _exit (1);
+    }
+
+  close (fds[1]);
+
+  if ( pid < 0 || ! (fp = fdopen (fds[0], "r")) )
+    return -1;
+
+  if ( ! fgets (line, sizeof (line), fp) || (*port = atoi (line)) <= 0 )
+    {
+      fprintf (stderr, "%s: server did not start\n", PACKAGE);
+      fclose (fp);
+      waitpid (pid, NULL, 0);
+      return -1;
+    }
+
+  fclose (fp);
+
+  return pid;
+}  /* End of startserver() */
+
+
+/***************************************************************************
+ * runarchiver:
+ *
+ * Run slarchive to completion with its output to the log file, under
+ * strace counting system calls if 'tracefile' is not NULL.  The I/O
+ * counters are read after the process exits but before it is reaped.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+runarchiver (const char *tracefile, BenchRun *run)
+{
+  char *args[MAXARGS + 8];
+  struct timespec start, end;
+  struct rusage usage;
+  siginfo_t info;
+  pid_t pid;
+  int argc = 0;
+  int idx;
+  int fd;
+
+  memset (run, 0, sizeof (BenchRun));
+
+  if ( tracefile )
+    {
+      args[argc++] = "strace";
+      args[argc++] = "-f";
+      args[argc++] = "-c";
+      args[argc++] = "-o";
+      args[argc++] = (char *) tracefile;
+    }
+
+  for ( idx = 0; idx <= archiverargc; idx++ )
+    args[argc++] = archiverargs[idx];
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+
+  if ( (pid = fork ()) == 0 )
+    {
+      if ( (fd = open (logfile, O_WRONLY | O_CREAT | O_APPEND, 0644)) >= 0 )
+	{
+	  dup2 (fd, STDOUT_FILENO);
+	  dup2 (fd, STDERR_FILENO);
+	  close (fd);
+	}
+
+      execvp (args[0], args);
+      fprintf (stderr, "%s: cannot execute %s: %s\n", PACKAGE, args[0], strerror (errno));
+      _exit (127);
+    }
+  else if ( pid < 0 )
+    {
+      return -1;
+    }
+
+  if ( waitid (P_PID, pid, &info, WEXITED | WNOWAIT) )
+    return -1;
+
+  clock_gettime (CLOCK_MONOTONIC, &end);
+
+  if ( ! tracefile )
+    readprocio (pid, run);
+
+  if ( wait4 (pid, &run->status, 0, &usage) < 0 )
+    return -1;
+
+  run->wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  run->cpuuser = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+  run->cpusystem = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+  run->cswitches = usage.ru_nvcsw + usage.ru_nivcsw;
+
+  if ( ! WIFEXITED (run->status) || WEXITSTATUS (run->status) != 0 )
+    {
+      fprintf (stderr, "%s: %s exited abnormally\n", PACKAGE, args[0]);
+      return -1;
+    }
+
+  return 0;
+}  /* End of runarchiver() */
+
+
+/***************************************************************************
+ * readprocio:
+ *
+ * Read the system call counters of an exited, not yet reaped, process
+ * from /proc/<pid>/io.  Not available on all systems.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+readprocio (pid_t pid, BenchRun *run)
+{
+  char path[64];
+  char line[128];
+  unsigned long long value;
+  FILE *fp;
+
+  snprintf (path, sizeof (path), "/proc/%d/io", (int) pid);
+
+  if ( ! (fp = fopen (path, "r")) )
+    return -1;
+
+  while ( fgets (line, sizeof (line), fp) )
+    {
+      if ( sscanf (line, "syscr: %llu", &value) == 1 )
+	run->syscr = value;
+      else if ( sscanf (line, "syscw: %llu", &value) == 1 )
+	run->syscw = value;
+    }
+
+  fclose (fp);
+
+  return 0;
+}  /* End of readprocio() */
+
+
+/***************************************************************************
+ * readstrace:
+ *
+ * Read the total number of system calls from an strace -c summary.
+ *
+ * Returns the number of calls, 0 if not found.
+ ***************************************************************************/
+static uint64_t
+readstrace (const char *tracefile)
+{
+  char line[256];
+  unsigned long long calls = 0;
+  double percent, seconds;
+  unsigned long usecs;
+  FILE *fp;
+
+  if ( ! (fp = fopen (tracefile, "r")) )
+    return 0;
+
+  /* The total line: % time, seconds, usecs/call, calls, [errors], total */
+  while ( fgets (line, sizeof (line), fp) )
+    {
+      if ( strstr (line, " total") &&
+	   sscanf (line, "%lf %lf %lu %llu", &percent, &seconds, &usecs, &calls) == 4 )
+	break;
+
+      calls = 0;
+    }
+
+  fclose (fp);
+
+  return calls;
+}  /* End of readstrace() */
+
+
+/***************************************************************************
+ * readmetrics:
+ *
+ * Read the number of data records, the longest negotiation time of
+ * all connections and the latency histogram from the slarchive metrics
+ * file and estimate the 50th and 99th percentiles by interpolating
+ * within histogram buckets.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+readmetrics (const char *filename, double *records, double *negotiation,
+	     double *p50, double *p99)
+{
+  double bounds[128];
+  double counts[128];
+  double lower, rank, value;
+  double *quantiles[2];
+  double fractions[2] = { 0.5, 0.99 };
+  char line[512];
+  char bound[32];
+  FILE *fp;
+  int nbuckets = 0;
+  int idx, qdx;
+
+  if ( ! (fp = fopen (filename, "r")) )
+    {
+      fprintf (stderr, "%s: cannot open %s: %s\n", PACKAGE, filename, strerror (errno));
+      return -1;
+    }
+
+  while ( fgets (line, sizeof (line), fp) )
+    {
+      if ( sscanf (line, "slarchive_packets_total{type=\"Data\"} %lf", &value) == 1 )
+	*records = value;
+      else if ( sscanf (line, "slarchive_negotiation_seconds{%*[^}]} %lf", &value) == 1 )
+	{
+	  if ( value > *negotiation )
+	    *negotiation = value;
+	}
+      else if ( nbuckets < 128 &&
+		sscanf (line, "slarchive_latency_seconds_bucket{le=\"%31[^\"]\"} %lf",
+			bound, &value) == 2 )
+	{
+	  bounds[nbuckets] = ( strcmp (bound, "+Inf") ) ? strtod (bound, NULL) : -1.0;
+	  counts[nbuckets++] = value;
+	}
+    }
+
+  fclose (fp);
+
+  if ( nbuckets == 0 || counts[nbuckets - 1] <= 0.0 )
+    {
+      fprintf (stderr, "%s: no latency histogram in %s\n", PACKAGE, filename);
+      return -1;
+    }
+
+  /* Bucket counts are cumulative, the last bucket is +Inf */
+  quantiles[0] = p50;
+  quantiles[1] = p99;
+  for ( qdx = 0; qdx < 2; qdx++ )
+    {
+      rank = fractions[qdx] * counts[nbuckets - 1];
+
+      for ( idx = 0; idx < nbuckets; idx++ )
+	if ( counts[idx] >= rank )
+	  break;
+
+      if ( idx >= nbuckets - 1 )
+	{
+	  *quantiles[qdx] = bounds[nbuckets - 2];
+	  continue;
+	}
+
+      lower = ( idx ) ? bounds[idx - 1] : 0.0;
+      value = ( idx ) ? counts[idx - 1] : 0.0;
+
+      *quantiles[qdx] = lower + (bounds[idx] - lower) *
+	(rank - value) / (counts[idx] - value);
+    }
+
+  return 0;
+}  /* End of readmetrics() */
+
+
+/***************************************************************************
+ * removefile:
+ *
+ * nftw() callback to remove the temporary directory tree.
+ ***************************************************************************/
+static int
+removefile (const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+  remove (path);
+
+  return 0;
+}  /* End of removefile() */
+
+
+/***************************************************************************
+ * usage:
+ * Print the usage message.
+ ***************************************************************************/
+static void
+usage (void)
+{
+  fprintf (stderr, "Usage: %s [options] [server options] [-- slarchive options]\n\n", PACKAGE);
+  fprintf (stderr,
+	   " -h             Print this usage message\n"
+	   " -A path        slarchive program, default ../slarchive\n"
+	   " -X path        slserver program, default ./slserver\n"
+	   " -d dir         Directory for the temporary archive, default /dev/shm\n"
+	   " -u             Uni-station mode, do not request stations\n"
+	   " -t             Count all system calls with strace in a second run\n"
+	   " -k             Keep the temporary archive, metrics and log\n"
+	   "\n"
+	   "Server options (see slserver -h):\n"
+	   " -s stations  -c channels  -r rate  -f  -l bytes  -F format  -n count\n");
+}  /* End of usage() */
@@ -0,0 +1,675 @@
+/***************************************************************************
+ * slserver.c
+ *
+ * A minimal SeedLink server stand-in for benchmarking slarchive.
+ *
+ * Speaks enough of SeedLink protocol 3 for libslink clients (HELLO,
+ * CAPABILITIES, BATCH, STATION, SELECT, DATA, FETCH, TIME, END and
+ * BYE) and serves synthetic miniSEED 2 or 3 records for a number of
+ * stations and channels.  Each connection is served by a forked
+ * process, selectors are accepted but all channels are sent.
+ *
+ * Records of all channels are sent on a schedule following the sample
+ * rate and the time of the last sample of each record is its scheduled
+ * send time, the latency seen by a client is the delay through the
+ * network and the client itself.  In flood mode records are sent as
+ * fast as possible and stamped with the time they are generated.
+ *
+ * After the requested number of records per channel END is sent and
+ * the connection is closed when the client disconnects.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fnmatch.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <libslink.h>
+
+#define PACKAGE   "slserver"
+
+#define NETWORK   "XX"
+#define SENDBUFSIZE 65536
+
+static int  serve (int sock);
+static int  readline (int sock, char *line, int size);
+static int  sendall (int sock, const char *buffer, size_t length);
+static int  buildrecord (char *record, int station, int channel, int64_t lastsample);
+static void stationcode (char *sta, int station);
+static void channelcodes (char *loc, char *chan, int channel);
+static int  parameter_proc (int argcount, char **argvec);
+static void usage (void);
+
+static int port       = 18000; /* TCP port, 0 for any free port */
+static int stations   = 10;    /* number of stations */
+static int channels   = 3;     /* channels per station */
+static int samprate   = 100;   /* sample rate in Hz */
+static int flood      = 0;     /* send records as fast as possible */
+static int reclen     = 512;   /* record length in bytes */
+static int format     = 2;     /* miniSEED format version */
+static int64_t count  = 100;   /* records per channel, 0 for no limit */
+static int verbose    = 0;
+
+static int samplecount = 0;    /* samples per record */
+static int headerlen   = 0;    /* length of record header, ms3 without SID */
+static char payload[SLRECSIZEMAX]; /* encoded samples */
+
+static const char *chancodes[] = { "BHZ", "BHN", "BHE", "HHZ", "HHN", "HHE",
+				   "LHZ", "LHN", "LHE", "SHZ", "SHN", "SHE",
+				   "EHZ", "EHN", "EHE", "VHZ", "VHN", "VHE" };
+#define CHANCODES (int)(sizeof (chancodes) / sizeof (chancodes[0]))
+
+int
+main (int argc, char **argv)
+{
+  struct sockaddr_in addr;
+  socklen_t addrlen = sizeof (addr);
+  int listener;
+  int sock;
+  int one = 1;
+  pid_t pid;
+
+  if ( parameter_proc (argc, argv) < 0 )
+    return 1;
+
+  signal (SIGPIPE, SIG_IGN);
+  signal (SIGCHLD, SIG_IGN);
+
+  if ( (listener = socket (AF_INET, SOCK_STREAM, 0)) < 0 )
+    {
+      fprintf (stderr, "%s: socket(): %s\n", PACKAGE, strerror (errno));
+      return 1;
+    }
+
+  setsockopt (listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  addr.sin_port = htons (port);
+
+  if ( bind (listener, (struct sockaddr *) &addr, sizeof (addr)) ||
+       listen (listener, 64) ||
+       getsockname (listener, (struct sockaddr *) &addr, &addrlen) )
+    {
+      fprintf (stderr, "%s: cannot listen on port %d: %s\n",
+	       PACKAGE, port, strerror (errno));
+      return 1;
+    }
+
+  /* Report the port, the driver reads it to know the server is up */
+  printf ("%d\n", ntohs (addr.sin_port));
+  fflush (stdout);
+
+  for (;;)
+    {
+      if ( (sock = accept (listener, NULL, NULL)) < 0 )
+	{
+	  if ( errno == EINTR )
+	    continue;
+
+	  fprintf (stderr, "%s: accept(): %s\n", PACKAGE, strerror (errno));
+	  return 1;
+	}
+
+      if ( (pid = fork ()) == 0 )
+	{
+	  close (listener);
+	  setsockopt (sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+	  _exit ( serve (sock) ? 1 : 0 );
+	}
+      else if ( pid < 0 )
+	{
+	  fprintf (stderr, "%s: fork(): %s\n", PACKAGE, strerror (errno));
+	}
+
+      close (sock);
+    }
+
+  return 0;
+}  /* End of main() */
+
+
+/***************************************************************************
+ * serve:
+ *
+ * Negotiate with a client and send records until the requested count
+ * is reached or the client disconnects.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+serve (int sock)
+{
+  static const char *hello = "SeedLink v3.1 (slserver) :: SLPROTO:3.1 CAP EXTREPLY"
+    " NSWILDCARD BATCH\r\nslarchive benchmark server\r\n";
+  char line[256];
+  char *words[4];
+  char *selected;
+  char *sendbuf;
+  char sta[6];
+  int  *seqnum;
+  int  *active;
+  int  nactive = 0;
+  int  batch = 0;
+  int  multi = 0;
+  int  current = -1;
+  int  nwords;
+  int  idx;
+  int  sendlen;
+  int  packetlen;
+  int64_t total;
+  int64_t next = 0;
+  int64_t start;
+  int64_t spacing;
+  int64_t due;
+  struct timespec now;
+  struct timespec delay;
+
+  selected = (char *) calloc (stations, 1);
+  seqnum   = (int *) calloc (stations, sizeof (int));
+  active   = (int *) malloc (sizeof (int) * stations);
+  sendbuf  = (char *) malloc (SENDBUFSIZE);
+
+  if ( ! selected || ! seqnum || ! active || ! sendbuf )
+    return -1;
+
+  /* Negotiate until END, or DATA/FETCH/TIME without STATION */
+  for (;;)
+    {
+      if ( readline (sock, line, sizeof (line)) <= 0 )
+	return 0;
+
+      if ( verbose )
+	fprintf (stderr, "%s: received: %s\n", PACKAGE, line);
+
+      for ( nwords = 0; nwords < 4; nwords++ )
+	if ( ! (words[nwords] = strtok ( (nwords) ? NULL : line, " \t")) )
+	  break;
+
+      if ( nwords == 0 )
+	continue;
+
+      if ( ! strcasecmp (words[0], "HELLO") )
+	{
+	  if ( sendall (sock, hello, strlen (hello)) )
+	    return -1;
+	}
+      else if ( ! strcasecmp (words[0], "BATCH") )
+	{
+	  if ( sendall (sock, "OK\r\n", 4) )
+	    return -1;
+
+	  batch = 1;
+	}
+      else if ( ! strcasecmp (words[0], "CAPABILITIES") ||
+		! strcasecmp (words[0], "SELECT") )
+	{
+	  if ( ! batch && sendall (sock, "OK\r\n", 4) )
+	    return -1;
+	}
+      else if ( ! strcasecmp (words[0], "STATION") && nwords >= 2 )
+	{
+	  multi = 1;
+	  current = -1;
+
+	  for ( idx = 0; idx < stations; idx++ )
+	    {
+	      stationcode (sta, idx);
+
+	      if ( ! fnmatch (words[1], sta, 0) &&
+		   ( nwords < 3 || ! fnmatch (words[2], NETWORK, 0) ) )
+		{
+		  selected[idx] = 1;
+		  current = idx;
+		}
+	    }
+
+	  if ( ! batch && sendall (sock, ( current >= 0 ) ? "OK\r\n" : "ERROR\r\n",
+				   ( current >= 0 ) ? 4 : 7) )
+	    return -1;
+	}
+      else if ( ! strcasecmp (words[0], "DATA") ||
+		! strcasecmp (words[0], "FETCH") ||
+		! strcasecmp (words[0], "TIME") )
+	{
+	  /* Resume a single station from the requested sequence number */
+	  if ( nwords >= 2 && current >= 0 && strcasecmp (words[0], "TIME") )
+	    seqnum[current] = (int) strtol (words[1], NULL, 16);
+
+	  if ( ! multi )
+	    {
+	      memset (selected, 1, stations);
+	      break;
+	    }
+
+	  if ( ! batch && sendall (sock, "OK\r\n", 4) )
+	    return -1;
+	}
+      else if ( ! strcasecmp (words[0], "END") && multi )
+	{
+	  break;
+	}
+      else if ( ! strcasecmp (words[0], "BYE") )
+	{
+	  return 0;
+	}
+      else if ( ! batch )
+	{
+	  if ( sendall (sock, "ERROR\r\n", 7) )
+	    return -1;
+	}
+    }
+
+  for ( idx = 0; idx < stations; idx++ )
+    if ( selected[idx] )
+      active[nactive++] = idx;
+
+  /* Record N of all channels in turn, spaced evenly over a record period */
+  total = ( count ) ? count * nactive * channels : INT64_MAX;
+  spacing = (int64_t) samplecount * 1000000000 / samprate / (nactive * channels);
+
+  clock_gettime (CLOCK_REALTIME, &now);
+  start = (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+
+  while ( next < total )
+    {
+      clock_gettime (CLOCK_REALTIME, &now);
+      due = (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+
+      if ( ! flood && start + next * spacing > due )
+	{
+	  due = start + next * spacing - due;
+	  delay.tv_sec  = due / 1000000000;
+	  delay.tv_nsec = due % 1000000000;
+	  nanosleep (&delay, NULL);
+	  continue;
+	}
+
+      /* Fill the send buffer with the records due now */
+      sendlen = 0;
+      while ( next < total && sendlen + SLHEADSIZE + SLRECSIZEMAX <= SENDBUFSIZE &&
+	      ( flood || start + next * spacing <= due ) )
+	{
+	  idx = active[(next / channels) % nactive];
+
+	  snprintf (line, sizeof (line), "SL%06X", seqnum[idx] & 0xFFFFFF);
+	  memcpy (sendbuf + sendlen, line, SLHEADSIZE);
+	  seqnum[idx]++;
+
+	  packetlen = buildrecord (sendbuf + sendlen + SLHEADSIZE, idx,
+				   (int) (next % channels),
+				   ( flood ) ? due : start + next * spacing);
+	  sendlen += SLHEADSIZE + packetlen;
+	  next++;
+	}
+
+      if ( sendall (sock, sendbuf, sendlen) )
+	return 0;
+    }
+
+  if ( sendall (sock, "END", 3) )
+    return 0;
+
+  /* Wait for the client to disconnect */
+  while ( readline (sock, line, sizeof (line)) > 0 )
+    if ( ! strcasecmp (line, "BYE") )
+      break;
+
+  return 0;
+}  /* End of serve() */
+
+
+/***************************************************************************
+ * readline:
+ *
+ * Read a command line terminated by CR and/or LF from a socket one
+ * byte at a time, commands are only read during negotiation.
+ *
+ * Returns the length of the line, 0 on end of file and -1 on error.
+ ***************************************************************************/
+static int
+readline (int sock, char *line, int size)
+{
+  int length = 0;
+  ssize_t nread;
+  char byte;
+
+  for (;;)
+    {
+      if ( (nread = read (sock, &byte, 1)) < 0 && errno == EINTR )
+	continue;
+
+      if ( nread <= 0 )
+	return ( length ) ? length : (int) nread;
+
+      if ( byte == '\r' || byte == '\n' )
+	{
+	  if ( length == 0 )
+	    continue;
+
+	  break;
+	}
+
+      if ( length < size - 1 )
+	line[length++] = byte;
+    }
+
+  line[length] = '\0';
+
+  return length;
+}  /* End of readline() */
+
+
+/***************************************************************************
+ * sendall:
+ *
+ * Send a buffer completely.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+sendall (int sock, const char *buffer, size_t length)
+{
+  ssize_t nsent;
+
+  while ( length > 0 )
+    {
+      if ( (nsent = write (sock, buffer, length)) < 0 )
+	{
+	  if ( errno == EINTR )
+	    continue;
+
+	  return -1;
+	}
+
+      buffer += nsent;
+      length -= nsent;
+    }
+
+  return 0;
+}  /* End of sendall() */
+
+
+/***************************************************************************
+ * buildrecord:
+ *
+ * Build a miniSEED record of the requested format and length for a
+ * channel, with 'lastsample' the time of the last sample in
+ * nanoseconds since the epoch.
+ *
+ * Returns the length of the record.
+ ***************************************************************************/
+static int
+buildrecord (char *record, int station, int channel, int64_t lastsample)
+{
+  char sta[6], loc[3], chan[4];
+  char sid[64];
+  struct tm tms;
+  time_t seconds;
+  int64_t starttime;
+  uint32_t nanoseconds;
+  uint32_t crc;
+  uint64_t ratebits;
+  double rate = samprate;
+  int sidlen;
+  int length;
+  int idx;
+
+  stationcode (sta, station);
+  channelcodes (loc, chan, channel);
+
+  starttime = lastsample - (int64_t) (samplecount - 1) * 1000000000 / samprate;
+  seconds = (time_t) (starttime / 1000000000);
+  nanoseconds = (uint32_t) (starttime % 1000000000);
+  gmtime_r (&seconds, &tms);
+
+  if ( format == 2 )
+    {
+      memset (record, 0, 64);
+      memcpy (record, "000001D ", 8);
+      memset (record + 8, ' ', 12);
+      memcpy (record + 8, sta, strlen (sta));
+      memcpy (record + 13, loc, strlen (loc));
+      memcpy (record + 15, chan, 3);
+      memcpy (record + 18, NETWORK, 2);
+
+      /* BTIME and the rest of the fixed header, big endian */
+      record[20] = (char) ((tms.tm_year + 1900) >> 8);
+      record[21] = (char) (tms.tm_year + 1900);
+      record[22] = (char) ((tms.tm_yday + 1) >> 8);
+      record[23] = (char) (tms.tm_yday + 1);
+      record[24] = (char) tms.tm_hour;
+      record[25] = (char) tms.tm_min;
+      record[26] = (char) tms.tm_sec;
+      record[28] = (char) ((nanoseconds / 100000) >> 8);
+      record[29] = (char) (nanoseconds / 100000);
+      record[30] = (char) (samplecount >> 8);
+      record[31] = (char) samplecount;
+      record[32] = (char) (samprate >> 8);
+      record[33] = (char) samprate;
+      record[35] = 1;             /* sample rate multiplier */
+      record[39] = 1;             /* number of blockettes */
+      record[45] = 64;            /* data offset */
+      record[47] = 48;            /* first blockette offset */
+
+      /* Blockette 1000: INT32, big endian, record length exponent */
+      record[48] = (char) (1000 >> 8);
+      record[49] = (char) (1000 & 0xFF);
+      record[52] = 3;
+      record[53] = 1;
+      for ( length = 1; (1 << length) < reclen; length++ );
+      record[54] = (char) length;
+
+      memcpy (record + 64, payload, reclen - 64);
+
+      return reclen;
+    }
+
+  sidlen = snprintf (sid, sizeof (sid), "FDSN:%s_%s_%s_%c_%c_%c",
+		     NETWORK, sta, loc, chan[0], chan[1], chan[2]);
+  length = headerlen + sidlen + samplecount * 4;
+
+  /* Fixed header, little endian */
+  memset (record, 0, headerlen);
+  record[0] = 'M';
+  record[1] = 'S';
+  record[2] = 3;
+  record[4] = (char) nanoseconds;
+  record[5] = (char) (nanoseconds >> 8);
+  record[6] = (char) (nanoseconds >> 16);
+  record[7] = (char) (nanoseconds >> 24);
+  record[8] = (char) (tms.tm_year + 1900);
+  record[9] = (char) ((tms.tm_year + 1900) >> 8);
+  record[10] = (char) (tms.tm_yday + 1);
+  record[11] = (char) ((tms.tm_yday + 1) >> 8);
+  record[12] = (char) tms.tm_hour;
+  record[13] = (char) tms.tm_min;
+  record[14] = (char) tms.tm_sec;
+  record[15] = 3;                 /* INT32 encoding */
+  memcpy (&ratebits, &rate, 8);
+  for ( idx = 0; idx < 8; idx++ )
+    record[16 + idx] = (char) (ratebits >> (8 * idx));
+  record[24] = (char) samplecount;
+  record[25] = (char) (samplecount >> 8);
+  record[32] = 1;                 /* publication version */
+  record[33] = (char) sidlen;
+  record[36] = (char) (samplecount * 4);
+  record[37] = (char) ((samplecount * 4) >> 8);
+
+  memcpy (record + headerlen, sid, sidlen);
+  memcpy (record + headerlen + sidlen, payload, samplecount * 4);
+
+  crc = sl_crc32c (record, length, 0);
+  record[28] = (char) crc;
+  record[29] = (char) (crc >> 8);
+  record[30] = (char) (crc >> 16);
+  record[31] = (char) (crc >> 24);
+
+  return length;
+}  /* End of buildrecord() */
+
+
+/***************************************************************************
+ * stationcode:
+ *
+ * Generate the code of a station number, S and 4 hexadecimal digits.
+ ***************************************************************************/
+static void
+stationcode (char *sta, int station)
+{
+  snprintf (sta, 6, "S%04X", station & 0xFFFF);
+}  /* End of stationcode() */
+
+
+/***************************************************************************
+ * channelcodes:
+ *
+ * Generate the location and channel codes of a channel number, the
+ * location codes 00 to 99 each hold a set of common channel codes.
+ ***************************************************************************/
+static void
+channelcodes (char *loc, char *chan, int channel)
+{
+  snprintf (loc, 3, "%02u", (unsigned int) (channel / CHANCODES) % 100);
+  strcpy (chan, chancodes[channel % CHANCODES]);
+}  /* End of channelcodes() */
+
+
+/***************************************************************************
+ * parameter_proc:
+ *
+ * Process the command line parameters and prepare the sample payload.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+parameter_proc (int argcount, char **argvec)
+{
+  int optind;
+  int idx;
+
+  for (optind = 1; optind < argcount; optind++)
+    {
+      if (strcmp (argvec[optind], "-h") == 0)
+	{
+	  usage ();
+	  exit (0);
+	}
+      else if (strcmp (argvec[optind], "-v") == 0)
+	verbose++;
+      else if (strcmp (argvec[optind], "-f") == 0)
+	flood = 1;
+      else if (optind + 1 < argcount && strcmp (argvec[optind], "-p") == 0)
+	port = atoi (argvec[++optind]);
+      else if (optind + 1 < argcount && strcmp (argvec[optind], "-s") == 0)
+	stations = atoi (argvec[++optind]);
+      else if (optind + 1 < argcount && strcmp (argvec[optind], "-c") == 0)
+	channels = atoi (argvec[++optind]);
+      else if (optind + 1 < argcount && strcmp (argvec[optind], "-r") == 0)
+	samprate = atoi (argvec[++optind]);
+      else if (optind + 1 < argcount && strcmp (argvec[optind], "-l") == 0)
+	reclen = atoi (argvec[++optind]);
+      else if (optind + 1 < argcount && strcmp (argvec[optind], "-F") == 0)
+	format = atoi (argvec[++optind]);
+      else if (optind + 1 < argcount && strcmp (argvec[optind], "-n") == 0)
+	count = strtoll (argvec[++optind], NULL, 10);
+      else
+	{
+	  fprintf (stderr, "%s: unknown option or missing value: %s\n",
+		   PACKAGE, argvec[optind]);
+	  usage ();
+	  return -1;
+	}
+    }
+
+  if ( stations < 1 || stations > 0x10000 )
+    {
+      fprintf (stderr, "%s: stations must be 1 to 65536\n", PACKAGE);
+      return -1;
+    }
+
+  if ( channels < 1 || channels > CHANCODES * 100 )
+    {
+      fprintf (stderr, "%s: channels must be 1 to %d\n", PACKAGE, CHANCODES * 100);
+      return -1;
+    }
+
+  if ( samprate < 1 || samprate > 32767 || count < 0 )
+    {
+      fprintf (stderr, "%s: sample rate must be 1 to 32767 and count not negative\n",
+	       PACKAGE);
+      return -1;
+    }
+
+  if ( format == 2 )
+    {
+      if ( reclen < 128 || reclen > SLRECSIZEMAX || (reclen & (reclen - 1)) )
+	{
+	  fprintf (stderr, "%s: miniSEED 2 record length must be a power of 2 from 128 to %d\n",
+		   PACKAGE, SLRECSIZEMAX);
+	  return -1;
+	}
+
+      samplecount = (reclen - 64) / 4;
+    }
+  else if ( format == 3 )
+    {
+      /* Fixed header plus the longest SID, FDSN:XX_SXXXX_00_B_H_Z */
+      headerlen = 40;
+
+      if ( reclen < headerlen + 22 + 4 || reclen > SLRECSIZEMAX )
+	{
+	  fprintf (stderr, "%s: miniSEED 3 record length must be %d to %d\n",
+		   PACKAGE, headerlen + 22 + 4, SLRECSIZEMAX);
+	  return -1;
+	}
+
+      samplecount = (reclen - headerlen - 22) / 4;
+    }
+  else
+    {
+      fprintf (stderr, "%s: format must be 2 or 3\n", PACKAGE);
+      return -1;
+    }
+
+  /* A ramp of 16-bit samples, big endian for miniSEED 2 and little for 3 */
+  for ( idx = 0; idx < samplecount; idx++ )
+    {
+      payload[idx * 4 + ( (format == 2) ? 2 : 1 )] = (char) (idx >> 8);
+      payload[idx * 4 + ( (format == 2) ? 3 : 0 )] = (char) idx;
+    }
+
+  return 0;
+}  /* End of parameter_proc() */
+
+
+/***************************************************************************
+ * usage:
+ * Print the usage message.
+ ***************************************************************************/
+static void
+usage (void)
+{
+  fprintf (stderr, "Usage: %s [options]\n\n", PACKAGE);
+  fprintf (stderr,
+	   " -h             Print this usage message\n"
+	   " -v             Be more verbose, log commands\n"
+	   " -p port        TCP port to listen on, 0 for any, default 18000\n"
+	   " -s stations    Number of stations, default 10\n"
+	   " -c channels    Channels per station, default 3\n"
+	   " -r rate        Sample rate in Hz, default 100\n"
+	   " -f             Flood: send records as fast as possible\n"
+	   " -l bytes       Record length, default 512\n"
+	   " -F format      miniSEED format version 2 or 3, default 2\n"
+	   " -n count       Records per channel and connection, 0 for no limit, default 100\n"
+	   "\n"
+	   "The listening port is printed on standard output.\n");
+}  /* End of usage() */
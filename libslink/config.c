@@ -58,6 +58,7 @@ sl_read_streamlist (SLCD *slconn, const char *streamfile,
   char sta[6];
   char selectors[100];
   char line[100];
+  SLreadbuf readbuf;
   int streamfd;
   int fields;
   int count;
@@ -87,7 +88,9 @@ sl_read_streamlist (SLCD *slconn, const char *streamfile,
   count    = 1;
   stacount = 0;
 
-  while ((sl_readline (streamfd, line, sizeof (line))) >= 0)
+  sl_readbuf_init (&readbuf, streamfd);
+
+  while ((sl_readline_buf (&readbuf, line, sizeof (line))) >= 0)
   {
     fields = sscanf (line, "%2s %5s %99[a-zA-Z0-9!?. ]\n",
                      net, sta, selectors);
@@ -179,3 +179,87 @@ sl_readline (int fd, char *buffer, int buflen)
 
   return nread;
 } /* End of sl_readline() */
+
+/***************************************************************************
+ * sl_readbuf_init:
+ *
+ * Initialize a SLreadbuf to read lines from the file descriptor 'fd'
+ * with sl_readline_buf().
+ ***************************************************************************/
+void
+sl_readbuf_init (SLreadbuf *readbuf, int fd)
+{
+  if (!readbuf)
+    return;
+
+  readbuf->fd    = fd;
+  readbuf->start = 0;
+  readbuf->end   = 0;
+} /* End of sl_readbuf_init() */
+
+/***************************************************************************
+ * sl_readline_buf:
+ *
+ * Read a line like sl_readline() through the buffer 'readbuf', reading
+ * the file in blocks instead of a character at a time.  Reading stops
+ * when either a newline character is read or buflen-1 characters have
+ * been read.  The buffer will always contain a NULL-terminated string.
+ * A last line without a newline character is returned at end of file.
+ *
+ * Returns the number of characters read on success and -1 on error or
+ * end of file.
+ ***************************************************************************/
+int
+sl_readline_buf (SLreadbuf *readbuf, char *buffer, int buflen)
+{
+  char *newline;
+  int nread = 0;
+  int ncopy;
+  int got;
+
+  if (!readbuf || !buffer || buflen < 1)
+    return -1;
+
+  while (nread < (buflen - 1))
+  {
+    /* Refill the buffer when empty */
+    if (readbuf->start >= readbuf->end)
+    {
+      got = read (readbuf->fd, readbuf->buf, sizeof (readbuf->buf));
+
+      if (got <= 0)
+      {
+        if (nread > 0)
+          break;
+
+        return -1;
+      }
+
+      readbuf->start = 0;
+      readbuf->end   = got;
+    }
+
+    ncopy = readbuf->end - readbuf->start;
+    if (ncopy > (buflen - 1 - nread))
+      ncopy = buflen - 1 - nread;
+
+    /* Trap door for newline character */
+    if ((newline = memchr (readbuf->buf + readbuf->start, '\n', ncopy)) != NULL)
+    {
+      ncopy = newline - (readbuf->buf + readbuf->start);
+      memcpy (buffer + nread, readbuf->buf + readbuf->start, ncopy);
+      nread += ncopy;
+      readbuf->start += ncopy + 1;
+      break;
+    }
+
+    memcpy (buffer + nread, readbuf->buf + readbuf->start, ncopy);
+    nread += ncopy;
+    readbuf->start += ncopy;
+  }
+
+  /* Terminate string in buffer */
+  buffer[nread] = '\0';
+
+  return nread;
+} /* End of sl_readline_buf() */
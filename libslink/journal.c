@@ -0,0 +1,409 @@
+/***************************************************************************
+ * journal.c:
+ *
+ * Routines to keep SeedLink sequence numbers in a memory-mapped binary
+ * state journal, updated in place for every packet received.
+ *
+ * The journal file is a 64 byte header followed by one 64 byte SLjslot
+ * per stream, all in host byte order.  The text state file written by
+ * sl_savestate() remains available as an export of the same state.
+ *
+ * This file is part of the SeedLink Library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libslink.h"
+#include "slplatform.h"
+
+#if !defined(SLP_WIN)
+#include <sys/mman.h>
+#endif
+
+#define SLJ_MAGIC   "SLJOURNL"
+#define SLJ_VERSION 1
+#define SLJ_ORDER   0x01020304  /* Byte order marker */
+
+/* Journal file header, the same size as a slot */
+typedef struct sljheader_s
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t order;
+  uint32_t slotsize;
+  uint32_t slotcount;
+  uint8_t  reserved[40];
+} SLjheader;
+
+/* Open journal, referenced by SLstat.journal */
+struct sljournal_s
+{
+  int     fd;
+  size_t  size;
+  char   *map;
+};
+
+#if !defined(SLP_WIN)
+static char *read_journal (SLCD *slconn, const char *journalfile, uint32_t *slotcount);
+static void recover_stream (SLstream *curstream, const SLjslot *slot);
+#endif
+
+/***************************************************************************
+ * sl_openjournal:
+ *
+ * Open the binary state journal 'journalfile' and attach a slot to
+ * each entry in the stream chain.  Sequence numbers and time stamps in
+ * an existing journal are recovered into the matching stream entries,
+ * as done by sl_recoverstate(), before the journal is rewritten with
+ * one slot per stream in the order of the stream chain.
+ *
+ * The journal is memory-mapped and the slots are updated in place for
+ * every packet received, sl_syncjournal() flushes the updates to
+ * storage.  All streams must be added before the journal is opened.
+ *
+ * Returns:
+ * -1 : error
+ *  0 : completed successfully, state recovered from the journal
+ *  1 : completed successfully, a new journal was created
+ ***************************************************************************/
+int
+sl_openjournal (SLCD *slconn, const char *journalfile)
+{
+#if defined(SLP_WIN)
+  sl_log_r (slconn, 2, 0, "%s(): state journal is not supported on this platform\n", __func__);
+  return -1;
+#else
+  struct sljournal_s *journal;
+  SLjheader *header;
+  SLjslot *slots;
+  SLjslot *slot;
+  SLstream *curstream;
+  char *oldjournal;
+  char *buffer;
+  char *tempfile;
+  uint32_t oldcount = 0;
+  uint32_t idx;
+  size_t size;
+  int streamcount = 0;
+  int recovered = 0;
+  int fd;
+
+  if (!slconn || !journalfile)
+    return -1;
+
+  if (slconn->stat->journal)
+  {
+    sl_log_r (slconn, 2, 0, "%s(): a state journal is already open\n", __func__);
+    return -1;
+  }
+
+  for (curstream = slconn->streams; curstream != NULL; curstream = curstream->next)
+    streamcount++;
+
+  if (streamcount == 0)
+  {
+    sl_log_r (slconn, 2, 0, "%s(): no streams configured\n", __func__);
+    return -1;
+  }
+
+  /* Read an existing journal and recover state for matching streams */
+  oldjournal = read_journal (slconn, journalfile, &oldcount);
+
+  if (oldjournal)
+  {
+    sl_log_r (slconn, 1, 1, "recovering connection state from state journal\n");
+
+    slots = (SLjslot *)(oldjournal + sizeof (SLjheader));
+
+    for (idx = 0; idx < oldcount; idx++)
+    {
+      slots[idx].net[sizeof (slots[idx].net) - 1] = '\0';
+      slots[idx].sta[sizeof (slots[idx].sta) - 1] = '\0';
+
+      if ((curstream = sl_findstream (slconn, slots[idx].net, slots[idx].sta)) != NULL)
+        recover_stream (curstream, &slots[idx]);
+    }
+
+    free (oldjournal);
+    recovered = 1;
+  }
+
+  /* Build the new journal, one slot per stream in chain order */
+  size = sizeof (SLjheader) + (size_t)streamcount * sizeof (SLjslot);
+
+  if ((buffer = (char *)calloc (1, size + strlen (journalfile) + 5)) == NULL)
+  {
+    sl_log_r (slconn, 2, 0, "%s(): cannot allocate memory\n", __func__);
+    return -1;
+  }
+
+  tempfile = buffer + size;
+  snprintf (tempfile, strlen (journalfile) + 5, "%s.tmp", journalfile);
+
+  header = (SLjheader *)buffer;
+  memcpy (header->magic, SLJ_MAGIC, sizeof (header->magic));
+  header->version   = SLJ_VERSION;
+  header->order     = SLJ_ORDER;
+  header->slotsize  = sizeof (SLjslot);
+  header->slotcount = streamcount;
+
+  slot = (SLjslot *)(buffer + sizeof (SLjheader));
+  for (curstream = slconn->streams; curstream != NULL; curstream = curstream->next, slot++)
+  {
+    strncpy (slot->net, curstream->net, sizeof (slot->net) - 1);
+    strncpy (slot->sta, curstream->sta, sizeof (slot->sta) - 1);
+    slot->seqnum = curstream->seqnum;
+    slot->nstime = curstream->nstime;
+  }
+
+  /* Write the complete journal to a temporary file and replace the old */
+  if ((fd = slp_openfile (tempfile, 't')) < 0)
+  {
+    sl_log_r (slconn, 2, 0, "cannot open state journal for writing, %s\n", strerror (errno));
+    free (buffer);
+    return -1;
+  }
+
+  if (write (fd, buffer, size) != (int)size || slp_syncfile (fd))
+  {
+    sl_log_r (slconn, 2, 0, "cannot write state journal, %s\n", strerror (errno));
+    close (fd);
+    unlink (tempfile);
+    free (buffer);
+    return -1;
+  }
+
+  if (close (fd) || slp_replacefile (tempfile, journalfile))
+  {
+    sl_log_r (slconn, 2, 0, "cannot replace state journal %s, %s\n", journalfile, strerror (errno));
+    unlink (tempfile);
+    free (buffer);
+    return -1;
+  }
+
+  free (buffer);
+
+  /* Map the journal and attach the slots to the streams */
+  if ((journal = (struct sljournal_s *)malloc (sizeof (struct sljournal_s))) == NULL)
+  {
+    sl_log_r (slconn, 2, 0, "%s(): cannot allocate memory\n", __func__);
+    return -1;
+  }
+
+  if ((journal->fd = slp_openfile (journalfile, 'w')) < 0)
+  {
+    sl_log_r (slconn, 2, 0, "cannot open state journal, %s\n", strerror (errno));
+    free (journal);
+    return -1;
+  }
+
+  journal->size = size;
+  journal->map  = (char *)mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, journal->fd, 0);
+
+  if (journal->map == MAP_FAILED)
+  {
+    sl_log_r (slconn, 2, 0, "cannot map state journal, %s\n", strerror (errno));
+    close (journal->fd);
+    free (journal);
+    return -1;
+  }
+
+  slot = (SLjslot *)(journal->map + sizeof (SLjheader));
+  for (curstream = slconn->streams; curstream != NULL; curstream = curstream->next)
+    curstream->jslot = slot++;
+
+  slconn->stat->journal = journal;
+
+  return (recovered) ? 0 : 1;
+#endif
+} /* End of sl_openjournal() */
+
+/***************************************************************************
+ * sl_syncjournal:
+ *
+ * Flush the updates of the state journal to storage.  The slots are
+ * updated in memory shared with the operating system, they survive a
+ * crash of the program without syncing but not a crash of the system.
+ * With SLCD.durablestate set the slots are not updated per packet but
+ * here, from the durable state committed by sl_commitacks().
+ *
+ * Returns:
+ * -1 : error
+ *  0 : completed successfully or no journal is open
+ ***************************************************************************/
+int
+sl_syncjournal (SLCD *slconn)
+{
+#if defined(SLP_WIN)
+  return 0;
+#else
+  struct sljournal_s *journal;
+  SLstream *curstream;
+
+  if (!slconn || !slconn->stat || !(journal = slconn->stat->journal))
+    return 0;
+
+  /* With durable state the slots are updated here from committed state */
+  if (slconn->durablestate)
+  {
+    for (curstream = slconn->streams; curstream != NULL; curstream = curstream->next)
+    {
+      if (curstream->jslot && curstream->jslot->seqnum != curstream->durseqnum)
+      {
+        curstream->jslot->nstime = curstream->durnstime;
+        curstream->jslot->seqnum = curstream->durseqnum;
+      }
+    }
+  }
+
+  if (msync (journal->map, journal->size, MS_SYNC))
+  {
+    sl_log_r (slconn, 2, 0, "cannot sync state journal, %s\n", strerror (errno));
+    return -1;
+  }
+
+  return 0;
+#endif
+} /* End of sl_syncjournal() */
+
+/***************************************************************************
+ * sl_closejournal:
+ *
+ * Sync and close the state journal and detach the slots from the
+ * stream chain.
+ *
+ * Returns:
+ * -1 : error
+ *  0 : completed successfully or no journal is open
+ ***************************************************************************/
+int
+sl_closejournal (SLCD *slconn)
+{
+#if defined(SLP_WIN)
+  return 0;
+#else
+  struct sljournal_s *journal;
+  SLstream *curstream;
+  int retval;
+
+  if (!slconn || !slconn->stat || !(journal = slconn->stat->journal))
+    return 0;
+
+  retval = sl_syncjournal (slconn);
+
+  for (curstream = slconn->streams; curstream != NULL; curstream = curstream->next)
+    curstream->jslot = NULL;
+
+  munmap (journal->map, journal->size);
+
+  if (close (journal->fd))
+  {
+    sl_log_r (slconn, 2, 0, "cannot close state journal, %s\n", strerror (errno));
+    retval = -1;
+  }
+
+  free (journal);
+  slconn->stat->journal = NULL;
+
+  return retval;
+#endif
+} /* End of sl_closejournal() */
+
+#if !defined(SLP_WIN)
+/***************************************************************************
+ * read_journal:
+ *
+ * Read an existing journal file into memory and validate the header.
+ * A journal that does not exist is not an error, a journal with an
+ * invalid header is ignored with a warning.
+ *
+ * Returns the allocated journal contents and sets 'slotcount', or
+ * NULL if there is no usable journal.
+ ***************************************************************************/
+static char *
+read_journal (SLCD *slconn, const char *journalfile, uint32_t *slotcount)
+{
+  SLjheader header;
+  char *contents;
+  size_t size;
+  int fd;
+
+  if ((fd = slp_openfile (journalfile, 'r')) < 0)
+  {
+    if (errno == ENOENT)
+      sl_log_r (slconn, 1, 0, "could not find state journal: %s\n", journalfile);
+    else
+      sl_log_r (slconn, 2, 0, "could not open state journal, %s\n", strerror (errno));
+
+    return NULL;
+  }
+
+  if (read (fd, &header, sizeof (header)) != sizeof (header) ||
+      memcmp (header.magic, SLJ_MAGIC, sizeof (header.magic)) ||
+      header.version != SLJ_VERSION || header.order != SLJ_ORDER ||
+      header.slotsize != sizeof (SLjslot) || header.slotcount > 1000000)
+  {
+    sl_log_r (slconn, 1, 0, "ignoring unrecognized state journal: %s\n", journalfile);
+    close (fd);
+    return NULL;
+  }
+
+  size = sizeof (SLjheader) + (size_t)header.slotcount * sizeof (SLjslot);
+
+  if ((contents = (char *)malloc (size)) == NULL)
+  {
+    sl_log_r (slconn, 2, 0, "%s(): cannot allocate memory\n", __func__);
+    close (fd);
+    return NULL;
+  }
+
+  memcpy (contents, &header, sizeof (header));
+
+  if (read (fd, contents + sizeof (header), size - sizeof (header)) != (int)(size - sizeof (header)))
+  {
+    sl_log_r (slconn, 1, 0, "ignoring truncated state journal: %s\n", journalfile);
+    free (contents);
+    close (fd);
+    return NULL;
+  }
+
+  close (fd);
+
+  *slotcount = header.slotcount;
+
+  return contents;
+} /* End of read_journal() */
+
+/***************************************************************************
+ * recover_stream:
+ *
+ * Set the sequence number and time stamp of a stream entry from a
+ * journal slot.
+ ***************************************************************************/
+static void
+recover_stream (SLstream *curstream, const SLjslot *slot)
+{
+  curstream->seqnum = curstream->ackseqnum = curstream->durseqnum = slot->seqnum;
+
+  if (slot->nstime == 0 || !sl_nstime2timestamp (slot->nstime, curstream->timestamp))
+    return;
+
+  curstream->nstime = curstream->acknstime = curstream->durnstime = slot->nstime;
+  curstream->tsstale = 0;
+} /* End of recover_stream() */
+#endif /* !SLP_WIN */
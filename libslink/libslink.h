@@ -28,14 +28,15 @@
 extern "C" {
 #endif
 
-#define LIBSLINK_VERSION "2.7.1"       /**< libslink version */
-#define LIBSLINK_RELEASE "2023.007"    /**< libslink release date */
+#define LIBSLINK_VERSION "3.0.0"       /**< libslink version */
+#define LIBSLINK_RELEASE "2026.292"    /**< libslink release date */
 
 /** @defgroup seedlink-connection SeedLink Connection */
 /** @defgroup connection-state Connection State */
 /** @defgroup logging Central Logging */
 /** @defgroup miniseed-record miniSEED Records */
 /** @defgroup utility-functions General Utility Functions */
+/** @defgroup timing-probes Timing Probes */
 
 
 /* Portability to the XScale (ARM) architecture requires a packed
@@ -106,6 +107,7 @@ extern "C" {
   #include <sys/stat.h>
   #include <sys/socket.h>
   #include <netinet/in.h>
+  #include <netinet/tcp.h>
   #include <netdb.h>
   #include <sys/time.h>
   #include <sys/utsname.h>
@@ -117,6 +119,7 @@ extern "C" {
   #include <errno.h>
   #include <sys/socket.h>
   #include <netinet/in.h>
+  #include <netinet/tcp.h>
   #include <netdb.h>
   #include <sys/time.h>
   #include <sys/utsname.h>
@@ -175,6 +178,8 @@ typedef struct SLlog_s
 
 #define SL_DEFAULT_HOST "localhost"  /**< Default host for libslink */
 #define SL_DEFAULT_PORT "18000"      /**< Default port for libslink */
+#define SL_CONNECT_TIMEOUT 10        /**< Timeout for socket connection (seconds) */
+#define SL_ADDRCACHE_TTL 300         /**< Time to cache resolved server addresses (seconds) */
 
 #define SLRECSIZEMIN        48       /**< Min supported miniSEED record size */
 #define SLRECSIZEMAX        4096     /**< Max supported miniSEED record size */
@@ -218,8 +223,38 @@ typedef struct slpacket_s
   char    *slhead;              /**< SeedLink header */
   char    *msrecord;            /**< miniSEED record */
   int      reclen;              /**< miniSEED record length */
+  int      seqnum;              /**< SeedLink sequence number, as sl_sequence() */
+  int      packettype;          /**< Packet type, as sl_packettype() */
+  uint8_t  formatversion;       /**< miniSEED format version of the record */
+  uint8_t  swapflag;            /**< Record header byte order differs from host order */
+  uint16_t b100;                /**< Offset of blockette 100, 0 if absent */
+  uint16_t b1000;               /**< Offset of blockette 1000, 0 if absent */
+  uint16_t b1001;               /**< Offset of blockette 1001, 0 if absent */
+  double   starttime;           /**< Record start time, epoch seconds */
 } SLpacket;
 
+/** @brief Epoch time in nanoseconds since 1970-01-01T00:00:00 UTC */
+typedef int64_t SLnstime;
+
+#define SL_NSTMODULUS 1000000000                /**< Nanoseconds per second */
+#define SL_NSTERROR   (-2145916800000000000LL)  /**< SLnstime error value */
+
+/** @brief Convert a SLnstime to a double precision epoch time */
+#define SL_NSTIME2EPOCH(X) ((double)(X) / SL_NSTMODULUS)
+
+/** @brief Binary state journal slot, one per stream, see sl_openjournal()
+
+    The slots follow a 64 byte header in the journal file and are
+    updated in place, in host byte order, for every packet received. */
+typedef struct sljslot_s
+{
+  char    net[16];              /**< The network code */
+  char    sta[16];              /**< The station code */
+  int64_t nstime;               /**< Start time of the last packet, nanoseconds since the epoch */
+  int32_t seqnum;               /**< SeedLink sequence number of the last packet */
+  int32_t reserved[5];          /**< Reserved, pads the slot to 64 bytes */
+} SLjslot;
+
 /** @brief Stream information */
 typedef struct slstream_s
 {
@@ -227,10 +262,28 @@ typedef struct slstream_s
   char   *sta;      	        /**< The station code */
   char   *selectors;	        /**< SeedLink style selectors for this station */
   int     seqnum;	        /**< SeedLink sequence number for this station */
-  char    timestamp[30];        /**< Time stamp of last packet received */
+  char    timestamp[30];        /**< Time stamp of last packet received, see sl_formattimestamps() */
+  SLnstime nstime;              /**< Start time of last packet received, 0 if unknown */
+  int8_t  tsstale;              /**< Boolean flag, timestamp not yet formatted from nstime */
+  SLjslot *jslot;               /**< State journal slot, NULL if no journal */
+  int     ackseqnum;            /**< Sequence number of the last archived packet, see sl_ackpacket() */
+  SLnstime acknstime;           /**< Start time of the last archived packet */
+  int     durseqnum;            /**< Sequence number saved as durable state, see sl_commitacks() */
+  SLnstime durnstime;           /**< Start time saved as durable state */
+  int8_t  ackfrozen;            /**< Archiving failed, acknowledgements are ignored */
+  struct  slstream_s *nextupdate; /**< Next stream updated by the same packet */
   struct  slstream_s *next;     /**< The next station in the chain */
 } SLstream;
 
+/** @brief Record length of a stream without blockette 1000, see SLstat */
+typedef struct slreclen_s
+{
+  char    key[12];              /**< Station, location, channel and network header fields */
+  int32_t reclen;               /**< Record length found by scanning, 0 if unused */
+} SLreclen;
+
+#define SL_RECLENCACHE 16       /**< Number of entries in the record length cache */
+
 /** @brief Persistent connection state information */
 typedef struct stat_s
 {
@@ -245,12 +298,31 @@ typedef struct stat_s
   int8_t  keepalive_trig;       /**< Send keepalive trigger */
 
   double  netto_time;           /**< Network timeout time stamp */
-  double  netdly_time;          /**< Network re-connect delay time stamp */
+  double  netdly_time;          /**< Network re-connect deadline time stamp */
   double  keepalive_time;       /**< Keepalive time stamp */
+  double  connect_time;         /**< Start time of non-blocking connection attempt */
+
+  int     reconnect_attempts;   /**< Consecutive failed connection attempts */
+  int     reconnect_count;      /**< Number of times a lost connection was re-established */
+  double  disconnect_time;      /**< Time the connection was lost, 0 when established */
+  double  reconnect_time;       /**< Time needed for the last reconnect (secs) */
+  double  negotiate_time;       /**< Time needed for the last stream negotiation (secs) */
+
+  struct slreplay_s *replay;    /**< Replay source state, opaque */
+  struct sljournal_s *journal;  /**< State journal, opaque, see sl_openjournal() */
+  struct slstreamindex_s *streamindex; /**< Index of streams by network and station, opaque */
+  SLstream *laststream;         /**< Last entry in the stream chain, for appending */
+  SLstream *lastupdate;         /**< Streams updated by the last packet, see sl_ackpacket() */
+
+  SLreclen reclencache[SL_RECLENCACHE]; /**< Lengths of records without blockette 1000 */
+
+  struct addrinfo *addrlist;    /**< Cached server addresses */
+  double  addrlist_time;        /**< Time the server addresses were resolved */
+  int     addrlist_next;        /**< Index of server address for next connection */
 
   enum                          /**< Connection state */
     {
-      SL_DOWN, SL_UP, SL_DATA
+      SL_DOWN, SL_UP, SL_DATA, SL_CONNECTING
     }
   sl_state;
 
@@ -276,11 +348,22 @@ typedef struct slcd_s
   int8_t      batchmode;        /**< Batch mode (1 - requested, 2 - activated) */
   int8_t      lastpkttime;      /**< Boolean flag to control last packet time usage */
   int8_t      terminate;        /**< Boolean flag to control connection termination */
+  int8_t      durablestate;     /**< Boolean flag to save only acknowledged state, see sl_ackpacket() */
 
   int         keepalive;        /**< Interval to send keepalive/heartbeat (secs) */
   int         iotimeout;        /**< Timeout for network I/O operations (seconds) */
+  int         resptimeout;      /**< Timeout waiting for a command response (secs), default 30 */
   int         netto;            /**< Network timeout (secs) */
   int         netdly;           /**< Network reconnect delay (secs) */
+  int8_t      netdly_backoff;   /**< Boolean flag to use exponential backoff up to netdly */
+  int8_t      netdly_nowait;    /**< Boolean flag, sl_collect_nb() does not sleep during netdly */
+  int         rcvbufsize;       /**< Socket receive buffer size (bytes), 0 for system default */
+  int8_t      tcpnodelay;       /**< Boolean flag to disable Nagle's algorithm (TCP_NODELAY) */
+  int         busypoll;         /**< Socket busy poll time (usecs), 0 to disable (SO_BUSY_POLL) */
+  int         usertimeout;      /**< TCP user timeout (msecs), 0 for system default */
+
+  char       *replayfile;       /**< File to replay instead of connecting to a server */
+  double      replayrate;       /**< Replay rate (packets/sec), 0 for full speed */
 
   float       protocol_ver;     /**< Version of the SeedLink protocol in use */
   const char *info;             /**< INFO level to request */
@@ -299,6 +382,10 @@ extern int sl_addstream (SLCD *slconn, const char *net, const char *sta,
                          const char *timestamp);
 extern int sl_setuniparams (SLCD *slconn, const char *selectors,
                             int seqnum, const char *timestamp);
+extern SLstream *sl_findstream (SLCD *slconn, const char *net, const char *sta);
+extern void sl_formattimestamps (SLCD *slconn);
+extern int sl_ackpacket (SLCD *slconn, const SLpacket *slpack, int8_t archived);
+extern void sl_commitacks (SLCD *slconn);
 extern int sl_request_info (SLCD *slconn, const char *infostr);
 extern int sl_sequence (const SLpacket *);
 extern int sl_packettype (const SLpacket *);
@@ -313,6 +400,8 @@ extern int sl_configlink (SLCD *slconn);
 extern int sl_send_info (SLCD *slconn, const char *info_level,
                          int verbose);
 extern SOCKET sl_connect (SLCD *slconn, int sayhello);
+extern SOCKET sl_connect_nb (SLCD *slconn);
+extern int sl_connect_poll (SLCD *slconn, int sayhello);
 extern int sl_disconnect (SLCD *slconn);
 extern int sl_ping (SLCD *slconn, char *serverid, char *site);
 extern int sl_senddata (SLCD *slconn, void *buffer, size_t buflen,
@@ -356,6 +445,9 @@ extern SLlog *sl_loginit_rl (SLlog *log, int verbosity,
     @{ */
 extern int sl_recoverstate (SLCD *slconn, const char *statefile);
 extern int sl_savestate (SLCD *slconn, const char *statefile);
+extern int sl_openjournal (SLCD *slconn, const char *journalfile);
+extern int sl_syncjournal (SLCD *slconn);
+extern int sl_closejournal (SLCD *slconn);
 /** @} */
 
 /** @addtogroup miniseed-record
@@ -445,17 +537,30 @@ struct sl_fsdh_s
 #define MSD_STBADLASTMATCH  -5        /**< Steim, last sample does not match */
 #define MSD_STBADCOMPFLAG   -6        /**< Steim, invalid compression flag(s) */
 
+/** @brief Parsed miniSEED 2 record
+
+    The blockette pointers are NULL when the blockette is absent,
+    otherwise they refer to the embedded storage in the struct so that
+    parsing a record does not allocate memory for them. */
 typedef struct SLMSrecord_s {
   const char            *msrecord;    /**< Pointer to original record */
   struct sl_fsdh_s       fsdh;        /**< Fixed Section of Data Header */
   struct sl_blkt_100_s  *Blkt100;     /**< Blockette 100, if present */
   struct sl_blkt_1000_s *Blkt1000;    /**< Blockette 1000, if present */
   struct sl_blkt_1001_s *Blkt1001;    /**< Blockette 1001, if present */
+  struct sl_blkt_100_s   blkt100;     /**< Storage for Blockette 100, see Blkt100 */
+  struct sl_blkt_1000_s  blkt1000;    /**< Storage for Blockette 1000, see Blkt1000 */
+  struct sl_blkt_1001_s  blkt1001;    /**< Storage for Blockette 1001, see Blkt1001 */
   int32_t               *datasamples; /**< Unpacked 32-bit data samples */
+  size_t                 datasize;    /**< Allocated size of datasamples in bytes */
   int32_t                numsamples;  /**< Number of unpacked samples */
   int8_t                 unpackerr;   /**< Unpacking/decompression error flag */
 } SLMSrecord;
 
+extern SLnstime sl_time2nstime (int year, int day, int hour, int min, int sec, uint32_t nsec);
+extern SLnstime sl_timestamp2nstime (const char *timestamp);
+extern char    *sl_nstime2timestamp (SLnstime nstime, char *timestamp);
+
 extern SLMSrecord *sl_msr_new (void);
 extern void sl_msr_free (SLMSrecord **msr);
 extern SLMSrecord *sl_msr_parse (SLlog *log, const char *msrecord, SLMSrecord **msr,
@@ -467,6 +572,73 @@ extern char *sl_msr_srcname (SLMSrecord *msr, char *srcname, int8_t quality);
 extern int sl_msr_dsamprate (SLMSrecord *msr, double *samprate);
 extern double sl_msr_dnomsamprate (SLMSrecord *msr);
 extern double sl_msr_depochstime (SLMSrecord *msr);
+extern SLnstime sl_msr_nstime (SLMSrecord *msr);
+extern SLnstime sl_msr_sampleperiod (SLMSrecord *msr);
+
+#define SL_VIEW_CODESIZE 16     /**< Buffer size for codes returned by sl_view_nslc() */
+
+/** @brief View of a miniSEED 2 or 3 record in place
+
+    Initialized by sl_view_init(), which validates the header and
+    locates the blockettes of interest.  The accessors read header
+    fields directly from the record and byte-swap them as needed, no
+    data is copied. */
+typedef struct SLRecordView_s
+{
+  const char *record;           /**< Start of the record */
+  int         reclen;           /**< Record length in bytes */
+  uint8_t     formatversion;    /**< miniSEED format version, 2 or 3 */
+  uint8_t     swapflag;         /**< Header byte order differs from host order */
+  uint16_t    b100;             /**< Offset of blockette 100, 0 if absent (version 2) */
+  uint16_t    b1000;            /**< Offset of blockette 1000, 0 if absent (version 2) */
+  uint16_t    b1001;            /**< Offset of blockette 1001, 0 if absent (version 2) */
+} SLRecordView;
+
+extern int sl_view_init (SLRecordView *view, const char *record, int reclen);
+extern int sl_view_packet (SLRecordView *view, const SLpacket *slpack);
+extern int sl_view_nslc (const SLRecordView *view, char *net, char *sta,
+                         char *loc, char *chan);
+extern int sl_view_btime (const SLRecordView *view, uint16_t *year, uint16_t *day,
+                          uint8_t *hour, uint8_t *min, uint8_t *sec, uint32_t *nsec);
+extern double sl_view_depochstime (const SLRecordView *view);
+extern SLnstime sl_view_nstime (const SLRecordView *view);
+extern SLnstime sl_view_sampleperiod (const SLRecordView *view);
+extern SLnstime sl_view_lastsamptime (const SLRecordView *view);
+extern double sl_view_samprate (const SLRecordView *view);
+extern int64_t sl_view_numsamples (const SLRecordView *view);
+extern char sl_view_quality (const SLRecordView *view);
+extern int sl_view_verifycrc (const SLRecordView *view);
+extern int64_t sl_msr_decode (SLlog *log, const SLRecordView *view,
+                              int32_t *output, int64_t outputsamples);
+extern int64_t sl_msr_decode_batch (SLlog *log, const SLRecordView *views, int nviews,
+                                    int32_t *output, int64_t outputsamples,
+                                    int64_t *offsets);
+
+/** @brief Contiguous run of samples in a SLTraceBatch */
+typedef struct SLSegment_s
+{
+  int64_t     start;            /**< Index of the first sample in datasamples */
+  int64_t     numsamples;       /**< Number of samples in the segment */
+  double      starttime;        /**< Time of the first sample, Unix/POSIX epoch */
+  double      samprate;         /**< Sample rate in samples per second */
+} SLSegment;
+
+/** @brief Samples of many records of a channel decoded into one array
+
+    Allocated by sl_decode_tracebatch() as a single block including
+    the segment table and samples, free with sl_free_tracebatch(). */
+typedef struct SLTraceBatch_s
+{
+  char        sampletype;       /**< Sample type: 'i' (int32), 'f' (float) or 'd' (double) */
+  int64_t     numsamples;       /**< Total number of samples */
+  void       *datasamples;      /**< Samples of all segments, in time order */
+  int         numsegments;      /**< Number of segments */
+  SLSegment  *segments;         /**< Segments of contiguous samples */
+} SLTraceBatch;
+
+extern SLTraceBatch *sl_decode_tracebatch (SLlog *log, const SLRecordView *views,
+                                           int nviews, char sampletype);
+extern void sl_free_tracebatch (SLTraceBatch **batch);
 /** @} */
 
 /** @addtogroup utility-functions
@@ -476,10 +648,24 @@ extern double sl_msr_depochstime (SLMSrecord *msr);
 
 extern double sl_dtime (void);
 extern int sl_doy2md (int year, int jday, int *month, int *mday);
+extern uint8_t sl_littleendianhost (void);
 extern int sl_checkversion (const SLCD *slconn, float version);
 extern int sl_checkslcd (const SLCD *slconn);
 extern int sl_readline (int fd, char *buffer, int buflen);
 
+/** @brief Buffered line reader for a file descriptor, see sl_readline_buf() */
+typedef struct slreadbuf_s
+{
+  int     fd;                   /**< File descriptor to read from */
+  int     start;                /**< Start of unread data in buf */
+  int     end;                  /**< End of data in buf */
+  char    buf[4096];            /**< Read buffer */
+} SLreadbuf;
+
+extern void sl_readbuf_init (SLreadbuf *readbuf, int fd);
+extern int sl_readline_buf (SLreadbuf *readbuf, char *buffer, int buflen);
+extern uint32_t sl_crc32c (const void *input, size_t length, uint32_t previouscrc);
+
 /*@ @brief For a linked list of strings, as filled by strparse() */
 typedef struct SLstrlist_s {
   char               *element;
@@ -507,6 +693,57 @@ extern void sl_gswap8a (void *data8);
   sl_gswap2 (x.fract);
 /** @} */
 
+/** @addtogroup timing-probes
+    @brief Histograms of cycle counts of processing stages
+
+    Probes are compiled in when SL_PROBES is defined, otherwise the
+    SL_PROBE_ macros are empty.  A stage is timed with SL_PROBE_START()
+    and SL_PROBE_END(), which adds the elapsed ticks of the CPU cycle
+    counter to the histogram of the named probe, registered on first
+    use.  The probes are not thread safe, they are meant for the thread
+    collecting and handling packets.
+
+    @{ */
+#define SL_PROBE_MAX        32       /**< Maximum number of probes */
+#define SL_PROBE_NAMESIZE   24       /**< Maximum length of a probe name */
+#define SL_PROBE_BUCKETS    156      /**< Histogram buckets, 4 per power of 2 ticks */
+
+extern int sl_probe_register (const char *name);
+extern void sl_probe_record (int probe, uint64_t ticks);
+extern void sl_probe_dump (SLlog *log);
+extern void sl_probe_reset (void);
+extern uint64_t sl_probe_ticks (void);
+
+#ifdef SL_PROBES
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+    #define SL_PROBE_TICKS() __rdtsc ()
+  #elif defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define SL_PROBE_TICKS() __rdtsc ()
+  #else
+    #define SL_PROBE_TICKS() sl_probe_ticks ()
+  #endif
+
+  #define SL_PROBE_START(start) uint64_t start = SL_PROBE_TICKS ()
+  #define SL_PROBE_END(start, name)                                     \
+    do {                                                                \
+      static int sl_probe_id = -1;                                      \
+      uint64_t sl_probe_end = SL_PROBE_TICKS ();                        \
+      if (sl_probe_id < 0)                                              \
+        sl_probe_id = sl_probe_register (name);                         \
+      sl_probe_record (sl_probe_id, sl_probe_end - (start));            \
+    } while (0)
+  #define SL_PROBE_DUMP(log) sl_probe_dump (log)
+  #define SL_PROBE_RESET() sl_probe_reset ()
+#else
+  #define SL_PROBE_START(start)
+  #define SL_PROBE_END(start, name)
+  #define SL_PROBE_DUMP(log)
+  #define SL_PROBE_RESET()
+#endif
+/** @} */
+
 #ifdef __cplusplus
 }
 #endif
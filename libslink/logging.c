@@ -302,7 +302,8 @@ sl_log_rl (SLlog *log, int level, int verb, const char *format, ...)
  * sl_loginit_r() they will be pre-pended to the message.
  *
  * All messages will be truncated to the MAX_LOG_MSG_LENGTH, this includes
- * any set prefix.
+ * any set prefix.  The message is built on the stack so that threads
+ * may log concurrently.
  *
  * Returns the number of characters formatted on success, and a
  * a negative value on error.
@@ -310,7 +311,7 @@ sl_log_rl (SLlog *log, int level, int verb, const char *format, ...)
 int
 sl_log_main (SLlog *logp, int level, int verb, const char *format, va_list *varlist)
 {
-  static char message[MAX_LOG_MSG_LENGTH];
+  char message[MAX_LOG_MSG_LENGTH];
   int retvalue = 0;
   int presize;
 
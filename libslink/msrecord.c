@@ -42,6 +42,8 @@
 /* Declare routines only used in this source file */
 void encoding_hash (char enc, char *encstr);
 double host_latency (SLMSrecord *msr);
+static SLnstime nomsampleperiod (int factor, int multiplier);
+static SLnstime rateperiod (double samprate);
 
 /***************************************************************************
  * sl_msr_new:
@@ -95,6 +97,7 @@ sl_msr_new (void)
 
   msr->msrecord    = NULL;
   msr->datasamples = NULL;
+  msr->datasize    = 0;
   msr->numsamples  = -1;
   msr->unpackerr   = MSD_NOERROR;
 
@@ -112,10 +115,6 @@ sl_msr_free (SLMSrecord **msr)
 {
   if (msr != NULL && *msr != NULL)
   {
-    free ((*msr)->Blkt100);
-    free ((*msr)->Blkt1000);
-    free ((*msr)->Blkt1001);
-
     if ((*msr)->datasamples != NULL)
       free ((*msr)->datasamples);
 
@@ -134,7 +133,7 @@ sl_msr_free (SLMSrecord **msr)
  *
  * Returns 1 if the host is little endian, otherwise 0.
  ***************************************************************************/
-static uint8_t
+uint8_t
 sl_littleendianhost (void)
 {
   uint16_t host = 1;
@@ -173,7 +172,10 @@ sl_msr_parse (SLlog *log, const char *msrecord, SLMSrecord **ppmsr,
  * the data samples.
  *
  * All header values, blockette values and data samples will be overwritten
- * by subsequent calls to this function.
+ * by subsequent calls to this function.  Blockettes are stored in the
+ * SLMSrecord itself and the sample buffer is kept between calls, only
+ * growing when a record has more samples than it can hold, so re-using
+ * a SLMSrecord avoids memory allocation in steady state.
  *
  * If the msr struct is NULL it will be allocated.
  *
@@ -212,28 +214,9 @@ sl_msr_parse_size (SLlog *log, const char *msrecord, SLMSrecord **ppmsr,
   }
   else
   {
-    if (msr->Blkt100 != NULL)
-    {
-      free (msr->Blkt100);
-      msr->Blkt100 = NULL;
-    }
-    if (msr->Blkt1000 != NULL)
-    {
-      free (msr->Blkt1000);
-      msr->Blkt1000 = NULL;
-    }
-
-    if (msr->Blkt1001 != NULL)
-    {
-      free (msr->Blkt1001);
-      msr->Blkt1001 = NULL;
-    }
-
-    if (msr->datasamples != NULL)
-    {
-      free (msr->datasamples);
-      msr->datasamples = NULL;
-    }
+    msr->Blkt100  = NULL;
+    msr->Blkt1000 = NULL;
+    msr->Blkt1001 = NULL;
   }
 
   msr->msrecord = msrecord;
@@ -271,19 +254,9 @@ sl_msr_parse_size (SLlog *log, const char *msrecord, SLMSrecord **ppmsr,
   /* Parse the blockettes if requested */
   if (blktflag)
   {
-    /* Define some structures */
-    struct sl_blkt_head_s *blkt_head;
-    struct sl_blkt_100_s *blkt_100;
-    struct sl_blkt_1000_s *blkt_1000;
-    struct sl_blkt_1001_s *blkt_1001;
+    struct sl_blkt_head_s blkt_head;
     uint16_t begin_blockette; /* byte offset for next blockette */
 
-    /* Initialize the blockette structures */
-    blkt_head = (struct sl_blkt_head_s *)malloc (sizeof (struct sl_blkt_head_s));
-    blkt_100  = NULL;
-    blkt_1000 = NULL;
-    blkt_1001 = NULL;
-
     /* loop through blockettes as long as number is non-zero and viable */
     begin_blockette = msr->fsdh.begin_blockette;
 
@@ -291,63 +264,58 @@ sl_msr_parse_size (SLlog *log, const char *msrecord, SLMSrecord **ppmsr,
            (begin_blockette <= slrecsize))
     {
 
-      memcpy ((void *)blkt_head, msrecord + begin_blockette,
+      memcpy ((void *)&blkt_head, msrecord + begin_blockette,
               sizeof (struct sl_blkt_head_s));
       if (headerswapflag)
       {
-        sl_gswap2 (&blkt_head->blkt_type);
-        sl_gswap2 (&blkt_head->next_blkt);
+        sl_gswap2 (&blkt_head.blkt_type);
+        sl_gswap2 (&blkt_head.next_blkt);
       }
 
-      if (blkt_head->blkt_type == 100)
+      if (blkt_head.blkt_type == 100)
       { /* found a 100 blockette */
-        blkt_100 = (struct sl_blkt_100_s *)malloc (sizeof (struct sl_blkt_100_s));
-        memcpy ((void *)blkt_100, msrecord + begin_blockette,
+        memcpy ((void *)&msr->blkt100, msrecord + begin_blockette,
                 sizeof (struct sl_blkt_100_s));
 
         if (headerswapflag)
         {
-          sl_gswap4 (&blkt_100->sample_rate);
+          sl_gswap4 (&msr->blkt100.sample_rate);
         }
 
-        blkt_100->blkt_type = blkt_head->blkt_type;
-        blkt_100->next_blkt = blkt_head->next_blkt;
+        msr->blkt100.blkt_type = blkt_head.blkt_type;
+        msr->blkt100.next_blkt = blkt_head.next_blkt;
 
-        msr->Blkt100 = blkt_100;
+        msr->Blkt100 = &msr->blkt100;
       }
 
-      if (blkt_head->blkt_type == 1000)
+      if (blkt_head.blkt_type == 1000)
 
       { /* found the 1000 blockette */
-        blkt_1000 =
-            (struct sl_blkt_1000_s *)malloc (sizeof (struct sl_blkt_1000_s));
-        memcpy ((void *)blkt_1000, msrecord + begin_blockette,
+        memcpy ((void *)&msr->blkt1000, msrecord + begin_blockette,
                 sizeof (struct sl_blkt_1000_s));
 
-        blkt_1000->blkt_type = blkt_head->blkt_type;
-        blkt_1000->next_blkt = blkt_head->next_blkt;
+        msr->blkt1000.blkt_type = blkt_head.blkt_type;
+        msr->blkt1000.next_blkt = blkt_head.next_blkt;
 
-        msr->Blkt1000 = blkt_1000;
+        msr->Blkt1000 = &msr->blkt1000;
       }
 
-      if (blkt_head->blkt_type == 1001)
+      if (blkt_head.blkt_type == 1001)
       { /* found a 1001 blockette */
-        blkt_1001 =
-            (struct sl_blkt_1001_s *)malloc (sizeof (struct sl_blkt_1001_s));
-        memcpy ((void *)blkt_1001, msrecord + begin_blockette,
+        memcpy ((void *)&msr->blkt1001, msrecord + begin_blockette,
                 sizeof (struct sl_blkt_1001_s));
 
-        blkt_1001->blkt_type = blkt_head->blkt_type;
-        blkt_1001->next_blkt = blkt_head->next_blkt;
+        msr->blkt1001.blkt_type = blkt_head.blkt_type;
+        msr->blkt1001.next_blkt = blkt_head.next_blkt;
 
-        msr->Blkt1001 = blkt_1001;
+        msr->Blkt1001 = &msr->blkt1001;
       }
 
       /* Point to the next blockette */
-      begin_blockette = blkt_head->next_blkt;
+      begin_blockette = blkt_head.next_blkt;
     } /* End of while looping through blockettes */
 
-    if (blkt_1000 == NULL)
+    if (msr->Blkt1000 == NULL)
     {
       sl_log_rl (log, 1, 0, "1000 blockette was NOT found for %s.%s.%s.%s!",
                  msr->fsdh.network, msr->fsdh.station,
@@ -356,14 +324,12 @@ sl_msr_parse_size (SLlog *log, const char *msrecord, SLMSrecord **ppmsr,
     else
     {
       /* no byte swapping of data if little-endian host and little-endian data */
-      if (sl_littleendianhost () && blkt_1000->word_swap == 0)
+      if (sl_littleendianhost () && msr->Blkt1000->word_swap == 0)
         dataswapflag = 0;
       /* no byte swapping of data if big-endian host and big-endian data */
-      else if (!sl_littleendianhost () && blkt_1000->word_swap == 1)
+      else if (!sl_littleendianhost () && msr->Blkt1000->word_swap == 1)
         dataswapflag = 0;
     }
-
-    free (blkt_head);
   }
 
   /* Unpack the data samples if requested */
@@ -641,30 +607,666 @@ sl_msr_dnomsamprate (SLMSrecord *msr)
  ***************************************************************************/
 double
 sl_msr_depochstime (SLMSrecord *msr)
+{
+  SLnstime nstime;
+
+  nstime = sl_msr_nstime (msr);
+
+  if (nstime == SL_NSTERROR)
+    return 0;
+
+  return SL_NSTIME2EPOCH (nstime);
+} /* End of sl_msr_depochstime() */
+
+/***************************************************************************
+ * sl_msr_nstime:
+ *
+ * Return the record start time of a SLMSrecord as nanoseconds since
+ * the epoch, including the microsecond offset in blockette 1001.
+ *
+ * Returns the start time or SL_NSTERROR on error.
+ ***************************************************************************/
+SLnstime
+sl_msr_nstime (SLMSrecord *msr)
 {
   struct sl_btime_s *btime;
-  double dtime;
+  SLnstime nstime;
 
   if (!msr)
-    return 0;
+    return SL_NSTERROR;
 
   btime = &msr->fsdh.start_time;
 
-  dtime = (double)(btime->year - 1970) * 31536000 +
-          ((btime->year - 1969) / 4) * 86400 +
-          (btime->day - 1) * 86400 +
-          btime->hour * 3600 +
-          btime->min * 60 +
-          btime->sec +
-          (double)btime->fract / 10000.0;
+  nstime = sl_time2nstime (btime->year, btime->day, btime->hour, btime->min,
+                           btime->sec, (uint32_t)btime->fract * 100000);
 
-  if (msr->Blkt1001)
+  if (nstime != SL_NSTERROR && msr->Blkt1001)
+    nstime += (SLnstime)msr->Blkt1001->usec * 1000;
+
+  return nstime;
+} /* End of sl_msr_nstime() */
+
+/***************************************************************************
+ * sl_msr_sampleperiod:
+ *
+ * Return the sample period of a SLMSrecord in nanoseconds.  The rate
+ * in blockette 100 is used if present, otherwise the period is
+ * calculated exactly from the sample rate factor and multiplier.
+ *
+ * Returns the sample period or 0 if the sample rate is unknown.
+ ***************************************************************************/
+SLnstime
+sl_msr_sampleperiod (SLMSrecord *msr)
+{
+  if (!msr)
+    return 0;
+
+  if (msr->Blkt100)
+    return rateperiod ((double)msr->Blkt100->sample_rate);
+
+  return nomsampleperiod (msr->fsdh.samprate_fact, msr->fsdh.samprate_mult);
+} /* End of sl_msr_sampleperiod() */
+
+/***************************************************************************
+ * sl_time2nstime:
+ *
+ * Convert a year, day-of-year, hour, minute, second and nanosecond
+ * time to nanoseconds since the epoch.  Leap years are determined by
+ * the full Gregorian rules, leap seconds are not counted, matching
+ * POSIX time.
+ *
+ * Returns the epoch time or SL_NSTERROR if the values are out of range.
+ ***************************************************************************/
+SLnstime
+sl_time2nstime (int year, int day, int hour, int min, int sec, uint32_t nsec)
+{
+  int64_t days;
+  int prior;
+
+  if (!SL_ISVALIDYEARDAY (year, day) || hour > 23 || min > 59 || sec > 60 ||
+      hour < 0 || min < 0 || sec < 0 || nsec >= SL_NSTMODULUS)
+    return SL_NSTERROR;
+
+  /* Days since 1970 to the start of the year, 477 leap days before 1970 */
+  prior = year - 1;
+  days  = (int64_t)(year - 1970) * 365 + (prior / 4 - prior / 100 + prior / 400) - 477;
+
+  days += day - 1;
+
+  return ((days * 86400 + hour * 3600 + min * 60 + sec) * SL_NSTMODULUS) + nsec;
+} /* End of sl_time2nstime() */
+
+/***************************************************************************
+ * sl_timestamp2nstime:
+ *
+ * Convert a stream time stamp as used by the state file and SeedLink
+ * negotiation, "YYYY,MM,DD,hh,mm,ss", to nanoseconds since the epoch.
+ *
+ * Returns the epoch time or SL_NSTERROR if the time stamp is empty or
+ * invalid.
+ ***************************************************************************/
+SLnstime
+sl_timestamp2nstime (const char *timestamp)
+{
+  static const int monthdays[12] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+  int year, month, mday, hour, min, sec;
+  int day;
+
+  if (!timestamp ||
+      sscanf (timestamp, "%d,%d,%d,%d,%d,%d",
+              &year, &month, &mday, &hour, &min, &sec) != 6 ||
+      month < 1 || month > 12 || mday < 1 || mday > 31)
+    return SL_NSTERROR;
+
+  day = monthdays[month - 1] + mday;
+
+  if (month > 2 && ((year % 4 == 0 && year % 100 != 0) || year % 400 == 0))
+    day++;
+
+  return sl_time2nstime (year, day, hour, min, sec, 0);
+} /* End of sl_timestamp2nstime() */
+
+/***************************************************************************
+ * sl_nstime2timestamp:
+ *
+ * Format nanoseconds since the epoch as a stream time stamp,
+ * "YYYY,MM,DD,hh,mm,ss", into 'timestamp', which must have room for
+ * at least 20 characters.  Sub-second time is truncated.
+ *
+ * Returns 'timestamp' or NULL if 'nstime' is SL_NSTERROR or the year
+ * is not in the range 0 to 9999.
+ ***************************************************************************/
+char *
+sl_nstime2timestamp (SLnstime nstime, char *timestamp)
+{
+  int64_t seconds;
+  int64_t days;
+  int64_t era;
+  int64_t yoe, doy, mp;
+  int year, month, mday;
+  int secofday;
+  char buffer[64];
+
+  if (!timestamp || nstime == SL_NSTERROR)
+    return NULL;
+
+  /* Floor division, times before the epoch are negative */
+  seconds = nstime / SL_NSTMODULUS;
+  if (nstime % SL_NSTMODULUS < 0)
+    seconds--;
+
+  days     = seconds / 86400;
+  secofday = (int)(seconds % 86400);
+  if (secofday < 0)
   {
-    dtime += msr->Blkt1001->usec / 1000000;
+    secofday += 86400;
+    days--;
   }
 
-  return dtime;
-} /* End of sl_msr_depochstime() */
+  /* Civil date from days since the epoch, in 400 year eras from 0000-03-01 */
+  days += 719468;
+  era  = ((days >= 0) ? days : days - 146096) / 146097;
+  yoe  = (days - era * 146097 - ((days - era * 146097) / 1460) +
+          ((days - era * 146097) / 36524) - ((days - era * 146097) / 146096)) / 365;
+  doy  = (days - era * 146097) - (365 * yoe + yoe / 4 - yoe / 100);
+  mp   = (5 * doy + 2) / 153;
+
+  mday  = (int)(doy - (153 * mp + 2) / 5 + 1);
+  month = (int)((mp < 10) ? mp + 3 : mp - 9);
+  year  = (int)(yoe + era * 400 + (month <= 2));
+
+  /* Only 4 digit years fit in the time stamp */
+  if (year < 0 || year > 9999)
+    return NULL;
+
+  /* Format with room for any int values, the result is 19 characters */
+  snprintf (buffer, sizeof (buffer), "%04d,%02d,%02d,%02d,%02d,%02d",
+            year, month, mday, secofday / 3600, (secofday / 60) % 60, secofday % 60);
+
+  memcpy (timestamp, buffer, 20);
+
+  return timestamp;
+} /* End of sl_nstime2timestamp() */
+
+/***************************************************************************
+ * sl_view_init:
+ *
+ * Initialize a SLRecordView for the miniSEED 2 or 3 record at
+ * 'record'.  The header is validated, the byte order determined and
+ * for miniSEED 2 the blockette chain is scanned once for blockettes
+ * 100, 1000 and 1001.
+ *
+ * If 'reclen' is not positive the record length is determined from
+ * the header (miniSEED 3) or blockette 1000 (miniSEED 2), which must
+ * then be within the first MAX_HEADER_SIZE bytes and give a length of
+ * 2^7 to 2^20 bytes.
+ *
+ * The record must remain valid for as long as the view is used.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+sl_view_init (SLRecordView *view, const char *record, int reclen)
+{
+  uint16_t blkt_offset;
+  uint16_t blkt_type;
+  uint16_t next_blkt;
+  int limit;
+
+  if (!view || !record)
+    return -1;
+
+  view->record        = record;
+  view->reclen        = 0;
+  view->formatversion = 0;
+  view->swapflag      = 0;
+  view->b100          = 0;
+  view->b1000         = 0;
+  view->b1001         = 0;
+
+  if (MS3_ISVALIDHEADER (record))
+  {
+    view->formatversion = 3;
+
+    /* miniSEED 3 is always little endian */
+    view->swapflag = !sl_littleendianhost ();
+
+    if (reclen <= 0)
+      reclen = MS3FSDH_LENGTH + *pMS3FSDH_SIDLENGTH (record) +
+               HO2u (*pMS3FSDH_EXTRALENGTH (record), view->swapflag) +
+               HO4u (*pMS3FSDH_DATALENGTH (record), view->swapflag);
+  }
+  else if (MS2_ISVALIDHEADER (record))
+  {
+    view->formatversion = 2;
+
+    if (!MS_ISVALIDYEARDAY (*pMS2FSDH_YEAR (record), *pMS2FSDH_DAY (record)))
+      view->swapflag = 1;
+
+    /* Without a known length only the maximum header size is scanned */
+    limit = (reclen > 0) ? reclen : MAX_HEADER_SIZE;
+
+    blkt_offset = HO2u (*pMS2FSDH_BLOCKETTEOFFSET (record), view->swapflag);
+
+    while (blkt_offset > 47 && (int)(blkt_offset + 4) <= limit)
+    {
+      blkt_type = HO2u (*pMS2B100_TYPE (record + blkt_offset), view->swapflag);
+      next_blkt = HO2u (*pMS2B100_NEXT (record + blkt_offset), view->swapflag);
+
+      if (blkt_type == 100 && (int)(blkt_offset + 12) <= limit)
+        view->b100 = blkt_offset;
+      else if (blkt_type == 1001 && (int)(blkt_offset + 8) <= limit)
+        view->b1001 = blkt_offset;
+      else if (blkt_type == 1000 && (int)(blkt_offset + 8) <= limit)
+      {
+        view->b1000 = blkt_offset;
+
+        /* Record length exponent, only 2^7 to 2^20 bytes are valid */
+        if (reclen <= 0)
+        {
+          if (*pMS2B1000_RECLEN (record + blkt_offset) < 7 ||
+              *pMS2B1000_RECLEN (record + blkt_offset) > 20)
+            return -1;
+
+          reclen = (unsigned int)1 << *pMS2B1000_RECLEN (record + blkt_offset);
+        }
+      }
+
+      /* Blockettes must be in increasing order */
+      if (next_blkt != 0 && next_blkt <= blkt_offset)
+        break;
+
+      blkt_offset = next_blkt;
+    }
+  }
+  else
+  {
+    return -1;
+  }
+
+  if (reclen <= 0)
+    return -1;
+
+  view->reclen = reclen;
+
+  return 0;
+} /* End of sl_view_init() */
+
+/***************************************************************************
+ * sl_view_packet:
+ *
+ * Initialize a SLRecordView for the record of a packet returned by
+ * sl_collect() or sl_collect_nb() using the record description set
+ * when the packet was received, the header is not examined again.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+sl_view_packet (SLRecordView *view, const SLpacket *slpack)
+{
+  if (!view || !slpack || !slpack->msrecord || !slpack->formatversion)
+    return -1;
+
+  view->record        = slpack->msrecord;
+  view->reclen        = slpack->reclen;
+  view->formatversion = slpack->formatversion;
+  view->swapflag      = slpack->swapflag;
+  view->b100          = slpack->b100;
+  view->b1000         = slpack->b1000;
+  view->b1001         = slpack->b1001;
+
+  return 0;
+} /* End of sl_view_packet() */
+
+/***************************************************************************
+ * sl_view_nslc:
+ *
+ * Copy the network, station, location and channel codes of the
+ * record into the supplied buffers, which must each hold at least
+ * SL_VIEW_CODESIZE bytes.  Padding spaces are removed.
+ *
+ * For miniSEED 3 the codes are split from an FDSN source identifier
+ * (FDSN:NET_STA_LOC_B_S_SS).  Single character band, source and
+ * subsource codes are combined into a SEED channel code, otherwise
+ * they are returned separated by underscores.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+sl_view_nslc (const SLRecordView *view, char *net, char *sta,
+              char *loc, char *chan)
+{
+  char sid[256];
+  char *codes[4];
+  char *cptr;
+  int sidlen;
+  int idx;
+
+  if (!view || !net || !sta || !loc || !chan)
+    return -1;
+
+  if (view->formatversion == 2)
+  {
+    sl_strncpclean (net, pMS2FSDH_NETWORK (view->record), 2);
+    sl_strncpclean (sta, pMS2FSDH_STATION (view->record), 5);
+    sl_strncpclean (loc, pMS2FSDH_LOCATION (view->record), 2);
+    sl_strncpclean (chan, pMS2FSDH_CHANNEL (view->record), 3);
+
+    return 0;
+  }
+
+  if (view->formatversion != 3)
+    return -1;
+
+  sidlen = *pMS3FSDH_SIDLENGTH (view->record);
+
+  if (sidlen < 5 || strncmp (pMS3FSDH_SID (view->record), "FDSN:", 5))
+    return -1;
+
+  memcpy (sid, pMS3FSDH_SID (view->record) + 5, sidlen - 5);
+  sid[sidlen - 5] = '\0';
+
+  /* Split network, station and location, the remainder is the channel */
+  cptr = sid;
+  for (idx = 0; idx < 3; idx++)
+  {
+    codes[idx] = cptr;
+
+    if ((cptr = strchr (cptr, '_')) == NULL)
+      return -1;
+
+    *cptr++ = '\0';
+  }
+  codes[3] = cptr;
+
+  /* Collapse B_S_SS to a SEED channel code when each part is one character */
+  if (strlen (codes[3]) == 5 && codes[3][1] == '_' && codes[3][3] == '_')
+  {
+    codes[3][1] = codes[3][2];
+    codes[3][2] = codes[3][4];
+    codes[3][3] = '\0';
+  }
+
+  snprintf (net, SL_VIEW_CODESIZE, "%s", codes[0]);
+  snprintf (sta, SL_VIEW_CODESIZE, "%s", codes[1]);
+  snprintf (loc, SL_VIEW_CODESIZE, "%s", codes[2]);
+  snprintf (chan, SL_VIEW_CODESIZE, "%s", codes[3]);
+
+  return 0;
+} /* End of sl_view_nslc() */
+
+/***************************************************************************
+ * sl_view_btime:
+ *
+ * Return the components of the record start time.  For miniSEED 2 the
+ * nanoseconds include the 0.0001 second fraction, the blockette 1001
+ * microsecond offset is not applied.  Any argument may be NULL.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+sl_view_btime (const SLRecordView *view, uint16_t *year, uint16_t *day,
+               uint8_t *hour, uint8_t *min, uint8_t *sec, uint32_t *nsec)
+{
+  const char *record;
+
+  if (!view || !view->formatversion)
+    return -1;
+
+  record = view->record;
+
+  if (view->formatversion == 3)
+  {
+    if (year)
+      *year = HO2u (*pMS3FSDH_YEAR (record), view->swapflag);
+    if (day)
+      *day = HO2u (*pMS3FSDH_DAY (record), view->swapflag);
+    if (hour)
+      *hour = *pMS3FSDH_HOUR (record);
+    if (min)
+      *min = *pMS3FSDH_MIN (record);
+    if (sec)
+      *sec = *pMS3FSDH_SEC (record);
+    if (nsec)
+      *nsec = HO4u (*pMS3FSDH_NSEC (record), view->swapflag);
+  }
+  else
+  {
+    if (year)
+      *year = HO2u (*pMS2FSDH_YEAR (record), view->swapflag);
+    if (day)
+      *day = HO2u (*pMS2FSDH_DAY (record), view->swapflag);
+    if (hour)
+      *hour = *pMS2FSDH_HOUR (record);
+    if (min)
+      *min = *pMS2FSDH_MIN (record);
+    if (sec)
+      *sec = *pMS2FSDH_SEC (record);
+    if (nsec)
+      *nsec = (uint32_t)HO2u (*pMS2FSDH_FSEC (record), view->swapflag) * 100000;
+  }
+
+  return 0;
+} /* End of sl_view_btime() */
+
+/***************************************************************************
+ * sl_view_depochstime:
+ *
+ * Return the record start time as a double precision (Unix/POSIX)
+ * epoch time, including the blockette 1001 microsecond offset.
+ *
+ * Returns double precision epoch time or 0 for error.
+ ***************************************************************************/
+double
+sl_view_depochstime (const SLRecordView *view)
+{
+  SLnstime nstime;
+
+  nstime = sl_view_nstime (view);
+
+  if (nstime == SL_NSTERROR)
+    return 0;
+
+  return SL_NSTIME2EPOCH (nstime);
+} /* End of sl_view_depochstime() */
+
+/***************************************************************************
+ * sl_view_nstime:
+ *
+ * Return the record start time as nanoseconds since the epoch,
+ * including the blockette 1001 microsecond offset.
+ *
+ * Returns the start time or SL_NSTERROR on error.
+ ***************************************************************************/
+SLnstime
+sl_view_nstime (const SLRecordView *view)
+{
+  uint16_t year, day;
+  uint8_t hour, min, sec;
+  uint32_t nsec;
+  SLnstime nstime;
+
+  if (sl_view_btime (view, &year, &day, &hour, &min, &sec, &nsec))
+    return SL_NSTERROR;
+
+  nstime = sl_time2nstime (year, day, hour, min, sec, nsec);
+
+  if (nstime != SL_NSTERROR && view->formatversion == 2 && view->b1001)
+    nstime += (SLnstime)*pMS2B1001_MICROSECOND (view->record + view->b1001) * 1000;
+
+  return nstime;
+} /* End of sl_view_nstime() */
+
+/***************************************************************************
+ * sl_view_sampleperiod:
+ *
+ * Return the sample period of the record in nanoseconds.  For
+ * miniSEED 2 without blockette 100 the period is calculated exactly
+ * from the sample rate factor and multiplier.
+ *
+ * Returns the sample period or 0 if the sample rate is unknown.
+ ***************************************************************************/
+SLnstime
+sl_view_sampleperiod (const SLRecordView *view)
+{
+  double samprate;
+
+  if (!view)
+    return 0;
+
+  if (view->formatversion == 3)
+  {
+    samprate = HO8f (*pMS3FSDH_SAMPLERATE (view->record), view->swapflag);
+
+    /* Negative values are sample periods in seconds */
+    if (samprate < 0.0)
+      return (SLnstime)(-samprate * SL_NSTMODULUS + 0.5);
+
+    return rateperiod (samprate);
+  }
+  else if (view->formatversion == 2)
+  {
+    if (view->b100)
+      return rateperiod ((double)HO4f (*pMS2B100_SAMPRATE (view->record + view->b100), view->swapflag));
+
+    return nomsampleperiod (HO2d (*pMS2FSDH_SAMPLERATEFACT (view->record), view->swapflag),
+                            HO2d (*pMS2FSDH_SAMPLERATEMULT (view->record), view->swapflag));
+  }
+
+  return 0;
+} /* End of sl_view_sampleperiod() */
+
+/***************************************************************************
+ * sl_view_lastsamptime:
+ *
+ * Return the time of the last sample in the record as nanoseconds
+ * since the epoch; this is the actual last sample time and *not* the
+ * time "covered" by the last sample.
+ *
+ * Returns the last sample time or SL_NSTERROR on error.
+ ***************************************************************************/
+SLnstime
+sl_view_lastsamptime (const SLRecordView *view)
+{
+  SLnstime nstime;
+  int64_t numsamples;
+
+  nstime = sl_view_nstime (view);
+
+  if (nstime == SL_NSTERROR)
+    return SL_NSTERROR;
+
+  numsamples = sl_view_numsamples (view);
+
+  if (numsamples > 1)
+    nstime += (numsamples - 1) * sl_view_sampleperiod (view);
+
+  return nstime;
+} /* End of sl_view_lastsamptime() */
+
+/***************************************************************************
+ * sl_view_samprate:
+ *
+ * Return the sample rate of the record in samples per second.  For
+ * miniSEED 2 the rate in blockette 100 is used if present, otherwise
+ * the nominal rate from the factor and multiplier.
+ *
+ * Returns the sample rate or 0.0 if unknown.
+ ***************************************************************************/
+double
+sl_view_samprate (const SLRecordView *view)
+{
+  double samprate = 0.0;
+  int factor;
+  int multiplier;
+
+  if (!view)
+    return 0.0;
+
+  if (view->formatversion == 3)
+  {
+    samprate = HO8f (*pMS3FSDH_SAMPLERATE (view->record), view->swapflag);
+
+    /* Negative values are sample periods in seconds */
+    if (samprate < 0.0)
+      samprate = -1.0 / samprate;
+  }
+  else if (view->formatversion == 2)
+  {
+    if (view->b100)
+      return (double)HO4f (*pMS2B100_SAMPRATE (view->record + view->b100), view->swapflag);
+
+    factor     = HO2d (*pMS2FSDH_SAMPLERATEFACT (view->record), view->swapflag);
+    multiplier = HO2d (*pMS2FSDH_SAMPLERATEMULT (view->record), view->swapflag);
+
+    if (factor > 0)
+      samprate = (double)factor;
+    else if (factor < 0)
+      samprate = -1.0 / (double)factor;
+
+    if (multiplier > 0)
+      samprate = samprate * (double)multiplier;
+    else if (multiplier < 0)
+      samprate = -1.0 * (samprate / (double)multiplier);
+  }
+
+  return samprate;
+} /* End of sl_view_samprate() */
+
+/***************************************************************************
+ * sl_view_numsamples:
+ *
+ * Returns the number of samples in the record or -1 on error.
+ ***************************************************************************/
+int64_t
+sl_view_numsamples (const SLRecordView *view)
+{
+  if (!view)
+    return -1;
+
+  if (view->formatversion == 3)
+    return HO4u (*pMS3FSDH_NUMSAMPLES (view->record), view->swapflag);
+  else if (view->formatversion == 2)
+    return HO2u (*pMS2FSDH_NUMSAMPLES (view->record), view->swapflag);
+
+  return -1;
+} /* End of sl_view_numsamples() */
+
+/***************************************************************************
+ * sl_view_quality:
+ *
+ * Return the data quality indicator of the record.  miniSEED 3 has no
+ * quality indicator, the publication version is mapped to the
+ * equivalent indicator (1:R, 2:D, 3:Q, 4:M).
+ *
+ * Returns the quality indicator character or 0 on error.
+ ***************************************************************************/
+char
+sl_view_quality (const SLRecordView *view)
+{
+  if (!view)
+    return 0;
+
+  if (view->formatversion == 2)
+    return *pMS2FSDH_DATAQUALITY (view->record);
+
+  if (view->formatversion == 3)
+  {
+    switch (*pMS3FSDH_PUBVERSION (view->record))
+    {
+    case 1:
+      return 'R';
+    case 3:
+      return 'Q';
+    case 4:
+      return 'M';
+    default:
+      return 'D';
+    }
+  }
+
+  return 0;
+} /* End of sl_view_quality() */
 
 /***************************************************************************
  * encoding_hash:
@@ -755,24 +1357,66 @@ encoding_hash (char enc, char *encstr)
 double
 host_latency (SLMSrecord *msr)
 {
-  double dsamprate = 0.0; /* Nominal sampling rate */
-  double span      = 0.0; /* Time covered by the samples */
-  double epoch;           /* Current epoch time */
-  double sepoch;          /* Epoch time of the record start time */
-  double latency = 0.0;
-
-  sl_msr_dsamprate (msr, &dsamprate);
+  SLnstime span = 0; /* Time covered by the samples */
+  SLnstime sepoch;   /* Epoch time of the record start time */
+  double epoch;      /* Current epoch time */
 
   /* Calculate the time covered by the samples */
-  if (dsamprate)
-    span = (double)msr->fsdh.num_samples * (1.0 / dsamprate);
+  span = (SLnstime)msr->fsdh.num_samples * sl_msr_sampleperiod (msr);
 
   /* Grab UTC time according to the system clock */
   epoch = sl_dtime ();
 
   /* Now calculate the latency */
-  sepoch  = sl_msr_depochstime (msr);
-  latency = epoch - sepoch - span;
+  sepoch = sl_msr_nstime (msr);
 
-  return latency;
+  return epoch - SL_NSTIME2EPOCH (sepoch + span);
 } /* End of host_latency() */
+
+/***************************************************************************
+ * nomsampleperiod:
+ *
+ * Calculate the sample period in nanoseconds from a miniSEED 2 sample
+ * rate factor and multiplier.  The rate is kept as an integer ratio
+ * so the period is exact to the nanosecond.
+ *
+ * Returns the sample period or 0 if the rate is zero.
+ ***************************************************************************/
+static SLnstime
+nomsampleperiod (int factor, int multiplier)
+{
+  int64_t numerator   = 1; /* Rate is numerator / denominator */
+  int64_t denominator = 1;
+
+  if (factor == 0 || multiplier == 0)
+    return 0;
+
+  if (factor > 0)
+    numerator *= factor;
+  else
+    denominator *= -factor;
+
+  if (multiplier > 0)
+    numerator *= multiplier;
+  else
+    denominator *= -multiplier;
+
+  return (denominator * SL_NSTMODULUS + numerator / 2) / numerator;
+} /* End of nomsampleperiod() */
+
+/***************************************************************************
+ * rateperiod:
+ *
+ * Convert a sample rate in samples per second to a sample period in
+ * nanoseconds, rounded to the nearest nanosecond.
+ *
+ * Returns the sample period or 0 if the rate is not positive.
+ ***************************************************************************/
+static SLnstime
+rateperiod (double samprate)
+{
+  if (!(samprate > 0.0))
+    return 0;
+
+  return (SLnstime)(SL_NSTMODULUS / samprate + 0.5);
+} /* End of rateperiod() */
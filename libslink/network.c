@@ -37,6 +37,12 @@ static int batchmode_int (SLCD *slconn);
 static int negotiate_uni_int (SLCD *slconn);
 static int negotiate_multi_int (SLCD *slconn);
 static int checksock_int (SOCKET sock, int tosec, int tousec);
+static void setsockopts_int (SLCD *slconn, SOCKET sock);
+static void setiotimeout_int (SLCD *slconn, SOCKET sock);
+static void reportsockopts_int (SLCD *slconn, SOCKET sock);
+static int resolve_int (SLCD *slconn);
+static struct addrinfo *nextaddr_int (SLCD *slconn, int advance);
+static SOCKET connected_int (SLCD *slconn, SOCKET sock, int sayhello);
 
 /***************************************************************************
  * sl_connect:
@@ -63,17 +69,11 @@ static int checksock_int (SOCKET sock, int tosec, int tousec);
 SOCKET
 sl_connect (SLCD *slconn, int sayhello)
 {
-  struct addrinfo *addr0 = NULL;
-  struct addrinfo *addr  = NULL;
-  struct addrinfo hints;
+  struct addrinfo *addr = NULL;
   SOCKET sock;
-  int on = 1;
   int sockstat;
-  long int nport;
-  char nodename[300] = {0};
-  char nodeport[100] = {0};
-  char *ptr, *tail;
-  int timeout;
+  int addrcount;
+  int idx;
 
   if (slp_sockstartup ())
   {
@@ -81,67 +81,17 @@ sl_connect (SLCD *slconn, int sayhello)
     return -1;
   }
 
-  /* Search address host-port separator, first for '@', then ':' */
-  if ((ptr = strchr (slconn->sladdr, '@')) == NULL && (ptr = strchr (slconn->sladdr, ':')))
-  {
-    /* If first ':' is not the last, this is not a separator */
-    if (strrchr (slconn->sladdr, ':') != ptr)
-      ptr = NULL;
-  }
-
-  /* If address begins with the separator */
-  if (slconn->sladdr == ptr)
-  {
-    if (slconn->sladdr[1] == '\0') /* Only a separator */
-    {
-      strcpy (nodename, SL_DEFAULT_HOST);
-      strcpy (nodeport, SL_DEFAULT_PORT);
-    }
-    else /* Only a port */
-    {
-      strcpy (nodename, SL_DEFAULT_HOST);
-      strncpy (nodeport, slconn->sladdr + 1, sizeof (nodeport) - 1);
-    }
-  }
-  /* Otherwise if no separator, use default port */
-  else if (ptr == NULL)
-  {
-    strncpy (nodename, slconn->sladdr, sizeof (nodename) - 1);
-    strcpy (nodeport, SL_DEFAULT_PORT);
-  }
-  /* Otherwise separate host and port */
-  else if ((ptr - slconn->sladdr) < sizeof (nodename))
+  if ((addrcount = resolve_int (slconn)) <= 0)
   {
-    strncpy (nodename, slconn->sladdr, (ptr - slconn->sladdr));
-    nodename[(ptr - slconn->sladdr)] = '\0';
-    strncpy (nodeport, ptr + 1, sizeof (nodeport) - 1);
-  }
-
-  /* Sanity test the port number */
-  nport = strtoul (nodeport, &tail, 10);
-  if (*tail || (nport <= 0 || nport > 0xffff))
-  {
-    sl_log_r (slconn, 2, 0, "server port specified incorrectly\n");
-    slconn->terminate = 1;
     return -1;
   }
 
-  /* Resolve for either IPv4 or IPv6 (PF_UNSPEC) for a TCP stream (SOCK_STREAM) */
-  memset (&hints, 0, sizeof (hints));
-  hints.ai_family   = PF_UNSPEC;
-  hints.ai_socktype = SOCK_STREAM;
-
-  /* Resolve server address */
-  if (getaddrinfo (nodename, nodeport, &hints, &addr0))
-  {
-    sl_log_r (slconn, 2, 0, "cannot resolve hostname %s\n", nodename);
-    return -1;
-  }
-
-  /* Traverse address results trying to connect */
+  /* Traverse cached addresses trying to connect, starting with the next in rotation */
   sock = -1;
-  for (addr = addr0; addr != NULL; addr = addr->ai_next)
+  for (idx = 0; idx < addrcount; idx++)
   {
+    addr = nextaddr_int (slconn, (idx > 0));
+
     /* Create socket */
     if ((sock = socket (addr->ai_family, addr->ai_socktype, addr->ai_protocol)) < 0)
     {
@@ -149,16 +99,10 @@ sl_connect (SLCD *slconn, int sayhello)
     }
 
     /* Set socket I/O timeouts if possible */
-    if (slconn->iotimeout)
-    {
-      timeout = (slconn->iotimeout > 0) ? slconn->iotimeout : -slconn->iotimeout;
+    setiotimeout_int (slconn, sock);
 
-      if (slp_setsocktimeo (sock, timeout) == 1)
-      {
-        /* Negate timeout to indicate socket timeouts are set */
-        slconn->iotimeout = -timeout;
-      }
-    }
+    /* Apply socket tuning, the receive buffer must be set before connecting */
+    setsockopts_int (slconn, sock);
 
     /* Connect socket */
     if ((slp_sockconnect (sock, addr->ai_addr, addr->ai_addrlen)))
@@ -174,18 +118,10 @@ sl_connect (SLCD *slconn, int sayhello)
   if (sock < 0)
   {
     sl_log_r (slconn, 2, 0, "[%s] Cannot connect: %s\n", slconn->sladdr, slp_strerror ());
-    slp_sockclose (sock);
-    freeaddrinfo (addr0);
+    nextaddr_int (slconn, 1);
     return -1;
   }
 
-  freeaddrinfo (addr0);
-
-  if (slconn->iotimeout < 0)
-  {
-    sl_log_r (slconn, 1, 2, "[%s] using system socket timeouts\n", slconn->sladdr);
-  }
-
   /* Set non-blocking IO */
   if (slp_socknoblock (sock))
   {
@@ -194,7 +130,7 @@ sl_connect (SLCD *slconn, int sayhello)
   }
 
   /* Wait up to 10 seconds for the socket to be connected */
-  if ((sockstat = checksock_int (sock, 10, 0)) <= 0)
+  if ((sockstat = checksock_int (sock, SL_CONNECT_TIMEOUT, 0)) <= 0)
   {
     if (sockstat < 0)
     { /* select() returned error */
@@ -202,52 +138,147 @@ sl_connect (SLCD *slconn, int sayhello)
     }
     else
     { /* socket time-out */
-      sl_log_r (slconn, 2, 1, "[%s] socket connect time-out (10s)\n",
-                slconn->sladdr);
+      sl_log_r (slconn, 2, 1, "[%s] socket connect time-out (%ds)\n",
+                slconn->sladdr, SL_CONNECT_TIMEOUT);
     }
 
     slp_sockclose (sock);
+    nextaddr_int (slconn, 1);
     return -1;
   }
   else if (!slconn->terminate)
-  { /* socket connected */
-    sl_log_r (slconn, 1, 1, "[%s] network socket opened\n", slconn->sladdr);
+  {
+    return connected_int (slconn, sock, sayhello);
+  }
 
-    /* Set the SO_KEEPALIVE socket option, although not really useful */
-    if (setsockopt (sock, SOL_SOCKET, SO_KEEPALIVE, (char *)&on, sizeof (on)) < 0)
-      sl_log_r (slconn, 1, 1, "[%s] cannot set SO_KEEPALIVE socket option\n",
-                slconn->sladdr);
+  return -1;
+} /* End of sl_connect() */
+
+/***************************************************************************
+ * sl_connect_nb:
+ *
+ * Start a non-blocking connection to a SeedLink server, the
+ * counterpart of sl_connect() for use in an event loop.  Server
+ * addresses are resolved as described for sl_connect() and cached for
+ * SL_ADDRCACHE_TTL seconds, each attempt uses the next address in
+ * rotation after a failure.
+ *
+ * On success 'slconn->link' is set to the socket, for which the
+ * connection is in progress; completion must be checked with
+ * sl_connect_poll().
+ *
+ * Returns -1 on errors otherwise the socket descriptor created.
+ ***************************************************************************/
+SOCKET
+sl_connect_nb (SLCD *slconn)
+{
+  struct addrinfo *addr = NULL;
+  SOCKET sock;
 
-    slconn->link = sock;
+  if (slp_sockstartup ())
+  {
+    sl_log_r (slconn, 2, 0, "could not initialize network sockets\n");
+    return -1;
+  }
 
-    if (slconn->batchmode)
-      slconn->batchmode = 1;
+  if (resolve_int (slconn) <= 0)
+  {
+    return -1;
+  }
 
-    /* Everything should be connected, say hello if requested */
-    if (sayhello)
-    {
-      if (sayhello_int (slconn) == -1)
-      {
-        slp_sockclose (sock);
-        return -1;
-      }
-    }
+  addr = nextaddr_int (slconn, 0);
+
+  if ((sock = socket (addr->ai_family, addr->ai_socktype, addr->ai_protocol)) < 0)
+  {
+    sl_log_r (slconn, 2, 0, "[%s] cannot create socket: %s\n", slconn->sladdr, slp_strerror ());
+    nextaddr_int (slconn, 1);
+    return -1;
+  }
+
+  setsockopts_int (slconn, sock);
 
-    /* Try to enter batch mode if requested */
-    if (slconn->batchmode)
+  if (slp_socknoblock (sock))
+  {
+    sl_log_r (slconn, 2, 0, "Error setting socket to non-blocking\n");
+    slp_sockclose (sock);
+    return -1;
+  }
+
+  if (slp_sockconnect (sock, addr->ai_addr, addr->ai_addrlen))
+  {
+    sl_log_r (slconn, 2, 0, "[%s] Cannot connect: %s\n", slconn->sladdr, slp_strerror ());
+    slp_sockclose (sock);
+    nextaddr_int (slconn, 1);
+    return -1;
+  }
+
+  sl_log_r (slconn, 1, 2, "[%s] connecting\n", slconn->sladdr);
+
+  slconn->stat->connect_time = sl_dtime ();
+  slconn->link               = sock;
+
+  return sock;
+} /* End of sl_connect_nb() */
+
+/***************************************************************************
+ * sl_connect_poll:
+ *
+ * Check the progress of a connection started with sl_connect_nb()
+ * without blocking.  When the socket is connected the connection is
+ * completed as described for sl_connect(), including the HELLO
+ * exchange if sayhello is true.  If the connection fails or is not
+ * established within SL_CONNECT_TIMEOUT seconds the socket is closed
+ * and the next server address is selected for the following attempt.
+ *
+ * Returns 1 when connected, 0 while in progress and -1 on failure.
+ ***************************************************************************/
+int
+sl_connect_poll (SLCD *slconn, int sayhello)
+{
+  SOCKET sock = slconn->link;
+  int sockstat;
+
+  if (sock == -1)
+  {
+    return -1;
+  }
+
+  if ((sockstat = checksock_int (sock, 0, 0)) == 0)
+  {
+    if ((sl_dtime () - slconn->stat->connect_time) <= SL_CONNECT_TIMEOUT)
     {
-      if (batchmode_int (slconn) == -1)
-      {
-        slp_sockclose (sock);
-        return -1;
-      }
+      return 0;
     }
 
-    return sock;
+    sl_log_r (slconn, 2, 1, "[%s] socket connect time-out (%ds)\n",
+              slconn->sladdr, SL_CONNECT_TIMEOUT);
+  }
+  else if (sockstat < 0)
+  {
+    sl_log_r (slconn, 2, 1, "[%s] socket connect error: %s\n",
+              slconn->sladdr, slp_strerror ());
   }
 
+  /* Link is only set to a connected socket by connected_int() */
+  slconn->link = -1;
+
+  if (sockstat > 0 && !slconn->terminate)
+  {
+    /* Set socket I/O timeouts as sl_connect() does */
+    setiotimeout_int (slconn, sock);
+
+    if (connected_int (slconn, sock, sayhello) != -1)
+      return 1;
+  }
+  else
+  {
+    slp_sockclose (sock);
+  }
+
+  nextaddr_int (slconn, 1);
+
   return -1;
-} /* End of sl_connect() */
+} /* End of sl_connect_poll() */
 
 /***************************************************************************
  * sl_configlink:
@@ -263,6 +294,10 @@ SOCKET
 sl_configlink (SLCD *slconn)
 {
   SOCKET ret = -1;
+  double starttime = sl_dtime ();
+
+  /* Time stamps are formatted lazily, the resume requests use them */
+  sl_formattimestamps (slconn);
 
   if (slconn->multistation)
   {
@@ -281,6 +316,8 @@ sl_configlink (SLCD *slconn)
   else
     ret = negotiate_uni_int (slconn);
 
+  slconn->stat->negotiate_time = sl_dtime () - starttime;
+
   return ret;
 } /* End of sl_configlink() */
 
@@ -333,7 +370,15 @@ sl_send_info (SLCD *slconn, const char *info_level, int verbose)
 int
 sl_disconnect (SLCD *slconn)
 {
-  if (slconn->link != -1)
+  if (slconn->link != -1 && slconn->replayfile)
+  {
+    /* The link is the file descriptor of the replay file */
+    close (slconn->link);
+    slconn->link = -1;
+
+    sl_log_r (slconn, 1, 1, "replay file %s closed\n", slconn->replayfile);
+  }
+  else if (slconn->link != -1)
   {
     slp_sockclose (slconn->link);
     slconn->link = -1;
@@ -514,11 +559,16 @@ sl_recvdata (SLCD *slconn, void *buffer, size_t maxbytes,
  *
  * To receive a response to a command recv() one byte at a time until
  * '\r\n' or up to 'maxbytes' is read from 'slconn->link' into a
- * specified 'buffer'.  The function will wait up to 30 seconds for a
- * response to be recv'd.  'command' is a string to be included in
- * error messages indicating which command the response is
- * for. 'ident' is a string to be included in error messages for
- * identification, usually the address of the remote server.
+ * specified 'buffer'.  The function will wait up to
+ * 'slconn->resptimeout' seconds (30 if not set) for a response to be
+ * recv'd.  While no data is available the function waits in select()
+ * on 'slconn->link', returning as soon as data arrives and checking
+ * the timeout and terminate flag at least every 0.05 seconds.  An
+ * error is logged and -1 returned if the timeout expires.  'command'
+ * is a string to be included in error messages indicating which
+ * command the response is for. 'ident' is a string to be included in error
+ * messages for identification, usually the address of the remote
+ * server.
  *
  * It should not be assumed that the populated buffer contains a
  * terminated string.
@@ -532,18 +582,24 @@ sl_recvresp (SLCD *slconn, void *buffer, size_t maxbytes,
 
   int bytesread = 0;     /* total bytes read */
   int recvret   = 0;     /* return from sl_recvdata */
-  int ackcnt    = 0;     /* counter for the read loop */
-  int ackpoll   = 50000; /* poll at 0.05 seconds for reading */
+  int ackpoll   = 50000; /* select() wait of 0.05 seconds */
+  int timeout;
+  double deadline;
+  fd_set readset;
+  struct timeval to;
 
   if (buffer == NULL)
   {
     return -1;
   }
 
+  timeout  = (slconn->resptimeout > 0) ? slconn->resptimeout : 30;
+  deadline = sl_dtime () + timeout;
+
   /* Clear the receiving buffer */
   memset (buffer, 0, maxbytes);
 
-  /* Recv a byte at a time and wait up to 30 seconds for a response */
+  /* Recv a byte at a time and wait up to the timeout for a response */
   while (bytesread < maxbytes)
   {
     recvret = sl_recvdata (slconn, (char *)buffer + bytesread, 1, ident);
@@ -575,21 +631,25 @@ sl_recvresp (SLCD *slconn, void *buffer, size_t maxbytes,
       return bytesread;
     }
 
-    /* Trap door if 30 seconds has elapsed, (ackpoll x 600) */
-    if (ackcnt > 600)
+    /* Trap door if the timeout has elapsed */
+    if (recvret == 0 && sl_dtime () > deadline)
     {
-      sl_log_r (slconn, 2, 0, "[%s] timeout waiting for response to '%.*s'\n",
-                ident,
+      sl_log_r (slconn, 2, 0, "[%s] timeout (%ds) waiting for response to '%.*s'\n",
+                ident, timeout,
                 (int)strcspn (command, "\r\n"),
                 command);
       return -1;
     }
 
-    /* Delay if no data received */
+    /* Wait for data, returning as soon as the response arrives */
     if (recvret == 0)
     {
-      slp_usleep (ackpoll);
-      ackcnt++;
+      FD_ZERO (&readset);
+      FD_SET (slconn->link, &readset);
+      to.tv_sec  = 0;
+      to.tv_usec = ackpoll;
+
+      select (slconn->link + 1, &readset, NULL, NULL, &to);
     }
   }
 
@@ -1358,6 +1418,331 @@ negotiate_multi_int (SLCD *slconn)
   return slconn->link;
 } /* End of negotiate_multi_int() */
 
+/***************************************************************************
+ * resolve_int:
+ *
+ * Resolve the server address in 'slconn->sladdr' into the address
+ * cache of the connection, see sl_connect() for the address format.
+ * Cached addresses are reused for SL_ADDRCACHE_TTL seconds to avoid
+ * a (blocking) resolver call on every reconnect.
+ *
+ * If a permanent error is detected (invalid port specified) the
+ * slconn->terminate flag will be set.
+ *
+ * Returns the number of cached addresses on success and -1 on error.
+ ***************************************************************************/
+static int
+resolve_int (SLCD *slconn)
+{
+  struct addrinfo *addr0 = NULL;
+  struct addrinfo *addr  = NULL;
+  struct addrinfo hints;
+  long int nport;
+  char nodename[300] = {0};
+  char nodeport[100] = {0};
+  char *ptr, *tail;
+  double now;
+  int count;
+
+  now = sl_dtime ();
+
+  if (slconn->stat->addrlist &&
+      (now - slconn->stat->addrlist_time) < SL_ADDRCACHE_TTL)
+  {
+    for (count = 0, addr = slconn->stat->addrlist; addr; addr = addr->ai_next)
+      count++;
+
+    return count;
+  }
+
+  /* Search address host-port separator, first for '@', then ':' */
+  if ((ptr = strchr (slconn->sladdr, '@')) == NULL && (ptr = strchr (slconn->sladdr, ':')))
+  {
+    /* If first ':' is not the last, this is not a separator */
+    if (strrchr (slconn->sladdr, ':') != ptr)
+      ptr = NULL;
+  }
+
+  /* If address begins with the separator */
+  if (slconn->sladdr == ptr)
+  {
+    if (slconn->sladdr[1] == '\0') /* Only a separator */
+    {
+      strcpy (nodename, SL_DEFAULT_HOST);
+      strcpy (nodeport, SL_DEFAULT_PORT);
+    }
+    else /* Only a port */
+    {
+      strcpy (nodename, SL_DEFAULT_HOST);
+      strncpy (nodeport, slconn->sladdr + 1, sizeof (nodeport) - 1);
+    }
+  }
+  /* Otherwise if no separator, use default port */
+  else if (ptr == NULL)
+  {
+    strncpy (nodename, slconn->sladdr, sizeof (nodename) - 1);
+    strcpy (nodeport, SL_DEFAULT_PORT);
+  }
+  /* Otherwise separate host and port */
+  else if ((ptr - slconn->sladdr) < sizeof (nodename))
+  {
+    strncpy (nodename, slconn->sladdr, (ptr - slconn->sladdr));
+    nodename[(ptr - slconn->sladdr)] = '\0';
+    strncpy (nodeport, ptr + 1, sizeof (nodeport) - 1);
+  }
+
+  /* Sanity test the port number */
+  nport = strtoul (nodeport, &tail, 10);
+  if (*tail || (nport <= 0 || nport > 0xffff))
+  {
+    sl_log_r (slconn, 2, 0, "server port specified incorrectly\n");
+    slconn->terminate = 1;
+    return -1;
+  }
+
+  /* Resolve for either IPv4 or IPv6 (PF_UNSPEC) for a TCP stream (SOCK_STREAM) */
+  memset (&hints, 0, sizeof (hints));
+  hints.ai_family   = PF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  /* Resolve server address */
+  if (getaddrinfo (nodename, nodeport, &hints, &addr0) || addr0 == NULL)
+  {
+    sl_log_r (slconn, 2, 0, "cannot resolve hostname %s\n", nodename);
+
+    /* Keep using stale addresses, if any, when the resolver fails */
+    if (slconn->stat->addrlist)
+    {
+      for (count = 0, addr = slconn->stat->addrlist; addr; addr = addr->ai_next)
+        count++;
+
+      return count;
+    }
+
+    return -1;
+  }
+
+  if (slconn->stat->addrlist)
+    freeaddrinfo (slconn->stat->addrlist);
+
+  slconn->stat->addrlist      = addr0;
+  slconn->stat->addrlist_time = now;
+  slconn->stat->addrlist_next = 0;
+
+  for (count = 0, addr = addr0; addr; addr = addr->ai_next)
+    count++;
+
+  sl_log_r (slconn, 1, 2, "[%s] resolved %d address(es)\n", slconn->sladdr, count);
+
+  return count;
+} /* End of resolve_int() */
+
+/***************************************************************************
+ * nextaddr_int:
+ *
+ * Return the cached server address to use for the next connection
+ * attempt, optionally advancing the rotation first.  The address
+ * cache must be populated with resolve_int().
+ ***************************************************************************/
+static struct addrinfo *
+nextaddr_int (SLCD *slconn, int advance)
+{
+  struct addrinfo *addr;
+  int idx;
+
+  if (slconn->stat->addrlist == NULL)
+    return NULL;
+
+  if (advance)
+    slconn->stat->addrlist_next++;
+
+  for (;;)
+  {
+    for (idx = 0, addr = slconn->stat->addrlist;
+         addr && idx < slconn->stat->addrlist_next;
+         idx++, addr = addr->ai_next)
+      ;
+
+    if (addr)
+      return addr;
+
+    slconn->stat->addrlist_next = 0;
+  }
+} /* End of nextaddr_int() */
+
+/***************************************************************************
+ * connected_int:
+ *
+ * Complete a connection for a connected socket: set socket options,
+ * set 'slconn->link', say HELLO if requested and enter batch mode if
+ * configured.  The socket is closed on failure.
+ *
+ * Returns -1 on errors otherwise the socket descriptor.
+ ***************************************************************************/
+static SOCKET
+connected_int (SLCD *slconn, SOCKET sock, int sayhello)
+{
+  int on = 1;
+
+  sl_log_r (slconn, 1, 1, "[%s] network socket opened\n", slconn->sladdr);
+
+  if (slconn->iotimeout < 0)
+    sl_log_r (slconn, 1, 2, "[%s] using system socket timeouts\n", slconn->sladdr);
+
+  /* Set the SO_KEEPALIVE socket option, although not really useful */
+  if (setsockopt (sock, SOL_SOCKET, SO_KEEPALIVE, (char *)&on, sizeof (on)) < 0)
+    sl_log_r (slconn, 1, 1, "[%s] cannot set SO_KEEPALIVE socket option\n",
+              slconn->sladdr);
+
+  reportsockopts_int (slconn, sock);
+
+  slconn->link = sock;
+
+  if (slconn->batchmode)
+    slconn->batchmode = 1;
+
+  /* Everything should be connected, say hello if requested */
+  if (sayhello)
+  {
+    if (sayhello_int (slconn) == -1)
+    {
+      slp_sockclose (sock);
+      slconn->link = -1;
+      return -1;
+    }
+  }
+
+  /* Try to enter batch mode if requested */
+  if (slconn->batchmode)
+  {
+    if (batchmode_int (slconn) == -1)
+    {
+      slp_sockclose (sock);
+      slconn->link = -1;
+      return -1;
+    }
+  }
+
+  return sock;
+} /* End of connected_int() */
+
+/***************************************************************************
+ * setsockopts_int:
+ *
+ * Apply the socket tuning options configured in the SLCD to a new,
+ * unconnected socket.  Failures are logged but are not fatal, options
+ * not supported by the platform are reported as such.
+ ***************************************************************************/
+static void
+setsockopts_int (SLCD *slconn, SOCKET sock)
+{
+  int optval;
+
+  if (slconn->rcvbufsize > 0)
+  {
+    optval = slconn->rcvbufsize;
+    if (setsockopt (sock, SOL_SOCKET, SO_RCVBUF, (char *)&optval, sizeof (optval)) < 0)
+      sl_log_r (slconn, 1, 0, "[%s] cannot set SO_RCVBUF to %d: %s\n",
+                slconn->sladdr, optval, slp_strerror ());
+  }
+
+  if (slconn->tcpnodelay)
+  {
+    optval = 1;
+    if (setsockopt (sock, IPPROTO_TCP, TCP_NODELAY, (char *)&optval, sizeof (optval)) < 0)
+      sl_log_r (slconn, 1, 0, "[%s] cannot set TCP_NODELAY: %s\n",
+                slconn->sladdr, slp_strerror ());
+  }
+
+  if (slconn->busypoll > 0)
+  {
+#if defined(SO_BUSY_POLL)
+    optval = slconn->busypoll;
+    if (setsockopt (sock, SOL_SOCKET, SO_BUSY_POLL, (char *)&optval, sizeof (optval)) < 0)
+      sl_log_r (slconn, 1, 0, "[%s] cannot set SO_BUSY_POLL to %d: %s\n",
+                slconn->sladdr, optval, slp_strerror ());
+#else
+    sl_log_r (slconn, 1, 0, "[%s] SO_BUSY_POLL is not supported on this platform\n",
+              slconn->sladdr);
+#endif
+  }
+
+  if (slconn->usertimeout > 0)
+  {
+#if defined(TCP_USER_TIMEOUT)
+    optval = slconn->usertimeout;
+    if (setsockopt (sock, IPPROTO_TCP, TCP_USER_TIMEOUT, (char *)&optval, sizeof (optval)) < 0)
+      sl_log_r (slconn, 1, 0, "[%s] cannot set TCP_USER_TIMEOUT to %d: %s\n",
+                slconn->sladdr, optval, slp_strerror ());
+#else
+    sl_log_r (slconn, 1, 0, "[%s] TCP_USER_TIMEOUT is not supported on this platform\n",
+              slconn->sladdr);
+#endif
+  }
+} /* End of setsockopts_int() */
+
+/***************************************************************************
+ * setiotimeout_int:
+ *
+ * Set the socket send and receive timeouts to 'slconn->iotimeout'
+ * seconds if configured and supported by the platform.  When the
+ * timeouts are set 'slconn->iotimeout' is negated to indicate that
+ * system socket timeouts are in use.
+ ***************************************************************************/
+static void
+setiotimeout_int (SLCD *slconn, SOCKET sock)
+{
+  int timeout;
+
+  if (slconn->iotimeout)
+  {
+    timeout = (slconn->iotimeout > 0) ? slconn->iotimeout : -slconn->iotimeout;
+
+    if (slp_setsocktimeo (sock, timeout) == 1)
+    {
+      /* Negate timeout to indicate socket timeouts are set */
+      slconn->iotimeout = -timeout;
+    }
+  }
+} /* End of setiotimeout_int() */
+
+/***************************************************************************
+ * reportsockopts_int:
+ *
+ * Log the effective values of the tunable socket options as reported
+ * by the kernel for a connected socket.  The kernel may adjust
+ * requested values, e.g. Linux doubles the SO_RCVBUF size.
+ ***************************************************************************/
+static void
+reportsockopts_int (SLCD *slconn, SOCKET sock)
+{
+  int rcvbuf      = -1;
+  int nodelay     = -1;
+  int busypoll    = -1;
+  int usertimeout = -1;
+  socklen_t optlen;
+
+  optlen = sizeof (rcvbuf);
+  getsockopt (sock, SOL_SOCKET, SO_RCVBUF, (char *)&rcvbuf, &optlen);
+
+  optlen = sizeof (nodelay);
+  getsockopt (sock, IPPROTO_TCP, TCP_NODELAY, (char *)&nodelay, &optlen);
+
+#if defined(SO_BUSY_POLL)
+  optlen = sizeof (busypoll);
+  getsockopt (sock, SOL_SOCKET, SO_BUSY_POLL, (char *)&busypoll, &optlen);
+#endif
+
+#if defined(TCP_USER_TIMEOUT)
+  optlen = sizeof (usertimeout);
+  getsockopt (sock, IPPROTO_TCP, TCP_USER_TIMEOUT, (char *)&usertimeout, &optlen);
+#endif
+
+  sl_log_r (slconn, 1, 1, "[%s] socket options: SO_RCVBUF=%d TCP_NODELAY=%d "
+            "SO_BUSY_POLL=%d TCP_USER_TIMEOUT=%d\n",
+            slconn->sladdr, rcvbuf, nodelay, busypoll, usertimeout);
+} /* End of reportsockopts_int() */
+
 /***************************************************************************
  * checksock_int:
  *
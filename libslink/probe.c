@@ -0,0 +1,288 @@
+/***************************************************************************
+ * probe.c:
+ *
+ * Timing probes: histograms of the CPU cycle counts of processing
+ * stages, see the SL_PROBE_ macros in libslink.h.
+ *
+ * Each probe keeps a fixed histogram with 4 buckets per power of 2
+ * ticks, percentiles are reported within about 12%.  Ticks are
+ * converted to nanoseconds with the tick rate measured against the
+ * system clock since the probes were first used or reset.
+ *
+ * This file is part of the SeedLink Library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libslink.h"
+
+/* The same tick source as SL_PROBE_TICKS() in libslink.h */
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+typedef struct SLprobe_s
+{
+  char     name[SL_PROBE_NAMESIZE];
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t buckets[SL_PROBE_BUCKETS];
+} SLprobe;
+
+static SLprobe probes[SL_PROBE_MAX];
+static int probecount = 0;
+
+/* Ticks and system time when the probes were started or reset */
+static uint64_t startticks = 0;
+static double starttime = 0.0;
+
+static int bucket_index (uint64_t ticks);
+static double bucket_value (int index);
+static double probe_quantile (const SLprobe *probe, double quantile);
+
+/***************************************************************************
+ * sl_probe_ticks:
+ *
+ * Return the current value of the CPU cycle counter, the time base
+ * counter on 64-bit ARM, or the system time in nanoseconds on other
+ * platforms.
+ ***************************************************************************/
+uint64_t
+sl_probe_ticks (void)
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+  return __rdtsc ();
+#elif defined(__GNUC__) && defined(__aarch64__)
+  uint64_t ticks;
+
+  __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r"(ticks));
+
+  return ticks;
+#else
+  return (uint64_t)(sl_dtime () * 1e9);
+#endif
+} /* End of sl_probe_ticks() */
+
+/***************************************************************************
+ * sl_probe_register:
+ *
+ * Return the index of the probe with the given name, adding it if
+ * not yet known.  The name is truncated to SL_PROBE_NAMESIZE - 1
+ * characters.
+ *
+ * Returns the probe index or -1 if the maximum number of probes is
+ * reached, records for index -1 are ignored.
+ ***************************************************************************/
+int
+sl_probe_register (const char *name)
+{
+  int idx;
+
+  if (!name)
+    return -1;
+
+  for (idx = 0; idx < probecount; idx++)
+  {
+    if (!strncmp (probes[idx].name, name, SL_PROBE_NAMESIZE - 1))
+      return idx;
+  }
+
+  if (probecount >= SL_PROBE_MAX)
+    return -1;
+
+  if (probecount == 0 && startticks == 0)
+  {
+    startticks = sl_probe_ticks ();
+    starttime  = sl_dtime ();
+  }
+
+  memset (&probes[probecount], 0, sizeof (SLprobe));
+  strncpy (probes[probecount].name, name, SL_PROBE_NAMESIZE - 1);
+
+  return probecount++;
+} /* End of sl_probe_register() */
+
+/***************************************************************************
+ * sl_probe_record:
+ *
+ * Add a duration in ticks to the histogram of a probe.
+ ***************************************************************************/
+void
+sl_probe_record (int probe, uint64_t ticks)
+{
+  SLprobe *p;
+
+  if (probe < 0 || probe >= probecount)
+    return;
+
+  p = &probes[probe];
+
+  p->count++;
+  p->sum += ticks;
+  if (ticks > p->max)
+    p->max = ticks;
+
+  p->buckets[bucket_index (ticks)]++;
+} /* End of sl_probe_record() */
+
+/***************************************************************************
+ * sl_probe_dump:
+ *
+ * Log the count, mean, median, 99th percentile and maximum of each
+ * probe in nanoseconds, or in ticks if the tick rate cannot be
+ * determined yet.
+ ***************************************************************************/
+void
+sl_probe_dump (SLlog *log)
+{
+  const SLprobe *p;
+  double elapsed;
+  double scale = 0.0; /* Nanoseconds per tick */
+  int idx;
+
+  elapsed = sl_dtime () - starttime;
+
+  if (probecount > 0 && elapsed > 0.01)
+    scale = elapsed * 1e9 / (double)(sl_probe_ticks () - startticks);
+
+  sl_log_rl (log, 1, 0, "Timing probes, %s, over %.1f seconds:\n",
+             (scale > 0.0) ? "nanoseconds" : "ticks", (probecount) ? elapsed : 0.0);
+
+  for (idx = 0; idx < probecount; idx++)
+  {
+    p = &probes[idx];
+
+    if (!p->count)
+    {
+      sl_log_rl (log, 1, 0, "  %-16s count 0\n", p->name);
+      continue;
+    }
+
+    if (scale <= 0.0)
+      sl_log_rl (log, 1, 0, "  %-16s count %llu mean %.0f p50 %.0f p99 %.0f max %llu\n",
+                 p->name, (unsigned long long)p->count, (double)p->sum / p->count,
+                 probe_quantile (p, 0.5), probe_quantile (p, 0.99),
+                 (unsigned long long)p->max);
+    else
+      sl_log_rl (log, 1, 0, "  %-16s count %llu mean %.0f p50 %.0f p99 %.0f max %.0f total %.3fs\n",
+                 p->name, (unsigned long long)p->count, scale * p->sum / p->count,
+                 scale * probe_quantile (p, 0.5), scale * probe_quantile (p, 0.99),
+                 scale * p->max, scale * p->sum / 1e9);
+  }
+} /* End of sl_probe_dump() */
+
+/***************************************************************************
+ * sl_probe_reset:
+ *
+ * Clear the histograms of all probes and restart the tick rate
+ * measurement, the probes remain registered.
+ ***************************************************************************/
+void
+sl_probe_reset (void)
+{
+  int idx;
+
+  for (idx = 0; idx < probecount; idx++)
+  {
+    probes[idx].count = 0;
+    probes[idx].sum   = 0;
+    probes[idx].max   = 0;
+    memset (probes[idx].buckets, 0, sizeof (probes[idx].buckets));
+  }
+
+  startticks = sl_probe_ticks ();
+  starttime  = sl_dtime ();
+} /* End of sl_probe_reset() */
+
+/***************************************************************************
+ * bucket_index:
+ *
+ * Return the histogram bucket for a tick count.  Counts below 4 have
+ * their own buckets, above that each power of 2 is split into 4
+ * buckets by the 2 bits following the leading bit.
+ ***************************************************************************/
+static int
+bucket_index (uint64_t ticks)
+{
+  int exponent;
+  int index;
+
+  if (ticks < 4)
+    return (int)ticks;
+
+#if defined(__GNUC__)
+  exponent = 63 - __builtin_clzll (ticks);
+#else
+  for (exponent = 2; exponent < 63 && (ticks >> (exponent + 1)); exponent++)
+    ;
+#endif
+
+  index = (exponent - 1) * 4 + (int)((ticks >> (exponent - 2)) & 3);
+
+  return (index < SL_PROBE_BUCKETS) ? index : SL_PROBE_BUCKETS - 1;
+} /* End of bucket_index() */
+
+/***************************************************************************
+ * bucket_value:
+ *
+ * Return the middle of the tick range of a histogram bucket.
+ ***************************************************************************/
+static double
+bucket_value (int index)
+{
+  double lower;
+
+  if (index < 4)
+    return index;
+
+  lower = (double)(4 + index % 4) * (double)((uint64_t)1 << (index / 4 - 1));
+
+  return lower + lower / (2.0 * (4 + index % 4));
+} /* End of bucket_value() */
+
+/***************************************************************************
+ * probe_quantile:
+ *
+ * Return the approximate tick count at the given quantile, limited
+ * to the maximum recorded.
+ ***************************************************************************/
+static double
+probe_quantile (const SLprobe *probe, double quantile)
+{
+  uint64_t target;
+  uint64_t seen = 0;
+  double value;
+  int idx;
+
+  target = (uint64_t)(quantile * probe->count);
+  if (target >= probe->count)
+    target = probe->count - 1;
+
+  for (idx = 0; idx < SL_PROBE_BUCKETS; idx++)
+  {
+    seen += probe->buckets[idx];
+
+    if (seen > target)
+      break;
+  }
+
+  value = bucket_value ((idx < SL_PROBE_BUCKETS) ? idx : SL_PROBE_BUCKETS - 1);
+
+  return (value < (double)probe->max) ? value : (double)probe->max;
+} /* End of probe_quantile() */
@@ -152,6 +152,24 @@ slp_noblockcheck (void)
   return 0;
 } /* End of slp_noblockcheck() */
 
+/***************************************************************************
+ * slp_interrupted:
+ *
+ * Return 1 if the last socket call was interrupted by a signal and
+ * 0 otherwise.
+ ***************************************************************************/
+int
+slp_interrupted (void)
+{
+#if defined(SLP_WIN)
+  return (WSAGetLastError () == WSAEINTR) ? 1 : 0;
+
+#else
+  return (errno == EINTR) ? 1 : 0;
+
+#endif
+} /* End of slp_interrupted() */
+
 /***********************************************************************/ /**
  * @brief Set socket I/O timeout
  *
@@ -217,6 +235,7 @@ slp_setsocktimeo (SOCKET socket, int timeout)
  * perm:
  *  'r', open file with read-only permissions
  *  'w', open file with read-write permissions, creating if necessary.
+ *  't', same as 'w' and truncate the file if it exists.
  *
  * Returns the return value of open(), generally this is a positive
  * file descriptor on success and -1 on error.
@@ -227,14 +246,92 @@ slp_openfile (const char *filename, char perm)
 #if defined(SLP_WIN)
   int flags = (perm == 'w') ? (_O_RDWR | _O_CREAT | _O_BINARY) : (_O_RDONLY | _O_BINARY);
   int mode  = (_S_IREAD | _S_IWRITE);
+
+  if (perm == 't')
+    flags = (_O_RDWR | _O_CREAT | _O_TRUNC | _O_BINARY);
 #else
   int flags   = (perm == 'w') ? (O_RDWR | O_CREAT) : O_RDONLY;
   mode_t mode = (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+  if (perm == 't')
+    flags = (O_RDWR | O_CREAT | O_TRUNC);
 #endif
 
   return open (filename, flags, mode);
 } /* End of slp_openfile() */
 
+/***************************************************************************
+ * slp_syncfile:
+ *
+ * Flush the data of an open file to storage.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+slp_syncfile (int fd)
+{
+#if defined(SLP_WIN)
+  return _commit (fd);
+#else
+  return fsync (fd);
+#endif
+} /* End of slp_syncfile() */
+
+/***************************************************************************
+ * slp_replacefile:
+ *
+ * Atomically replace the file 'filename' with the file 'newname'.  On
+ * *nix platforms the directory containing the file is synced after the
+ * rename so the replacement itself is durable.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+slp_replacefile (const char *newname, const char *filename)
+{
+#if defined(SLP_WIN)
+  if (!MoveFileEx (newname, filename, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    return -1;
+
+  return 0;
+#else
+  char dirname[1024];
+  const char *slash;
+  size_t dirlen;
+  int dirfd;
+
+  if (rename (newname, filename))
+    return -1;
+
+  /* Sync the containing directory, "." if there is no path */
+  if ((slash = strrchr (filename, '/')) != NULL)
+  {
+    dirlen = (slash == filename) ? 1 : (size_t) (slash - filename);
+
+    if (dirlen >= sizeof (dirname))
+      return -1;
+
+    memcpy (dirname, filename, dirlen);
+    dirname[dirlen] = '\0';
+  }
+  else
+  {
+    strcpy (dirname, ".");
+  }
+
+  if ((dirfd = open (dirname, O_RDONLY)) < 0)
+    return -1;
+
+  if (fsync (dirfd))
+  {
+    close (dirfd);
+    return -1;
+  }
+
+  return close (dirfd);
+#endif
+} /* End of slp_replacefile() */
+
 /***************************************************************************
  * slp_strerror:
  *
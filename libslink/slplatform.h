@@ -36,8 +36,11 @@ extern int slp_sockconnect (SOCKET sock, struct sockaddr * inetaddr, int addrlen
 extern int slp_sockclose (SOCKET sock);
 extern int slp_socknoblock (SOCKET sock);
 extern int slp_noblockcheck (void);
+extern int slp_interrupted (void);
 extern int slp_setsocktimeo (SOCKET socket, int timeout);
 extern int slp_openfile (const char *filename, char perm);
+extern int slp_syncfile (int fd);
+extern int slp_replacefile (const char *newname, const char *filename);
 extern const char *slp_strerror(void);
 extern double slp_dtime(void);
 extern void slp_usleep(unsigned long int useconds);
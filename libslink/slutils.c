@@ -31,9 +31,72 @@
 #include "slplatform.h"
 #include "mseedformat.h"
 
+/* SSE2 prefilter for header scanning, SSE2 is baseline on x86-64 */
+#if defined(__SSE2__)
+#define SL_SCAN_SSE2 1
+#include <emmintrin.h>
+#else
+#define SL_SCAN_SSE2 0
+#endif
+
 /* Function(s) only used in this source file */
 static int update_stream (SLCD *slconn, const SLpacket *slpack);
-static int detect (const char *record, uint64_t recbuflen, uint8_t *formatversion);
+static int detect (const char *record, uint64_t recbuflen, SLpacket *slpack,
+                   SLstat *stat, int8_t framed);
+static int32_t scan_ms2header (const char *record, uint64_t recbuflen, int8_t framed);
+static int is_boundary (const char *next, int8_t framed);
+static double reconnect_delay (SLCD *slconn, double now);
+static void reconnect_done (SLCD *slconn);
+static int replay_open (SLCD *slconn);
+static int replay_read (SLCD *slconn, char *buffer, int maxbytes, int wait);
+static void mark_update (SLCD *slconn, SLstream *stream, int seqnum, SLnstime nstime);
+static int index_stream (SLCD *slconn, SLstream *stream);
+static struct slmatchmemo_s *match_extras (struct slstreamindex_s *index,
+                                           const char *net, const char *sta);
+static int is_wildcard (const SLstream *stream);
+static uint32_t netsta_hash (const char *net, const char *sta);
+
+/* Replay source state, see replay_open() */
+struct slreplay_s
+{
+  int      fd;              /* File descriptor of replay file */
+  int8_t   raw;             /* Plain miniSEED (1), SeedLink capture (0) or unknown (-1) */
+  int8_t   eof;             /* End of file reached */
+  int      seqnum;          /* Sequence number for generated SeedLink headers */
+  int      buflen;          /* Bytes in staging buffer */
+  double   starttime;       /* Time the replay started */
+  uint64_t packets;         /* Packets replayed */
+  char     buf[2 * (SLHEADSIZE + SLRECSIZEMAX)]; /* Staging buffer */
+};
+
+/* Matches of wildcard and duplicate stream entries, see match_extras() */
+struct slmatchmemo_s
+{
+  char     net[SL_VIEW_CODESIZE]; /* Network code of the data */
+  char     sta[SL_VIEW_CODESIZE]; /* Station code of the data */
+  uint32_t first;           /* Offset of the first match in the match list */
+  uint32_t count;           /* Number of matching entries, may be 0 */
+  int8_t   used;            /* Slot is in use */
+};
+
+/* Open addressing hash index of the stream chain, see index_stream() */
+struct slstreamindex_s
+{
+  uint32_t   size;          /* Number of slots, a power of 2 */
+  uint32_t   count;         /* Number of streams in the index */
+  SLstream **slots;         /* Streams, NULL for empty slots */
+
+  SLstream **extras;        /* Wildcard and duplicate entries, matched with sl_globmatch() */
+  uint32_t   extracount;    /* Number of extra entries */
+  uint32_t   extrasize;     /* Allocated number of extra entries */
+
+  struct slmatchmemo_s *memo; /* Memoized matches of extra entries, by network and station */
+  uint32_t   memosize;      /* Number of memo slots, a power of 2 */
+  uint32_t   memocount;     /* Number of memo slots in use */
+  SLstream **matches;       /* Match lists referenced by memo entries */
+  uint32_t   matchcount;    /* Number of entries in the match lists */
+  uint32_t   matchsize;     /* Allocated number of match list entries */
+};
 
 /***************************************************************************
  * sl_collect:
@@ -56,7 +119,6 @@ sl_collect (SLCD *slconn, SLpacket **slpack)
   double current_time;
   char retpacket;
   int bufferlen;
-  uint8_t formatversion = 0;
 
   /* For select()ing during the read loop */
   struct timeval select_tv;
@@ -97,8 +159,8 @@ sl_collect (SLCD *slconn, SLpacket **slpack)
       /* Check for network timeout */
       if (slconn->stat->sl_state == SL_DATA && slconn->netto && slconn->stat->netto_trig > 0)
       {
-        sl_log_r (slconn, 1, 0, "network timeout (%ds), reconnecting in %ds\n",
-                  slconn->netto, slconn->netdly);
+        sl_log_r (slconn, 1, 0, "network timeout (%ds), reconnecting\n",
+                  slconn->netto);
         slconn->link              = sl_disconnect (slconn);
         slconn->stat->sl_state    = SL_DOWN;
         slconn->stat->netto_trig  = -1;
@@ -107,7 +169,7 @@ sl_collect (SLCD *slconn, SLpacket **slpack)
 
       /* Check if a keepalive packet needs to be sent */
       if (slconn->stat->sl_state == SL_DATA && !slconn->stat->expect_info &&
-          slconn->keepalive && slconn->stat->keepalive_trig > 0)
+          slconn->keepalive && slconn->stat->keepalive_trig > 0 && !slconn->replayfile)
       {
         sl_log_r (slconn, 1, 2, "sending keepalive request\n");
 
@@ -135,16 +197,19 @@ sl_collect (SLCD *slconn, SLpacket **slpack)
         slconn->info = NULL;
       }
 
-      /* Throttle the loop while delaying */
+      /* Sleep until the reconnect deadline, in slices of at most 0.5 seconds */
       if (slconn->stat->sl_state == SL_DOWN && slconn->stat->netdly_trig > 0)
       {
-        slp_usleep (500000);
+        double remaining = slconn->stat->netdly_time - sl_dtime ();
+
+        if (remaining > 0.0)
+          slp_usleep ((unsigned long)(((remaining < 0.5) ? remaining : 0.5) * 1000000));
       }
 
       /* Connect to remote SeedLink */
       if (slconn->stat->sl_state == SL_DOWN && slconn->stat->netdly_trig == 0)
       {
-        if (sl_connect (slconn, 1) != -1)
+        if (((slconn->replayfile) ? replay_open (slconn) : sl_connect (slconn, 1)) != -1)
         {
           slconn->stat->sl_state = SL_UP;
         }
@@ -158,9 +223,14 @@ sl_collect (SLCD *slconn, SLpacket **slpack)
       {
         int slconfret = 0;
 
+        /* Nothing to negotiate when replaying from a file */
+        if (slconn->replayfile)
+        {
+          slconfret = 0;
+        }
         /* Only send query if a query is set and no streams are defined,
          * if streams are defined we'll send the query after configuration. */
-        if (slconn->info && slconn->streams == NULL)
+        else if (slconn->info && slconn->streams == NULL)
         {
           if (sl_send_info (slconn, slconn->info, 1) != -1)
           {
@@ -186,6 +256,8 @@ sl_collect (SLCD *slconn, SLpacket **slpack)
           slconn->stat->recptr   = 0; /* initialize the data buffer pointers */
           slconn->stat->sendptr  = 0;
           slconn->stat->sl_state = SL_DATA;
+
+          reconnect_done (slconn);
         }
         else
         {
@@ -213,7 +285,11 @@ sl_collect (SLCD *slconn, SLpacket **slpack)
 
       slconn->stat->slpack.slhead = &slconn->stat->databuf[slconn->stat->sendptr];
       slconn->stat->slpack.msrecord = &slconn->stat->databuf[slconn->stat->sendptr + SLHEADSIZE];
-      slconn->stat->slpack.reclen = detect (slconn->stat->slpack.msrecord, bufferlen, &formatversion);
+
+      SL_PROBE_START (detectstart);
+      slconn->stat->slpack.reclen = detect (slconn->stat->slpack.msrecord, bufferlen - SLHEADSIZE,
+                                           &slconn->stat->slpack, slconn->stat, 1);
+      SL_PROBE_END (detectstart, "detect");
 
       /* Return error if no miniSEED could be detected */
       if (slconn->stat->slpack.reclen < 0)
@@ -229,12 +305,18 @@ sl_collect (SLCD *slconn, SLpacket **slpack)
         break;
       }
 
-      /* Process an INFO packet */
+      /* Complete the packet description from the SeedLink header */
+      slconn->stat->slpack.seqnum = sl_sequence (&slconn->stat->slpack);
+
       if (!memcmp (slconn->stat->slpack.slhead, INFOSIGNATURE, 6))
+        slconn->stat->slpack.packettype = (slconn->stat->slpack.slhead[SLHEADSIZE - 1] != '*') ? SLINFT : SLINF;
+
+      /* Process an INFO packet */
+      if (slconn->stat->slpack.packettype == SLINF || slconn->stat->slpack.packettype == SLINFT)
       {
         char terminator;
 
-        terminator = (slconn->stat->slpack.slhead[SLHEADSIZE - 1] != '*');
+        terminator = (slconn->stat->slpack.packettype == SLINFT);
 
         if (!slconn->stat->expect_info)
         {
@@ -270,11 +352,13 @@ sl_collect (SLCD *slconn, SLpacket **slpack)
       }
       else /* Update the stream chain entry if not an INFO packet */
       {
+        SL_PROBE_START (updatestart);
         if ((update_stream (slconn, &slconn->stat->slpack)) == -1)
         {
           /* If updating didn't work the packet is broken */
           retpacket = 0;
         }
+        SL_PROBE_END (updatestart, "update_stream");
       }
 
       /* Increment the send pointer */
@@ -329,35 +413,51 @@ sl_collect (SLCD *slconn, SLpacket **slpack)
       /* Check for more available data from the socket */
       bytesread = 0;
 
-      /* Poll the server */
-      FD_ZERO (&select_fd);
-      FD_SET ((unsigned int)slconn->link, &select_fd);
-      select_tv.tv_sec  = 0;
-      select_tv.tv_usec = 500000; /* Block up to 0.5 seconds */
-
-      select_ret = select ((slconn->link + 1), &select_fd, NULL, NULL, &select_tv);
-
-      /* Check the return from select(), an interrupted system call error
-         will be reported if a signal handler was used.  If the terminate
-         flag is set this is not an error. */
-      if (select_ret > 0)
+      /* Read a replay file directly, select() only works for sockets
+         on some platforms and replay_read() waits for due packets */
+      if (slconn->replayfile)
+      {
+        SL_PROBE_START (recvstart);
+        bytesread = replay_read (slconn, &slconn->stat->databuf[slconn->stat->recptr],
+                                 BUFSIZE - slconn->stat->recptr, 1);
+        SL_PROBE_END (recvstart, "recv");
+      }
+      else
       {
-        if (!FD_ISSET (slconn->link, &select_fd))
+        /* Poll the server */
+        FD_ZERO (&select_fd);
+        FD_SET ((unsigned int)slconn->link, &select_fd);
+        select_tv.tv_sec  = 0;
+        select_tv.tv_usec = 500000; /* Block up to 0.5 seconds */
+
+        SL_PROBE_START (selectstart);
+        select_ret = select ((slconn->link + 1), &select_fd, NULL, NULL, &select_tv);
+        SL_PROBE_END (selectstart, "select");
+
+        /* Check the return from select(), an interrupted system call error
+           will be reported if a signal handler was used.  If the terminate
+           flag is set or the call was interrupted this is not an error. */
+        if (select_ret > 0)
         {
-          sl_log_r (slconn, 2, 0, "select() reported data but socket not in set!\n");
+          if (!FD_ISSET (slconn->link, &select_fd))
+          {
+            sl_log_r (slconn, 2, 0, "select() reported data but socket not in set!\n");
+          }
+          else
+          {
+            SL_PROBE_START (recvstart);
+            bytesread = sl_recvdata (slconn, (void *)&slconn->stat->databuf[slconn->stat->recptr],
+                                     BUFSIZE - slconn->stat->recptr, slconn->sladdr);
+            SL_PROBE_END (recvstart, "recv");
+          }
         }
-        else
+        else if (select_ret < 0 && !slconn->terminate && !slp_interrupted ())
         {
-          bytesread = sl_recvdata (slconn, (void *)&slconn->stat->databuf[slconn->stat->recptr],
-                                   BUFSIZE - slconn->stat->recptr, slconn->sladdr);
+          sl_log_r (slconn, 2, 0, "select() error: %s\n", slp_strerror ());
+          slconn->link              = sl_disconnect (slconn);
+          slconn->stat->netdly_trig = -1;
         }
       }
-      else if (select_ret < 0 && !slconn->terminate)
-      {
-        sl_log_r (slconn, 2, 0, "select() error: %s\n", slp_strerror ());
-        slconn->link              = sl_disconnect (slconn);
-        slconn->stat->netdly_trig = -1;
-      }
 
       if (bytesread < 0) /* read() failed */
       {
@@ -407,16 +507,16 @@ sl_collect (SLCD *slconn, SLpacket **slpack)
       }
     }
 
-    /* Network delay timing logic */
+    /* Network delay timing logic, netdly_time is the reconnect deadline */
     if (slconn->netdly)
     {
       if (slconn->stat->netdly_trig == -1) /* reset timer */
       {
-        slconn->stat->netdly_time = current_time;
+        slconn->stat->netdly_time = current_time + reconnect_delay (slconn, current_time);
         slconn->stat->netdly_trig = 1;
       }
       else if (slconn->stat->netdly_trig == 1 &&
-               (current_time - slconn->stat->netdly_time) > slconn->netdly)
+               current_time >= slconn->stat->netdly_time)
       {
         slconn->stat->netdly_trig = 0;
       }
@@ -468,7 +568,6 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int maxrecsize)
   double current_time;
   char retpacket;
   int bufferlen;
-  uint8_t formatversion = 0;
 
 
   *slpack = NULL;
@@ -504,8 +603,8 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int maxrecsize)
     if (slconn->stat->sl_state == SL_DATA &&
         slconn->netto && slconn->stat->netto_trig > 0)
     {
-      sl_log_r (slconn, 1, 0, "network timeout (%ds), reconnecting in %ds\n",
-                slconn->netto, slconn->netdly);
+      sl_log_r (slconn, 1, 0, "network timeout (%ds), reconnecting\n",
+                slconn->netto);
       slconn->link              = sl_disconnect (slconn);
       slconn->stat->sl_state    = SL_DOWN;
       slconn->stat->netto_trig  = -1;
@@ -514,7 +613,7 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int maxrecsize)
 
     /* Check if a keepalive packet needs to be sent */
     if (slconn->stat->sl_state == SL_DATA && !slconn->stat->expect_info &&
-        slconn->keepalive && slconn->stat->keepalive_trig > 0)
+        slconn->keepalive && slconn->stat->keepalive_trig > 0 && !slconn->replayfile)
     {
       sl_log_r (slconn, 1, 2, "sending keepalive request\n");
 
@@ -543,22 +642,44 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int maxrecsize)
       slconn->info = NULL;
     }
 
-    /* Throttle the loop while delaying */
-    if (slconn->stat->sl_state == SL_DOWN && slconn->stat->netdly_trig > 0)
+    /* Throttle the loop while delaying, unless the caller paces itself */
+    if (slconn->stat->sl_state == SL_DOWN && slconn->stat->netdly_trig > 0 &&
+        !slconn->netdly_nowait)
     {
       slp_usleep (500000);
     }
 
-    /* Connect to remote SeedLink */
+    /* Start connecting to remote SeedLink */
     if (slconn->stat->sl_state == SL_DOWN && slconn->stat->netdly_trig == 0)
     {
-      if (sl_connect (slconn, 1) != -1)
+      if (slconn->replayfile && replay_open (slconn) != -1)
       {
         slconn->stat->sl_state = SL_UP;
       }
-      slconn->stat->netto_trig     = -1;
-      slconn->stat->netdly_trig    = -1;
-      slconn->stat->keepalive_trig = -1;
+      else if (!slconn->replayfile && sl_connect_nb (slconn) != -1)
+      {
+        slconn->stat->sl_state = SL_CONNECTING;
+      }
+      else
+      {
+        slconn->stat->netto_trig     = -1;
+        slconn->stat->netdly_trig    = -1;
+        slconn->stat->keepalive_trig = -1;
+      }
+    }
+
+    /* Check if connection in progress is complete */
+    if (slconn->stat->sl_state == SL_CONNECTING)
+    {
+      int connret = sl_connect_poll (slconn, 1);
+
+      if (connret != 0)
+      {
+        slconn->stat->sl_state       = (connret > 0) ? SL_UP : SL_DOWN;
+        slconn->stat->netto_trig     = -1;
+        slconn->stat->netdly_trig    = -1;
+        slconn->stat->keepalive_trig = -1;
+      }
     }
 
     /* Negotiate/configure the connection */
@@ -566,10 +687,15 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int maxrecsize)
     {
       int slconfret = 0;
 
+      /* Nothing to negotiate when replaying from a file */
+      if (slconn->replayfile)
+      {
+        slconfret = 0;
+      }
       /* Only send query if a query is set and no streams are defined,
        * if streams are defined we'll send the query after configuration.
        */
-      if (slconn->info && slconn->streams == NULL)
+      else if (slconn->info && slconn->streams == NULL)
       {
         if (sl_send_info (slconn, slconn->info, 1) != -1)
         {
@@ -595,6 +721,8 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int maxrecsize)
         slconn->stat->recptr   = 0; /* initialize the data buffer pointers */
         slconn->stat->sendptr  = 0;
         slconn->stat->sl_state = SL_DATA;
+
+        reconnect_done (slconn);
       }
       else
       {
@@ -622,7 +750,11 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int maxrecsize)
 
     slconn->stat->slpack.slhead = &slconn->stat->databuf[slconn->stat->sendptr];
     slconn->stat->slpack.msrecord = &slconn->stat->databuf[slconn->stat->sendptr + SLHEADSIZE];
-    slconn->stat->slpack.reclen = detect (slconn->stat->slpack.msrecord, bufferlen, &formatversion);
+
+    SL_PROBE_START (detectstart);
+    slconn->stat->slpack.reclen = detect (slconn->stat->slpack.msrecord, bufferlen - SLHEADSIZE,
+                                         &slconn->stat->slpack, slconn->stat, 1);
+    SL_PROBE_END (detectstart, "detect");
 
     /* Return error if no miniSEED could be detected */
     if (slconn->stat->slpack.reclen < 0)
@@ -638,12 +770,18 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int maxrecsize)
       break;
     }
 
-    /* Process an INFO packet */
+    /* Complete the packet description from the SeedLink header */
+    slconn->stat->slpack.seqnum = sl_sequence (&slconn->stat->slpack);
+
     if (!memcmp (slconn->stat->slpack.slhead, INFOSIGNATURE, 6))
+      slconn->stat->slpack.packettype = (slconn->stat->slpack.slhead[SLHEADSIZE - 1] != '*') ? SLINFT : SLINF;
+
+    /* Process an INFO packet */
+    if (slconn->stat->slpack.packettype == SLINF || slconn->stat->slpack.packettype == SLINFT)
     {
       char terminator;
 
-      terminator = (slconn->stat->slpack.slhead[SLHEADSIZE - 1] != '*');
+      terminator = (slconn->stat->slpack.packettype == SLINFT);
 
       if (!slconn->stat->expect_info)
       {
@@ -679,11 +817,13 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int maxrecsize)
     }
     else /* Update the stream chain entry if not an INFO packet */
     {
+      SL_PROBE_START (updatestart);
       if ((update_stream (slconn, &slconn->stat->slpack)) == -1)
       {
         /* If updating didn't work the packet is broken */
         retpacket = 0;
       }
+      SL_PROBE_END (updatestart, "update_stream");
     }
 
     /* Increment the send pointer */
@@ -738,8 +878,14 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int maxrecsize)
     /* Check for more available data from the socket */
     bytesread = 0;
 
-    bytesread = sl_recvdata (slconn, (void *)&slconn->stat->databuf[slconn->stat->recptr],
-                             BUFSIZE - slconn->stat->recptr, slconn->sladdr);
+    SL_PROBE_START (recvstart);
+    if (slconn->replayfile)
+      bytesread = replay_read (slconn, &slconn->stat->databuf[slconn->stat->recptr],
+                               BUFSIZE - slconn->stat->recptr, 0);
+    else
+      bytesread = sl_recvdata (slconn, (void *)&slconn->stat->databuf[slconn->stat->recptr],
+                               BUFSIZE - slconn->stat->recptr, slconn->sladdr);
+    SL_PROBE_END (recvstart, "recv");
 
     if (bytesread < 0 && !slconn->terminate) /* read() failed */
     {
@@ -789,16 +935,16 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int maxrecsize)
     }
   }
 
-  /* Network delay timing logic */
+  /* Network delay timing logic, netdly_time is the reconnect deadline */
   if (slconn->netdly)
   {
     if (slconn->stat->netdly_trig == -1) /* reset timer */
     {
-      slconn->stat->netdly_time = current_time;
+      slconn->stat->netdly_time = current_time + reconnect_delay (slconn, current_time);
       slconn->stat->netdly_trig = 1;
     }
     else if (slconn->stat->netdly_trig == 1 &&
-             (current_time - slconn->stat->netdly_time) > slconn->netdly)
+             current_time >= slconn->stat->netdly_time)
     {
       slconn->stat->netdly_trig = 0;
     }
@@ -809,6 +955,301 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int maxrecsize)
 
 } /* End of sl_collect_nb() */
 
+/***************************************************************************
+ * reconnect_delay:
+ *
+ * Determine the delay before the next connection attempt when the
+ * reconnect timer is reset.  The timer is also reset after successful
+ * connections, only resets while the link is down count as failed
+ * attempts.
+ *
+ * With the fixed policy the delay is always 'netdly'.  With the
+ * backoff policy the first attempt after losing a connection is
+ * immediate, further attempts wait 1, 2, 4, ... seconds up to
+ * 'netdly', with each delay randomized to between half and the full
+ * value so that many clients do not reconnect in lockstep.
+ *
+ * Returns the delay in seconds.
+ ***************************************************************************/
+static double
+reconnect_delay (SLCD *slconn, double now)
+{
+  double delay;
+  uint64_t jitter;
+  int attempts;
+
+  if (slconn->link != -1)
+    return slconn->netdly;
+
+  if (slconn->stat->disconnect_time == 0.0)
+    slconn->stat->disconnect_time = now;
+
+  attempts = slconn->stat->reconnect_attempts++;
+
+  if (!slconn->netdly_backoff)
+  {
+    delay = slconn->netdly;
+  }
+  else if (attempts == 0)
+  {
+    delay = 0.0;
+  }
+  else
+  {
+    delay = (attempts > 30) ? slconn->netdly : (double)(1U << (attempts - 1));
+
+    if (delay > slconn->netdly)
+      delay = slconn->netdly;
+
+    /* Mix the time in microseconds and connection address into a fraction in [0,1) */
+    jitter = (uint64_t)(now * 1000000.0) ^ (uint64_t)(uintptr_t)slconn;
+    jitter = (jitter ^ (jitter >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    jitter = (jitter ^ (jitter >> 27)) * 0x94d049bb133111ebULL;
+    jitter ^= jitter >> 31;
+
+    delay = delay / 2.0 + (delay / 2.0) * ((jitter >> 11) * (1.0 / 9007199254740992.0));
+  }
+
+  sl_log_r (slconn, 1, 1, "[%s] reconnecting in %.1f seconds (attempt %d)\n",
+            slconn->sladdr, delay, attempts + 1);
+
+  return delay;
+} /* End of reconnect_delay() */
+
+/***************************************************************************
+ * reconnect_done:
+ *
+ * Reset the reconnect attempt counter and, if the link was previously
+ * lost, count the reconnect and track the time needed to re-establish
+ * the data flow.
+ ***************************************************************************/
+static void
+reconnect_done (SLCD *slconn)
+{
+  slconn->stat->reconnect_attempts = 0;
+
+  if (slconn->stat->disconnect_time > 0.0)
+  {
+    slconn->stat->reconnect_time  = sl_dtime () - slconn->stat->disconnect_time;
+    slconn->stat->disconnect_time = 0.0;
+    slconn->stat->reconnect_count++;
+
+    sl_log_r (slconn, 1, 1, "[%s] reconnected after %.1f seconds\n",
+              slconn->sladdr, slconn->stat->reconnect_time);
+  }
+} /* End of reconnect_done() */
+
+/***************************************************************************
+ * replay_open:
+ *
+ * Open 'slconn->replayfile' as the packet source for the connection in
+ * place of a SeedLink server.  The file may contain either a capture
+ * of a SeedLink stream (8-byte SeedLink headers followed by records)
+ * or plain concatenated miniSEED records, in which case SeedLink
+ * headers with increasing sequence numbers are generated.  The format
+ * is determined from the start of the file.
+ *
+ * The file descriptor is used as 'slconn->link' so the connection
+ * state machine in the collect routines is unchanged.
+ *
+ * Returns -1 on errors otherwise the file descriptor.
+ ***************************************************************************/
+static int
+replay_open (SLCD *slconn)
+{
+  struct slreplay_s *rp;
+  int fd;
+
+  if ((fd = slp_openfile (slconn->replayfile, 'r')) < 0)
+  {
+    sl_log_r (slconn, 2, 0, "cannot open replay file %s: %s\n",
+              slconn->replayfile, strerror (errno));
+    slconn->terminate = 1;
+    return -1;
+  }
+
+  if (slconn->stat->replay == NULL &&
+      (slconn->stat->replay = (struct slreplay_s *)malloc (sizeof (struct slreplay_s))) == NULL)
+  {
+    sl_log_r (slconn, 2, 0, "%s(): error allocating memory\n", __func__);
+    close (fd);
+    slconn->terminate = 1;
+    return -1;
+  }
+
+  rp            = slconn->stat->replay;
+  rp->fd        = fd;
+  rp->raw       = -1;
+  rp->eof       = 0;
+  rp->seqnum    = 0;
+  rp->buflen    = 0;
+  rp->starttime = sl_dtime ();
+  rp->packets   = 0;
+
+  sl_log_r (slconn, 1, 1, "replaying packets from %s\n", slconn->replayfile);
+
+  slconn->link = fd;
+
+  return fd;
+} /* End of replay_open() */
+
+/***************************************************************************
+ * replay_read:
+ *
+ * Read complete packets (SeedLink header and record) from the replay
+ * file into 'buffer', up to 'maxbytes'.  When a replay rate is set
+ * packets are released at that rate; if 'wait' is true the routine
+ * sleeps (up to 0.5 seconds) for the next packet to become due,
+ * otherwise 0 is returned until then.
+ *
+ * At the end of the file the connection is flagged for termination so
+ * that buffered packets are still returned to the caller.
+ *
+ * Returns the number of bytes placed in buffer or -1 on errors.
+ ***************************************************************************/
+static int
+replay_read (SLCD *slconn, char *buffer, int maxbytes, int wait)
+{
+  struct slreplay_s *rp = slconn->stat->replay;
+  SLpacket desc;
+  int hdrlen;
+  int reclen;
+  int nread;
+  int total = 0;
+  double due;
+  double now;
+
+  if (rp == NULL)
+    return -1;
+
+  for (;;)
+  {
+    /* Fill the staging buffer */
+    if (!rp->eof && rp->buflen < (int)sizeof (rp->buf))
+    {
+      nread = read (rp->fd, rp->buf + rp->buflen, sizeof (rp->buf) - rp->buflen);
+
+      if (nread < 0)
+      {
+        sl_log_r (slconn, 2, 0, "error reading replay file %s: %s\n",
+                  slconn->replayfile, strerror (errno));
+        slconn->terminate = 1;
+        return -1;
+      }
+
+      if (nread == 0)
+        rp->eof = 1;
+
+      rp->buflen += nread;
+    }
+
+    if (rp->buflen == 0)
+    {
+      if (rp->eof)
+      {
+        sl_log_r (slconn, 1, 1, "end of replay file %s, %" PRIu64 " packets\n",
+                  slconn->replayfile, rp->packets);
+        slconn->terminate = 1;
+      }
+
+      return total;
+    }
+
+    /* Determine file type from the first bytes */
+    if (rp->raw == -1)
+    {
+      if (rp->buflen < SLHEADSIZE + 48 && !rp->eof)
+        continue;
+
+      if (rp->buflen >= 48 && (MS3_ISVALIDHEADER (rp->buf) || MS2_ISVALIDHEADER (rp->buf)))
+        rp->raw = 1;
+      else if (rp->buflen >= SLHEADSIZE + 48 && !memcmp (rp->buf, SIGNATURE, 2))
+        rp->raw = 0;
+      else
+      {
+        sl_log_r (slconn, 2, 0, "replay file %s is neither miniSEED nor a SeedLink capture\n",
+                  slconn->replayfile);
+        slconn->terminate = 1;
+        return -1;
+      }
+    }
+
+    hdrlen = (rp->raw) ? 0 : SLHEADSIZE;
+
+    if (rp->buflen < hdrlen + SLRECSIZEMIN)
+    {
+      if (!rp->eof)
+        continue;
+
+      sl_log_r (slconn, 2, 0, "skipping %d trailing bytes in replay file\n", rp->buflen);
+      rp->buflen = 0;
+      continue;
+    }
+
+    reclen = detect (rp->buf + hdrlen, rp->buflen - hdrlen, &desc, slconn->stat, !rp->raw);
+
+    /* A final record without a blockette 1000 extends to the end of the file */
+    if (reclen <= 0 && rp->eof && MS2_ISVALIDHEADER (rp->buf + hdrlen))
+      reclen = rp->buflen - hdrlen;
+
+    if (reclen <= 0 || reclen > SLRECSIZEMAX)
+    {
+      if (!rp->eof && rp->buflen < (int)sizeof (rp->buf))
+        continue;
+
+      sl_log_r (slconn, 2, 0, "cannot detect miniSEED record in replay file after %" PRIu64 " packets\n",
+                rp->packets);
+      slconn->terminate = 1;
+      return -1;
+    }
+
+    if (hdrlen + reclen > rp->buflen)
+    {
+      if (!rp->eof)
+        continue;
+
+      sl_log_r (slconn, 2, 0, "skipping truncated record at end of replay file\n");
+      rp->buflen = 0;
+      continue;
+    }
+
+    if (total + SLHEADSIZE + reclen > maxbytes)
+      return total;
+
+    /* Release packets at the requested rate */
+    if (slconn->replayrate > 0.0)
+    {
+      due = rp->starttime + rp->packets / slconn->replayrate;
+      now = sl_dtime ();
+
+      if (now < due)
+      {
+        if (wait && total == 0)
+          slp_usleep ((unsigned long)((((due - now) < 0.5) ? (due - now) : 0.5) * 1000000));
+
+        return total;
+      }
+    }
+
+    if (rp->raw)
+    {
+      snprintf (buffer + total, SLHEADSIZE + 1, "SL%06X", rp->seqnum);
+      memcpy (buffer + total + SLHEADSIZE, rp->buf, reclen);
+      rp->seqnum = (rp->seqnum + 1) & 0xFFFFFF;
+    }
+    else
+    {
+      memcpy (buffer + total, rp->buf, SLHEADSIZE + reclen);
+    }
+
+    total += SLHEADSIZE + reclen;
+    rp->packets++;
+
+    rp->buflen -= hdrlen + reclen;
+    memmove (rp->buf, rp->buf + hdrlen + reclen, rp->buflen);
+  }
+} /* End of replay_read() */
+
 /***************************************************************************
  * update_stream:
  *
@@ -820,109 +1261,126 @@ sl_collect_nb_size (SLCD *slconn, SLpacket **slpack, int maxrecsize)
 static int
 update_stream (SLCD *slconn, const SLpacket *slpack)
 {
+  struct slstreamindex_s *index;
+  struct slmatchmemo_s *memo;
   SLstream *curstream;
-  struct sl_fsdh_s fsdh;
+  SLRecordView view;
+  uint16_t year, day;
+  uint8_t hour, min, sec;
+  uint32_t idx;
   int seqnum;
-  int swapflag = 0;
-  int updates  = 0;
-  char net[11];
-  char sta[11];
-
-  if ((seqnum = sl_sequence (slpack)) == -1)
+  int updates = 0;
+  SLnstime nstime;
+  char net[SL_VIEW_CODESIZE];
+  char sta[SL_VIEW_CODESIZE];
+  char loc[SL_VIEW_CODESIZE];
+  char chan[SL_VIEW_CODESIZE];
+
+  if ((seqnum = slpack->seqnum) == -1)
   {
     sl_log_r (slconn, 2, 0, "%s(): could not determine sequence number\n", __func__);
     return -1;
   }
 
-  /* Copy fixed header */
-  memcpy (&fsdh, slpack->msrecord, sizeof (struct sl_fsdh_s));
-
-  /* Check to see if byte swapping is needed (bogus year makes good test) */
-  if ((fsdh.start_time.year < 1900) || (fsdh.start_time.year > 2050))
-    swapflag = 1;
-
-  /* Change byte order? */
-  if (swapflag)
+  /* Read the start time directly from the record header */
+  if (sl_view_packet (&view, slpack) ||
+      sl_view_btime (&view, &year, &day, &hour, &min, &sec, NULL))
   {
-    sl_gswap2 (&fsdh.start_time.year);
-    sl_gswap2 (&fsdh.start_time.day);
+    sl_log_r (slconn, 2, 0, "%s(): could not parse record header\n", __func__);
+    return -1;
   }
 
   curstream = slconn->streams;
+  slconn->stat->lastupdate = NULL;
 
-  /* Generate some "clean" net and sta strings */
-  if (curstream != NULL)
-  {
-    sl_strncpclean (net, fsdh.network, 2);
-    sl_strncpclean (sta, fsdh.station, 5);
-  }
+  if (curstream == NULL)
+    return -1;
+
+  /* The time stamp is formatted from this when needed, see sl_formattimestamps() */
+  if ((nstime = sl_time2nstime (year, day, hour, min, sec, 0)) == SL_NSTERROR)
+    nstime = 0;
 
   /* For uni-station mode */
-  if (curstream != NULL)
+  if (strcmp (curstream->net, UNINETWORK) == 0 &&
+      strcmp (curstream->sta, UNISTATION) == 0)
   {
-    if (strcmp (curstream->net, UNINETWORK) == 0 &&
-        strcmp (curstream->sta, UNISTATION) == 0)
-    {
-      int month = 0;
-      int mday  = 0;
+    mark_update (slconn, curstream, seqnum, nstime);
 
-      sl_doy2md (fsdh.start_time.year,
-                 fsdh.start_time.day,
-                 &month, &mday);
-
-      curstream->seqnum = seqnum;
+    return 0;
+  }
 
-      snprintf (curstream->timestamp, sizeof(curstream->timestamp),
-                "%04d,%02d,%02d,%02d,%02d,%02d",
-                fsdh.start_time.year,
-                month,
-                mday,
-                fsdh.start_time.hour,
-                fsdh.start_time.min,
-                fsdh.start_time.sec);
+  /* Generate some "clean" net and sta strings */
+  if (sl_view_nslc (&view, net, sta, loc, chan))
+  {
+    sl_log_r (slconn, 2, 0, "%s(): could not determine record source\n", __func__);
+    return -1;
+  }
 
-      return 0;
-    }
+  /* For multi-station mode, update the entry with exactly these codes */
+  if ((curstream = sl_findstream (slconn, net, sta)) != NULL &&
+      !is_wildcard (curstream))
+  {
+    mark_update (slconn, curstream, seqnum, nstime);
+    updates++;
   }
 
-  /* For multi-station mode, search the stream chain and update all matching entries */
-  while (curstream != NULL)
+  /* And all wildcard and duplicate entries that match, memoized per station */
+  if ((index = slconn->stat->streamindex) != NULL && index->extracount > 0)
   {
-    /* Use glob matching to match wildcarded network and station codes */
-    if (sl_globmatch (net, curstream->net) &&
-        sl_globmatch (sta, curstream->sta))
+    if ((memo = match_extras (index, net, sta)) != NULL)
     {
-      int month = 0;
-      int mday  = 0;
-
-      sl_doy2md (fsdh.start_time.year,
-                 fsdh.start_time.day,
-                 &month, &mday);
-
-      curstream->seqnum = seqnum;
-
-      snprintf (curstream->timestamp, sizeof(curstream->timestamp),
-                "%04d,%02d,%02d,%02d,%02d,%02d",
-                fsdh.start_time.year,
-                month,
-                mday,
-                fsdh.start_time.hour,
-                fsdh.start_time.min,
-                fsdh.start_time.sec);
+      for (idx = 0; idx < memo->count; idx++)
+        mark_update (slconn, index->matches[memo->first + idx], seqnum, nstime);
 
-      updates++;
+      updates += memo->count;
     }
+    else
+    {
+      for (idx = 0; idx < index->extracount; idx++)
+      {
+        curstream = index->extras[idx];
 
-    curstream = curstream->next;
+        if (sl_globmatch (net, curstream->net) &&
+            sl_globmatch (sta, curstream->sta))
+        {
+          mark_update (slconn, curstream, seqnum, nstime);
+          updates++;
+        }
+      }
+    }
   }
 
   /* If no updates then no match was found */
   if (updates == 0)
-    sl_log_r (slconn, 2, 0, "unexpected data received: %.2s %.6s\n", net, sta);
+    sl_log_r (slconn, 2, 0, "unexpected data received: %s %s\n", net, sta);
 
   return (updates == 0) ? -1 : 0;
 } /* End of update_stream() */
 
+/***************************************************************************
+ * mark_update:
+ *
+ * Set the sequence number and start time of the last packet received
+ * for a stream entry and add it to the streams updated by the packet.
+ * The time stamp is marked stale, it is formatted only when needed.
+ ***************************************************************************/
+static void
+mark_update (SLCD *slconn, SLstream *stream, int seqnum, SLnstime nstime)
+{
+  stream->seqnum  = seqnum;
+  stream->nstime  = nstime;
+  stream->tsstale = 1;
+
+  if (stream->jslot && !slconn->durablestate)
+  {
+    stream->jslot->nstime = nstime;
+    stream->jslot->seqnum = seqnum;
+  }
+
+  stream->nextupdate = slconn->stat->lastupdate;
+  slconn->stat->lastupdate = stream;
+} /* End of mark_update() */
+
 /***************************************************************************
  * sl_newslcd:
  *
@@ -955,11 +1413,23 @@ sl_newslcd (void)
   slconn->batchmode    = 0;
   slconn->lastpkttime  = 1;
   slconn->terminate    = 0;
+  slconn->durablestate = 0;
 
   slconn->keepalive = 0;
   slconn->iotimeout = 60;
+  slconn->resptimeout = 30;
   slconn->netto     = 600;
   slconn->netdly    = 30;
+  slconn->netdly_backoff = 0;
+  slconn->netdly_nowait  = 0;
+
+  slconn->replayfile = NULL;
+  slconn->replayrate = 0.0;
+
+  slconn->rcvbufsize  = 0;
+  slconn->tcpnodelay  = 0;
+  slconn->busypoll    = 0;
+  slconn->usertimeout = 0;
 
   slconn->link         = -1;
   slconn->info         = NULL;
@@ -979,6 +1449,10 @@ sl_newslcd (void)
   slconn->stat->sendptr     = 0;
   slconn->stat->slpack.slhead = NULL;
   slconn->stat->slpack.msrecord = NULL;
+  slconn->stat->slpack.reclen = 0;
+  slconn->stat->slpack.seqnum = -1;
+  slconn->stat->slpack.packettype = SLNUM;
+  slconn->stat->slpack.formatversion = 0;
   slconn->stat->expect_info = 0;
 
   slconn->stat->netto_trig     = -1;
@@ -988,6 +1462,25 @@ sl_newslcd (void)
   slconn->stat->netto_time     = 0.0;
   slconn->stat->netdly_time    = 0.0;
   slconn->stat->keepalive_time = 0.0;
+  slconn->stat->connect_time   = 0.0;
+
+  slconn->stat->reconnect_attempts = 0;
+  slconn->stat->reconnect_count    = 0;
+  slconn->stat->disconnect_time    = 0.0;
+  slconn->stat->reconnect_time     = 0.0;
+  slconn->stat->negotiate_time     = 0.0;
+
+  slconn->stat->replay = NULL;
+  slconn->stat->journal = NULL;
+  slconn->stat->streamindex = NULL;
+  slconn->stat->laststream = NULL;
+  slconn->stat->lastupdate = NULL;
+
+  memset (slconn->stat->reclencache, 0, sizeof (slconn->stat->reclencache));
+
+  slconn->stat->addrlist      = NULL;
+  slconn->stat->addrlist_time = 0.0;
+  slconn->stat->addrlist_next = 0;
 
   slconn->stat->sl_state   = SL_DOWN;
   slconn->stat->query_mode = NoQuery;
@@ -1010,6 +1503,9 @@ sl_freeslcd (SLCD *slconn)
   SLstream *curstream;
   SLstream *nextstream;
 
+  if (slconn->stat != NULL && slconn->stat->journal != NULL)
+    sl_closejournal (slconn);
+
   curstream = slconn->streams;
 
   /* Traverse the stream chain and free memory */
@@ -1034,7 +1530,24 @@ sl_freeslcd (SLCD *slconn)
     free (slconn->end_time);
 
   if (slconn->stat != NULL)
+  {
+    if (slconn->stat->addrlist != NULL)
+      freeaddrinfo (slconn->stat->addrlist);
+
+    if (slconn->stat->replay != NULL)
+      free (slconn->stat->replay);
+
+    if (slconn->stat->streamindex != NULL)
+    {
+      free (slconn->stat->streamindex->slots);
+      free (slconn->stat->streamindex->extras);
+      free (slconn->stat->streamindex->memo);
+      free (slconn->stat->streamindex->matches);
+      free (slconn->stat->streamindex);
+    }
+
     free (slconn->stat);
+  }
 
   if (slconn->log != NULL)
     free (slconn->log);
@@ -1061,7 +1574,6 @@ sl_addstream (SLCD *slconn, const char *net, const char *sta,
 {
   SLstream *curstream;
   SLstream *newstream;
-  SLstream *laststream = NULL;
 
   curstream = slconn->streams;
 
@@ -1076,13 +1588,6 @@ sl_addstream (SLCD *slconn, const char *net, const char *sta,
     }
   }
 
-  /* Search the stream chain */
-  while (curstream != NULL)
-  {
-    laststream = curstream;
-    curstream  = curstream->next;
-  }
-
   newstream = (SLstream *)malloc (sizeof (SLstream));
 
   if (newstream == NULL)
@@ -1106,22 +1611,195 @@ sl_addstream (SLCD *slconn, const char *net, const char *sta,
   else
     strncpy (newstream->timestamp, timestamp, 20);
 
+  newstream->jslot = NULL;
+  if ((newstream->nstime = sl_timestamp2nstime (newstream->timestamp)) == SL_NSTERROR)
+    newstream->nstime = 0;
+
+  newstream->tsstale = 0;
+  newstream->ackseqnum = newstream->durseqnum = seqnum;
+  newstream->acknstime = newstream->durnstime = newstream->nstime;
+  newstream->ackfrozen = 0;
+  newstream->nextupdate = NULL;
   newstream->next = NULL;
 
+  if (index_stream (slconn, newstream))
+  {
+    sl_log_r (slconn, 2, 0, "%s(): error allocating memory\n", __func__);
+    free (newstream->net);
+    free (newstream->sta);
+    if (newstream->selectors)
+      free (newstream->selectors);
+    free (newstream);
+    return -1;
+  }
+
+  /* Append to the chain, the tail is tracked to avoid a search */
   if (slconn->streams == NULL)
   {
     slconn->streams = newstream;
   }
-  else if (laststream)
+  else
   {
-    laststream->next = newstream;
+    if (!slconn->stat->laststream)
+      for (slconn->stat->laststream = slconn->streams;
+           slconn->stat->laststream->next;
+           slconn->stat->laststream = slconn->stat->laststream->next);
+
+    slconn->stat->laststream->next = newstream;
   }
 
+  slconn->stat->laststream = newstream;
   slconn->multistation = 1;
 
   return 0;
 } /* End of sl_addstream() */
 
+/***************************************************************************
+ * sl_findstream:
+ *
+ * Find the entry in the stream chain with the network and station
+ * codes 'net' and 'sta'.  The codes are compared literally, wildcards
+ * are not expanded.  If there are duplicate entries the first one
+ * added is returned.
+ *
+ * Returns a pointer to the stream entry or NULL if not found.
+ ***************************************************************************/
+SLstream *
+sl_findstream (SLCD *slconn, const char *net, const char *sta)
+{
+  struct slstreamindex_s *index;
+  SLstream *curstream;
+  uint32_t idx;
+
+  if (!slconn || !net || !sta)
+    return NULL;
+
+  /* Search the chain if not indexed, i.e. uni-station mode */
+  if ((index = slconn->stat->streamindex) == NULL)
+  {
+    for (curstream = slconn->streams; curstream != NULL; curstream = curstream->next)
+    {
+      if (!strcmp (net, curstream->net) && !strcmp (sta, curstream->sta))
+        return curstream;
+    }
+
+    return NULL;
+  }
+
+  idx = netsta_hash (net, sta) & (index->size - 1);
+
+  while ((curstream = index->slots[idx]) != NULL)
+  {
+    if (!strcmp (net, curstream->net) && !strcmp (sta, curstream->sta))
+      return curstream;
+
+    idx = (idx + 1) & (index->size - 1);
+  }
+
+  return NULL;
+} /* End of sl_findstream() */
+
+/***************************************************************************
+ * sl_formattimestamps:
+ *
+ * Format the time stamps of all stream entries updated since they
+ * were last formatted.  sl_collect() only records the start time of
+ * the last packet received for a stream (SLstream.nstime), the time
+ * stamp string is formatted from it by this function, which is called
+ * by sl_savestate() and before negotiating the streams with a server.
+ * Callers using SLstream.timestamp directly must call it first.
+ ***************************************************************************/
+void
+sl_formattimestamps (SLCD *slconn)
+{
+  SLstream *curstream;
+
+  if (!slconn)
+    return;
+
+  for (curstream = slconn->streams; curstream != NULL; curstream = curstream->next)
+  {
+    if (!curstream->tsstale)
+      continue;
+
+    if (!curstream->nstime || !sl_nstime2timestamp (curstream->nstime, curstream->timestamp))
+      curstream->timestamp[0] = '\0';
+
+    curstream->tsstale = 0;
+  }
+} /* End of sl_formattimestamps() */
+
+/***************************************************************************
+ * sl_ackpacket:
+ *
+ * Acknowledge that the packet last returned by sl_collect() for this
+ * connection has been handled.  If 'archived' is true the packet was
+ * stored and the acknowledged sequence number and time stamp of the
+ * streams it updated are advanced.  If 'archived' is false storing
+ * the packet failed and the acknowledgements of these streams are
+ * frozen for the rest of the session, later packets will not advance
+ * them past the failed packet.
+ *
+ * With SLCD.durablestate set, sl_savestate() and the state journal
+ * only record acknowledged state that was committed with
+ * sl_commitacks().  This must be called before the next packet is
+ * collected.
+ *
+ * Returns 0 on success and -1 if the packet did not update any stream.
+ ***************************************************************************/
+int
+sl_ackpacket (SLCD *slconn, const SLpacket *slpack, int8_t archived)
+{
+  SLstream *curstream;
+
+  if (!slconn || !slpack || !slconn->stat->lastupdate)
+    return -1;
+
+  for (curstream = slconn->stat->lastupdate; curstream != NULL;
+       curstream = curstream->nextupdate)
+  {
+    /* Only the packet that updated the stream last can be acknowledged */
+    if (curstream->seqnum != slpack->seqnum || curstream->ackfrozen)
+      continue;
+
+    if (!archived)
+    {
+      sl_log_r (slconn, 2, 0, "archiving failed for %s_%s, seq %d, state not advanced further\n",
+                curstream->net, curstream->sta, slpack->seqnum);
+      curstream->ackfrozen = 1;
+      continue;
+    }
+
+    curstream->ackseqnum = curstream->seqnum;
+    curstream->acknstime = curstream->nstime;
+  }
+
+  return 0;
+} /* End of sl_ackpacket() */
+
+/***************************************************************************
+ * sl_commitacks:
+ *
+ * Commit the acknowledged state of all streams as durable state, to
+ * be called once the archived data is on storage, for example after
+ * the archive files have been synced.  With SLCD.durablestate set the
+ * committed state is what sl_savestate() and sl_syncjournal() save.
+ ***************************************************************************/
+void
+sl_commitacks (SLCD *slconn)
+{
+  SLstream *curstream;
+
+  if (!slconn)
+    return;
+
+  for (curstream = slconn->streams; curstream != NULL; curstream = curstream->next)
+  {
+    curstream->durseqnum = curstream->ackseqnum;
+    curstream->durnstime = curstream->acknstime;
+  }
+} /* End of sl_commitacks() */
+
 /***************************************************************************
  * sl_setuniparams:
  *
@@ -1153,6 +1831,8 @@ sl_setuniparams (SLCD *slconn, const char *selectors,
       sl_log_r (slconn, 2, 0, "%s(): error allocating memory\n", __func__);
       return -1;
     }
+
+    newstream->jslot = NULL;
   }
   else if (strcmp (newstream->net, UNINETWORK) != 0 ||
            strcmp (newstream->sta, UNISTATION) != 0)
@@ -1176,6 +1856,14 @@ sl_setuniparams (SLCD *slconn, const char *selectors,
   else
     strncpy (newstream->timestamp, timestamp, 20);
 
+  if ((newstream->nstime = sl_timestamp2nstime (newstream->timestamp)) == SL_NSTERROR)
+    newstream->nstime = 0;
+
+  newstream->tsstale = 0;
+  newstream->ackseqnum = newstream->durseqnum = seqnum;
+  newstream->acknstime = newstream->durnstime = newstream->nstime;
+  newstream->ackfrozen = 0;
+  newstream->nextupdate = NULL;
   newstream->next = NULL;
 
   slconn->streams = newstream;
@@ -1337,86 +2025,123 @@ sl_terminate (SLCD *slconn)
  * Determine if the buffer contains a miniSEED data record by
  * verifying known signatures (fields with known limited values).
  *
- * If miniSEED 2.x is detected, search the record up to recbuflen
- * bytes for a 1000 blockette. If no blockette 1000 is found, search
- * at 64-byte offsets for the fixed section of the next header,
- * thereby implying the record length.
+ * If miniSEED 2.x is detected, walk the blockette chain of the record
+ * up to recbuflen bytes.  The record length is taken from blockette
+ * 1000; if no blockette 1000 is found, search at 64-byte offsets for
+ * the fixed section of the next header, thereby implying the record
+ * length.
+ *
+ * The record description fields of @p slpack are set in the same
+ * pass: format version, byte swap flag, offsets of blockettes 100,
+ * 1000 and 1001, the packet type implied by the blockettes and the
+ * record start time.  The SeedLink header is not examined.
  *
  * @param[in] record Buffer to test for record
  * @param[in] recbuflen Length of buffer
- * @param[out] formatversion Major version of format detected, 0 if unknown
+ * @param[out] slpack Packet to set record description in, formatversion
+ * is 0 if unknown
  *
  * @retval -1 Data record not detected or error
  * @retval 0 Data record detected but could not determine length
  * @retval >0 Size of the record in bytes
  *********************************************************************/
 static int
-detect (const char *record, uint64_t recbuflen, uint8_t *formatversion)
+detect (const char *record, uint64_t recbuflen, SLpacket *slpack,
+        SLstat *stat, int8_t framed)
 {
-  uint8_t swapflag = 0; /* Byte swapping flag */
   uint8_t foundlen = 0; /* Found record length */
   int32_t reclen = -1; /* Size of record in bytes */
+  int8_t b2000 = 0;    /* Blockette 2000 found */
+  SLRecordView view;
 
   uint16_t blkt_offset; /* Byte offset for next blockette */
   uint16_t blkt_type;
   uint16_t next_blkt;
-  const char *nextfsdh;
+  SLreclen *cached = NULL;
+  uint32_t hash;
+  int idx;
 
-  if (!record || !formatversion)
+  if (!record || !slpack)
     return -1;
 
+  slpack->formatversion = 0;
+  slpack->swapflag      = 0;
+  slpack->packettype    = SLDATA;
+  slpack->b100          = 0;
+  slpack->b1000         = 0;
+  slpack->b1001         = 0;
+  slpack->starttime     = 0.0;
+
   /* Buffer must be at least SLRECSIZEMIN */
   if (recbuflen < SLRECSIZEMIN)
     return -1;
 
   /* Check for valid header, set format version */
-  *formatversion = 0;
   if (MS3_ISVALIDHEADER (record))
   {
-    *formatversion = 3;
+    slpack->formatversion = 3;
+
+    /* miniSEED 3 is always little endian, swap on big endian hosts */
+    slpack->swapflag = !sl_littleendianhost ();
 
     reclen = MS3FSDH_LENGTH                   /* Length of fixed portion of header */
              + *pMS3FSDH_SIDLENGTH (record)   /* Length of source identifier */
-             + *pMS3FSDH_EXTRALENGTH (record) /* Length of extra headers */
-             + *pMS3FSDH_DATALENGTH (record); /* Length of data payload */
+             + HO2u (*pMS3FSDH_EXTRALENGTH (record), slpack->swapflag) /* Length of extra headers */
+             + HO4u (*pMS3FSDH_DATALENGTH (record), slpack->swapflag); /* Length of data payload */
 
     foundlen = 1;
   }
   else if (MS2_ISVALIDHEADER (record))
   {
-    *formatversion = 2;
+    slpack->formatversion = 2;
 
     /* Check to see if byte swapping is needed by checking for sane year and day */
     if (!MS_ISVALIDYEARDAY (*pMS2FSDH_YEAR(record), *pMS2FSDH_DAY(record)))
-      swapflag = 1;
+      slpack->swapflag = 1;
 
-    blkt_offset = HO2u(*pMS2FSDH_BLOCKETTEOFFSET (record), swapflag);
+    blkt_offset = HO2u(*pMS2FSDH_BLOCKETTEOFFSET (record), slpack->swapflag);
 
     /* Loop through blockettes as long as number is non-zero and viable */
     while (blkt_offset != 0 &&
            blkt_offset > 47 &&
-           blkt_offset <= recbuflen)
+           blkt_offset + 4 <= recbuflen)
     {
-      memcpy (&blkt_type, record + blkt_offset, 2);
-      memcpy (&next_blkt, record + blkt_offset + 2, 2);
-
-      if (swapflag)
-      {
-        sl_gswap2 (&blkt_type);
-        sl_gswap2 (&next_blkt);
-      }
+      blkt_type = HO2u (*pMS2B100_TYPE (record + blkt_offset), slpack->swapflag);
+      next_blkt = HO2u (*pMS2B100_NEXT (record + blkt_offset), slpack->swapflag);
 
       /* Found a 1000 blockette, not truncated */
       if (blkt_type == 1000 &&
           (int)(blkt_offset + 8) <= recbuflen)
       {
         foundlen = 1;
+        slpack->b1000 = blkt_offset;
 
         /* Field 3 of B1000 is a uint8_t value describing the record
          * length as 2^(value).  Calculate 2-raised with a shift. */
         reclen = (unsigned int)1 << *pMS2B1000_RECLEN(record+blkt_offset);
+      }
+      else if (blkt_type == 100 && (int)(blkt_offset + 12) <= recbuflen)
+      {
+        slpack->b100 = blkt_offset;
+      }
+      else if (blkt_type == 1001 && (int)(blkt_offset + 8) <= recbuflen)
+      {
+        slpack->b1001 = blkt_offset;
+      }
+      else if (blkt_type == 2000)
+      {
+        b2000 = 1;
+      }
 
-        break;
+      /* The first event, calibration or timing blockette sets the packet type */
+      if (slpack->packettype == SLDATA)
+      {
+        if (blkt_type >= 200 && blkt_type <= 299)
+          slpack->packettype = SLDET;
+        else if (blkt_type >= 300 && blkt_type <= 399)
+          slpack->packettype = SLCAL;
+        else if (blkt_type >= 500 && blkt_type <= 599)
+          slpack->packettype = SLTIM;
       }
 
       /* Safety check for invalid offset */
@@ -1430,29 +2155,460 @@ detect (const char *record, uint64_t recbuflen, uint8_t *formatversion)
       blkt_offset = next_blkt;
     }
 
-    /* If record length was not determined by a 1000 blockette scan the buffer
-     * and search for the next record */
-    if (reclen == -1)
+    /* Records without a sample rate are log messages or opaque data */
+    if (slpack->packettype == SLDATA &&
+        HO2d (*pMS2FSDH_SAMPLERATEFACT (record), slpack->swapflag) == 0)
     {
-      nextfsdh = record + 64;
+      if (HO2u (*pMS2FSDH_NUMSAMPLES (record), slpack->swapflag) != 0)
+        slpack->packettype = SLMSG;
+      else if (b2000)
+        slpack->packettype = SLBLK;
+    }
 
-      /* Check for record header or blank/noise record at MINRECLEN byte offsets */
-      while (((nextfsdh - record) + 48) < recbuflen)
+    /* If record length was not determined by a 1000 blockette use the length
+     * cached for the stream if the next record or packet starts there,
+     * otherwise scan the buffer and search for the next one */
+    if (reclen == -1)
+    {
+      if (stat)
       {
-        if (MS2_ISVALIDHEADER (nextfsdh))
+        for (hash = 2166136261U, idx = 8; idx < 20; idx++)
+          hash = (hash ^ (uint8_t)record[idx]) * 16777619U;
+
+        cached = &stat->reclencache[hash % SL_RECLENCACHE];
+
+        /* A packet ending exactly at the cached length is also accepted */
+        if (cached->reclen > 0 && !memcmp (cached->key, record + 8, 12) &&
+            (((uint64_t)(cached->reclen + 48) < recbuflen &&
+              is_boundary (record + cached->reclen, framed)) ||
+             (framed && (uint64_t)cached->reclen == recbuflen)))
         {
           foundlen = 1;
-          reclen = nextfsdh - record;
-          break;
+          reclen   = cached->reclen;
         }
+      }
 
-        nextfsdh += 64;
+      if (reclen == -1 && (reclen = scan_ms2header (record, recbuflen, framed)) > 0)
+      {
+        foundlen = 1;
+
+        if (cached)
+        {
+          memcpy (cached->key, record + 8, 12);
+          cached->reclen = reclen;
+        }
       }
+
+      /* The end of the record may not have been received yet */
+      if (reclen == -1 && recbuflen < SLRECSIZEMAX + 48)
+        return 0;
     }
   } /* End of miniSEED 2.x detection */
 
   if (!foundlen)
     return -1;
-  else
-    return reclen;
+
+  /* Start time from the header fields located above */
+  view.record        = record;
+  view.reclen        = reclen;
+  view.formatversion = slpack->formatversion;
+  view.swapflag      = slpack->swapflag;
+  view.b100          = slpack->b100;
+  view.b1000         = slpack->b1000;
+  view.b1001         = slpack->b1001;
+
+  slpack->starttime = sl_view_depochstime (&view);
+
+  return reclen;
 } /* End of detect() */
+
+/***************************************************************************
+ * scan_ms2header:
+ *
+ * Search for the end of the miniSEED 2 record at 'record', which is
+ * followed by 'recbuflen' bytes of buffer, by looking for the next
+ * record header (or blank/noise record) at 64-byte offsets.  If the
+ * buffer is 'framed' by SeedLink headers the header of the next packet
+ * also ends the record.
+ *
+ * With SSE2 four offsets are prefiltered at once by checking the
+ * sequence number, quality indicator and reserved bytes (or the
+ * SeedLink signature), the full test is only done for offsets that
+ * pass.
+ *
+ * Returns the offset of the end of the record or -1 if not found.
+ ***************************************************************************/
+static int32_t
+scan_ms2header (const char *record, uint64_t recbuflen, int8_t framed)
+{
+  uint64_t offset = 64;
+
+#if SL_SCAN_SSE2
+  /* Lane masks for the first 8 bytes of two headers */
+  const __m128i seqmask   = _mm_set_epi8 (0, 0, -1, -1, -1, -1, -1, -1,
+                                          0, 0, -1, -1, -1, -1, -1, -1);
+  const __m128i qualmask  = _mm_set_epi8 (0, -1, 0, 0, 0, 0, 0, 0,
+                                          0, -1, 0, 0, 0, 0, 0, 0);
+  const __m128i blankmask = _mm_set_epi8 (-1, 0, -1, -1, -1, -1, -1, -1,
+                                          -1, 0, -1, -1, -1, -1, -1, -1);
+  const __m128i signature = _mm_set_epi8 (0, 0, 0, 0, 0, 0, 'L', 'S',
+                                          0, 0, 0, 0, 0, 0, 'L', 'S');
+  __m128i bytes;
+  __m128i digits;
+  __m128i valid;
+  int candidates;
+  int pair;
+  int bits;
+  int idx;
+
+  while (offset + 3 * 64 + 48 < recbuflen)
+  {
+    candidates = 0;
+
+    for (pair = 0; pair < 2; pair++)
+    {
+      bytes = _mm_unpacklo_epi64 (
+          _mm_loadl_epi64 ((const __m128i *)(record + offset + pair * 128)),
+          _mm_loadl_epi64 ((const __m128i *)(record + offset + pair * 128 + 64)));
+
+      /* Digits in the sequence number, space or NULL also in the reserved byte */
+      digits = _mm_sub_epi8 (bytes, _mm_set1_epi8 ('0'));
+      digits = _mm_cmpeq_epi8 (_mm_min_epu8 (digits, _mm_set1_epi8 (9)), digits);
+
+      valid = _mm_and_si128 (digits, seqmask);
+      valid = _mm_or_si128 (valid, _mm_and_si128 (blankmask,
+                                                   _mm_or_si128 (_mm_cmpeq_epi8 (bytes, _mm_set1_epi8 (' ')),
+                                                                 _mm_cmpeq_epi8 (bytes, _mm_setzero_si128 ()))));
+
+      /* Quality indicator */
+      valid = _mm_or_si128 (valid, _mm_and_si128 (qualmask,
+                                                   _mm_or_si128 (_mm_or_si128 (_mm_cmpeq_epi8 (bytes, _mm_set1_epi8 ('D')),
+                                                                               _mm_cmpeq_epi8 (bytes, _mm_set1_epi8 ('R'))),
+                                                                 _mm_or_si128 (_mm_cmpeq_epi8 (bytes, _mm_set1_epi8 ('Q')),
+                                                                               _mm_cmpeq_epi8 (bytes, _mm_set1_epi8 ('M'))))));
+
+      bits = _mm_movemask_epi8 (valid);
+
+      if ((bits & 0xFF) == 0xFF)
+        candidates |= 1 << (pair * 2);
+      if ((bits >> 8) == 0xFF)
+        candidates |= 2 << (pair * 2);
+
+      /* SeedLink signature of the next packet */
+      if (framed)
+      {
+        bits = _mm_movemask_epi8 (_mm_cmpeq_epi8 (bytes, signature));
+
+        if ((bits & 0x3) == 0x3)
+          candidates |= 1 << (pair * 2);
+        if ((bits & 0x300) == 0x300)
+          candidates |= 2 << (pair * 2);
+      }
+    }
+
+    for (idx = 0; idx < 4; idx++)
+    {
+      if ((candidates & (1 << idx)) && is_boundary (record + offset + idx * 64, framed))
+        return (int32_t)(offset + idx * 64);
+    }
+
+    offset += 4 * 64;
+  }
+#endif
+
+  for (; offset + 48 < recbuflen; offset += 64)
+  {
+    if (is_boundary (record + offset, framed))
+      return (int32_t)offset;
+  }
+
+  return -1;
+} /* End of scan_ms2header() */
+
+/***************************************************************************
+ * is_boundary:
+ *
+ * Test if 'next' is the start of a miniSEED 2 record header or, when
+ * 'framed' by SeedLink headers, the start of a SeedLink packet.  At
+ * least 48 bytes must be readable at 'next'.
+ *
+ * Returns 1 if a record or packet starts at 'next', otherwise 0.
+ ***************************************************************************/
+static int
+is_boundary (const char *next, int8_t framed)
+{
+  int idx;
+
+  if (MS2_ISVALIDHEADER (next))
+    return 1;
+
+  if (!framed || memcmp (next, SIGNATURE, 2))
+    return 0;
+
+  if (!memcmp (next, INFOSIGNATURE, 6))
+    return 1;
+
+  for (idx = 2; idx < SLHEADSIZE; idx++)
+  {
+    if (!isxdigit ((uint8_t)next[idx]))
+      return 0;
+  }
+
+  return 1;
+} /* End of is_boundary() */
+
+/***************************************************************************
+ * index_stream:
+ *
+ * Add a stream entry to the hash index of the stream chain used by
+ * sl_findstream(), the index is created and doubled in size as needed
+ * to keep it at most half full.  A duplicate of an indexed entry is not
+ * added, so lookups return the first entry.
+ *
+ * Entries with wildcards in the network or station code and duplicate
+ * entries are also added to the extra entries, which update_stream()
+ * matches with sl_globmatch() via match_extras().  Adding one clears
+ * the memoized matches.
+ *
+ * Returns 0 on success and -1 on allocation error.
+ ***************************************************************************/
+static int
+index_stream (SLCD *slconn, SLstream *stream)
+{
+  struct slstreamindex_s *index = slconn->stat->streamindex;
+  SLstream **oldslots;
+  SLstream *curstream;
+  uint32_t oldsize;
+  uint32_t idx;
+  uint32_t jdx;
+
+  if (index == NULL)
+  {
+    if ((index = (struct slstreamindex_s *)calloc (1, sizeof (struct slstreamindex_s))) == NULL)
+      return -1;
+
+    slconn->stat->streamindex = index;
+  }
+
+  /* Grow the table when it would be more than half full */
+  if ((index->count + 1) * 2 > index->size)
+  {
+    oldslots = index->slots;
+    oldsize  = index->size;
+
+    index->size = (oldsize) ? oldsize * 2 : 64;
+
+    if ((index->slots = (SLstream **)calloc (index->size, sizeof (SLstream *))) == NULL)
+    {
+      index->slots = oldslots;
+      index->size  = oldsize;
+      return -1;
+    }
+
+    for (jdx = 0; jdx < oldsize; jdx++)
+    {
+      if ((curstream = oldslots[jdx]) == NULL)
+        continue;
+
+      idx = netsta_hash (curstream->net, curstream->sta) & (index->size - 1);
+      while (index->slots[idx] != NULL)
+        idx = (idx + 1) & (index->size - 1);
+
+      index->slots[idx] = curstream;
+    }
+
+    free (oldslots);
+  }
+
+  idx = netsta_hash (stream->net, stream->sta) & (index->size - 1);
+
+  while ((curstream = index->slots[idx]) != NULL)
+  {
+    if (!strcmp (stream->net, curstream->net) && !strcmp (stream->sta, curstream->sta))
+      break;
+
+    idx = (idx + 1) & (index->size - 1);
+  }
+
+  if (curstream == NULL || is_wildcard (stream))
+  {
+    if (index->extracount == index->extrasize)
+    {
+      SLstream **extras;
+      uint32_t extrasize = (index->extrasize) ? index->extrasize * 2 : 16;
+
+      if ((extras = (SLstream **)realloc (index->extras, extrasize * sizeof (SLstream *))) == NULL)
+        return -1;
+
+      index->extras    = extras;
+      index->extrasize = extrasize;
+    }
+  }
+
+  if (curstream == NULL)
+  {
+    index->slots[idx] = stream;
+    index->count++;
+
+    if (!is_wildcard (stream))
+      return 0;
+  }
+
+  index->extras[index->extracount++] = stream;
+
+  /* Memoized matches are incomplete now */
+  if (index->memocount)
+  {
+    memset (index->memo, 0, index->memosize * sizeof (struct slmatchmemo_s));
+    index->memocount  = 0;
+    index->matchcount = 0;
+  }
+
+  return 0;
+} /* End of index_stream() */
+
+/***************************************************************************
+ * match_extras:
+ *
+ * Find the extra (wildcard and duplicate) stream entries that match
+ * the network and station codes of data.  The matches are determined
+ * with sl_globmatch() the first time the codes are seen and memoized in
+ * an open addressing hash table, doubled in size to keep it at most
+ * half full.
+ *
+ * Returns the memo entry or NULL on allocation error.
+ ***************************************************************************/
+static struct slmatchmemo_s *
+match_extras (struct slstreamindex_s *index, const char *net, const char *sta)
+{
+  struct slmatchmemo_s *memo;
+  struct slmatchmemo_s *oldmemo;
+  SLstream *curstream;
+  uint32_t oldsize;
+  uint32_t idx;
+  uint32_t jdx;
+
+  if (index->memosize)
+  {
+    idx = netsta_hash (net, sta) & (index->memosize - 1);
+
+    while (index->memo[idx].used)
+    {
+      if (!strcmp (net, index->memo[idx].net) && !strcmp (sta, index->memo[idx].sta))
+        return &index->memo[idx];
+
+      idx = (idx + 1) & (index->memosize - 1);
+    }
+  }
+
+  if (strlen (net) >= sizeof (memo->net) || strlen (sta) >= sizeof (memo->sta))
+    return NULL;
+
+  /* Grow the table when it would be more than half full */
+  if ((index->memocount + 1) * 2 > index->memosize)
+  {
+    oldmemo = index->memo;
+    oldsize = index->memosize;
+
+    index->memosize = (oldsize) ? oldsize * 2 : 64;
+
+    if ((index->memo = (struct slmatchmemo_s *)calloc (index->memosize, sizeof (struct slmatchmemo_s))) == NULL)
+    {
+      index->memo     = oldmemo;
+      index->memosize = oldsize;
+      return NULL;
+    }
+
+    for (jdx = 0; jdx < oldsize; jdx++)
+    {
+      if (!oldmemo[jdx].used)
+        continue;
+
+      idx = netsta_hash (oldmemo[jdx].net, oldmemo[jdx].sta) & (index->memosize - 1);
+      while (index->memo[idx].used)
+        idx = (idx + 1) & (index->memosize - 1);
+
+      index->memo[idx] = oldmemo[jdx];
+    }
+
+    free (oldmemo);
+  }
+
+  idx = netsta_hash (net, sta) & (index->memosize - 1);
+  while (index->memo[idx].used)
+    idx = (idx + 1) & (index->memosize - 1);
+
+  memo = &index->memo[idx];
+  memo->first = index->matchcount;
+  memo->count = 0;
+
+  /* Append the matching entries to the match lists */
+  for (jdx = 0; jdx < index->extracount; jdx++)
+  {
+    curstream = index->extras[jdx];
+
+    if (!sl_globmatch ((char *)net, curstream->net) ||
+        !sl_globmatch ((char *)sta, curstream->sta))
+      continue;
+
+    if (index->matchcount == index->matchsize)
+    {
+      SLstream **matches;
+      uint32_t matchsize = (index->matchsize) ? index->matchsize * 2 : 64;
+
+      if ((matches = (SLstream **)realloc (index->matches, matchsize * sizeof (SLstream *))) == NULL)
+      {
+        index->matchcount = memo->first;
+        return NULL;
+      }
+
+      index->matches   = matches;
+      index->matchsize = matchsize;
+    }
+
+    index->matches[index->matchcount++] = curstream;
+    memo->count++;
+  }
+
+  strcpy (memo->net, net);
+  strcpy (memo->sta, sta);
+  memo->used = 1;
+  index->memocount++;
+
+  return memo;
+} /* End of match_extras() */
+
+/***************************************************************************
+ * is_wildcard:
+ *
+ * Check if the network or station code of a stream entry contains
+ * sl_globmatch() wildcard characters.
+ *
+ * Returns 1 if wildcarded and 0 otherwise.
+ ***************************************************************************/
+static int
+is_wildcard (const SLstream *stream)
+{
+  return (strpbrk (stream->net, "*?[\\") || strpbrk (stream->sta, "*?[\\")) ? 1 : 0;
+} /* End of is_wildcard() */
+
+/***************************************************************************
+ * netsta_hash:
+ *
+ * Calculate a 32-bit FNV-1a hash of network and station codes.
+ ***************************************************************************/
+static uint32_t
+netsta_hash (const char *net, const char *sta)
+{
+  uint32_t hash = 2166136261u;
+
+  while (*net)
+    hash = (hash ^ (uint8_t)*net++) * 16777619u;
+
+  hash = (hash ^ '_') * 16777619u;
+
+  while (*sta)
+    hash = (hash ^ (uint8_t)*sta++) * 16777619u;
+
+  return hash;
+} /* End of netsta_hash() */
@@ -23,6 +23,7 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "libslink.h"
@@ -33,6 +34,14 @@
  *
  * Save the all the current the sequence numbers and time stamps into the
  * given state file.
+ * With SLCD.durablestate set the durable sequence numbers and time
+ * stamps committed by sl_commitacks() are saved instead.
+ *
+ * The state is formatted into a single buffer and written to a
+ * temporary file (the state file name with ".tmp" appended), which is
+ * synced and renamed over the state file.  A crash while saving leaves
+ * either the previous or the new state file complete, never a partial
+ * one.
  *
  * Returns:
  * -1 : error
@@ -42,43 +51,109 @@ int
 sl_savestate (SLCD *slconn, const char *statefile)
 {
   SLstream *curstream;
-  char line[100];
-  int linelen;
+  char *tempfile = NULL;
+  char *buffer = NULL;
+  size_t bufsize;
+  size_t buflen = 0;
+  char timestamp[30];
+  int written;
   int statefd;
 
-  curstream = slconn->streams;
+  /* Allocate the buffer, 100 bytes per stream and the temporary file name */
+  bufsize = strlen (statefile) + 5;
+  for (curstream = slconn->streams; curstream != NULL; curstream = curstream->next)
+    bufsize += 100;
 
-  /* Open the state file */
-  if ((statefd = slp_openfile (statefile, 'w')) < 0)
+  if ((tempfile = (char *)malloc (bufsize)) == NULL)
+  {
+    sl_log_r (slconn, 2, 0, "cannot allocate memory for state file buffer\n");
+    return -1;
+  }
+
+  snprintf (tempfile, strlen (statefile) + 5, "%s.tmp", statefile);
+  buffer  = tempfile + strlen (statefile) + 5;
+  bufsize = bufsize - (strlen (statefile) + 5);
+
+  if (!slconn->durablestate)
+    sl_formattimestamps (slconn);
+
+  /* Traverse stream chain and format sequence numbers */
+  for (curstream = slconn->streams; curstream != NULL; curstream = curstream->next)
+  {
+    if (slconn->durablestate)
+    {
+      if (!curstream->durnstime || !sl_nstime2timestamp (curstream->durnstime, timestamp))
+        timestamp[0] = '\0';
+
+      buflen += snprintf (buffer + buflen, bufsize - buflen, "%s %s %d %s\n",
+                          curstream->net, curstream->sta,
+                          curstream->durseqnum, timestamp);
+    }
+    else
+      buflen += snprintf (buffer + buflen, bufsize - buflen, "%s %s %d %s\n",
+                          curstream->net, curstream->sta,
+                          curstream->seqnum, curstream->timestamp);
+  }
+
+  /* Open the temporary state file */
+  if ((statefd = slp_openfile (tempfile, 't')) < 0)
   {
     sl_log_r (slconn, 2, 0, "cannot open state file for writing\n");
+    free (tempfile);
     return -1;
   }
 
   sl_log_r (slconn, 1, 2, "saving connection state to state file\n");
 
-  /* Traverse stream chain and write sequence numbers */
-  while (curstream != NULL)
+  while (buflen > 0)
   {
-    linelen = snprintf (line, sizeof (line), "%s %s %d %s\n",
-                        curstream->net, curstream->sta,
-                        curstream->seqnum, curstream->timestamp);
+    written = write (statefd, buffer, buflen);
 
-    if (write (statefd, line, linelen) != linelen)
+    if (written < 0 && errno == EINTR)
+      continue;
+
+    if (written <= 0)
     {
       sl_log_r (slconn, 2, 0, "cannot write to state file, %s\n", strerror (errno));
+      close (statefd);
+      unlink (tempfile);
+      free (tempfile);
       return -1;
     }
 
-    curstream = curstream->next;
+    buffer += written;
+    buflen -= written;
+  }
+
+  if (slp_syncfile (statefd))
+  {
+    sl_log_r (slconn, 2, 0, "cannot sync state file, %s\n", strerror (errno));
+    close (statefd);
+    unlink (tempfile);
+    free (tempfile);
+    return -1;
   }
 
   if (close (statefd))
   {
     sl_log_r (slconn, 2, 0, "cannot close state file, %s\n", strerror (errno));
+    unlink (tempfile);
+    free (tempfile);
     return -1;
   }
 
+  /* Replace the state file with the complete temporary file */
+  if (slp_replacefile (tempfile, statefile))
+  {
+    sl_log_r (slconn, 2, 0, "cannot replace state file %s, %s\n",
+              statefile, strerror (errno));
+    unlink (tempfile);
+    free (tempfile);
+    return -1;
+  }
+
+  free (tempfile);
+
   return 0;
 } /* End of sl_savestate() */
 
@@ -97,6 +172,7 @@ int
 sl_recoverstate (SLCD *slconn, const char *statefile)
 {
   SLstream *curstream;
+  SLreadbuf readbuf;
   int statefd;
   char net[3];
   char sta[6];
@@ -129,7 +205,9 @@ sl_recoverstate (SLCD *slconn, const char *statefile)
 
   count = 1;
 
-  while ((sl_readline (statefd, line, sizeof (line))) >= 0)
+  sl_readbuf_init (&readbuf, statefd);
+
+  while ((sl_readline_buf (&readbuf, line, sizeof (line))) >= 0)
   {
     fields = sscanf (line, "%2s %5s %d %19[0-9,]\n",
                      net, sta, &seqnum, timestamp);
@@ -140,24 +218,27 @@ sl_recoverstate (SLCD *slconn, const char *statefile)
     if (fields < 3)
     {
       sl_log_r (slconn, 2, 0, "could not parse line %d of state file\n", count);
+      count++;
+      continue;
     }
 
-    /* Search for a matching NET and STA in the stream chain */
-    curstream = slconn->streams;
-    while (curstream != NULL)
+    /* Find the matching NET and STA in the stream chain */
+    if ((curstream = sl_findstream (slconn, net, sta)) != NULL)
     {
-      if (!strcmp (net, curstream->net) &&
-          !strcmp (sta, curstream->sta))
-      {
-        curstream->seqnum = seqnum;
+      curstream->seqnum = seqnum;
 
-        if (fields == 4)
-          strncpy (curstream->timestamp, timestamp, 20);
+      if (fields == 4)
+      {
+        strncpy (curstream->timestamp, timestamp, 20);
+        curstream->tsstale = 0;
 
-        break;
+        if ((curstream->nstime = sl_timestamp2nstime (timestamp)) == SL_NSTERROR)
+          curstream->nstime = 0;
       }
 
-      curstream = curstream->next;
+      /* Recovered state is also acknowledged and durable */
+      curstream->ackseqnum = curstream->durseqnum = seqnum;
+      curstream->acknstime = curstream->durnstime = curstream->nstime;
     }
 
     count++;
@@ -25,8 +25,20 @@
 #include <memory.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "libslink.h"
+#include "mseedformat.h"
+
+/* SSE4.1 Steim decoders with runtime selection on x86 with GCC or Clang,
+ * only in optimized builds: without inlining of the intrinsics they are
+ * slower than the portable decoders */
+#if defined(__GNUC__) && defined(__OPTIMIZE__) && (defined(__x86_64__) || defined(__i386__))
+#define SL_STEIM_SSE41 1
+#include <immintrin.h>
+#else
+#define SL_STEIM_SSE41 0
+#endif
 
 /* Supported SEED data encodings */
 #define DE_ASCII 0
@@ -37,11 +49,15 @@
 #define DE_STEIM1 10
 #define DE_STEIM2 11
 
+/* Test for encodings that can be decoded */
+#define SL_DECODABLE(ENC) ((ENC) == DE_INT16 || (ENC) == DE_INT32 || \
+                           (ENC) == DE_STEIM1 || (ENC) == DE_STEIM2)
+
 /* Internal decoding routines */
-static int decode_int16 (int16_t *input, int samplecount, int32_t *output,
-                         int outputlength, int swapflag);
-static int decode_int32 (int32_t *input, int samplecount, int32_t *output,
-                         int outputlength, int swapflag);
+static int decode_int16 (int16_t *input, int inputlength, int samplecount,
+                         int32_t *output, int outputlength, int swapflag);
+static int decode_int32 (int32_t *input, int inputlength, int samplecount,
+                         int32_t *output, int outputlength, int swapflag);
 static int decode_steim1 (int32_t *input, int inputlength, int samplecount,
                           int32_t *output, int outputlength, char *srcname,
                           int swapflag, SLlog *log);
@@ -49,6 +65,18 @@ static int decode_steim2 (int32_t *input, int inputlength, int samplecount,
                           int32_t *output, int outputlength, char *srcname,
                           int swapflag, SLlog *log);
 
+#if SL_STEIM_SSE41
+static int decode_steim1_sse41 (int32_t *input, int inputlength, int samplecount,
+                                int32_t *output, int outputlength, char *srcname,
+                                int swapflag, SLlog *log);
+static int decode_steim2_sse41 (int32_t *input, int inputlength, int samplecount,
+                                int32_t *output, int outputlength, char *srcname,
+                                int swapflag, SLlog *log);
+#endif
+static int decode_samples (SLlog *log, int encoding, const char *dbuf, int datasize,
+                           int samplecount, int32_t *output, int outputlength,
+                           char *srcname, int swapflag);
+
 /* Control for printing debugging information */
 static int decodedebug = 0;
 
@@ -74,6 +102,7 @@ sl_msr_unpack (SLlog *log, SLMSrecord *msr, int swapflag)
   int datasize;     /* byte size of data samples in record */
   int nsamples;     /* number of samples unpacked */
   int unpacksize;   /* byte size of unpacked samples */
+  int32_t *samples;
   int i;
 
   /* Reset the error flag */
@@ -95,11 +124,19 @@ sl_msr_unpack (SLlog *log, SLMSrecord *msr, int swapflag)
   /* Calculate buffer size needed for unpacked samples */
   unpacksize = msr->fsdh.num_samples * sizeof (int32_t);
 
-  /* Allocate space for the unpacked data */
-  if (msr->datasamples != NULL)
-    msr->datasamples = (int32_t *)malloc (unpacksize);
-  else
-    msr->datasamples = (int32_t *)realloc (msr->datasamples, unpacksize);
+  /* Grow the sample buffer if needed, it is kept for following records */
+  if ((size_t)unpacksize > msr->datasize)
+  {
+    if ((samples = (int32_t *)realloc (msr->datasamples, unpacksize)) == NULL)
+    {
+      sl_log_rl (log, 2, 0, "%s(): Cannot allocate memory for %d samples\n",
+                 __func__, msr->fsdh.num_samples);
+      return (-1);
+    }
+
+    msr->datasamples = samples;
+    msr->datasize    = unpacksize;
+  }
 
   datasize = blksize - msr->fsdh.begin_data;
   dbuf     = msr->msrecord + msr->fsdh.begin_data;
@@ -113,8 +150,8 @@ sl_msr_unpack (SLlog *log, SLMSrecord *msr, int swapflag)
 
     sl_msr_srcname (msr, srcname, 0);
 
-    nsamples = decode_steim1 ((int32_t *)dbuf, datasize, msr->fsdh.num_samples,
-                              msr->datasamples, unpacksize, srcname, swapflag, log);
+    nsamples = decode_samples (log, DE_STEIM1, dbuf, datasize, msr->fsdh.num_samples,
+                               msr->datasamples, unpacksize, srcname, swapflag);
 
     break;
 
@@ -123,24 +160,24 @@ sl_msr_unpack (SLlog *log, SLMSrecord *msr, int swapflag)
 
     sl_msr_srcname (msr, srcname, 0);
 
-    nsamples = decode_steim2 ((int32_t *)dbuf, datasize, msr->fsdh.num_samples,
-                              msr->datasamples, unpacksize, srcname, swapflag, log);
+    nsamples = decode_samples (log, DE_STEIM2, dbuf, datasize, msr->fsdh.num_samples,
+                               msr->datasamples, unpacksize, srcname, swapflag);
 
     break;
 
   case DE_INT32:
     sl_log_rl (log, 1, 2, "Unpacking INT32 data samples\n");
 
-    nsamples = decode_int32 ((int32_t *)dbuf, msr->fsdh.num_samples,
-                             msr->datasamples, unpacksize, swapflag);
+    nsamples = decode_samples (log, DE_INT32, dbuf, datasize, msr->fsdh.num_samples,
+                               msr->datasamples, unpacksize, NULL, swapflag);
 
     break;
 
   case DE_INT16:
     sl_log_rl (log, 1, 2, "Unpacking INT16 data samples\n");
 
-    nsamples = decode_int16 ((int16_t *)dbuf, msr->fsdh.num_samples,
-                             msr->datasamples, unpacksize, swapflag);
+    nsamples = decode_samples (log, DE_INT16, dbuf, datasize, msr->fsdh.num_samples,
+                               msr->datasamples, unpacksize, NULL, swapflag);
 
     break;
 
@@ -166,17 +203,395 @@ sl_msr_unpack (SLlog *log, SLMSrecord *msr, int swapflag)
   return (-1);
 } /* End of sl_msr_unpack() */
 
+/************************************************************************
+ * sl_msr_decode:
+ *
+ * Decode the data samples of the miniSEED 2 or 3 record described by
+ * 'view' into the caller supplied 'output' buffer, which must have
+ * room for 'outputsamples' samples.  The resulting data samples are
+ * 32-bit integers in host byte order.  No memory is allocated.
+ *
+ * The encoding and data byte order are determined from blockette 1000
+ * for miniSEED 2 and from the fixed header for miniSEED 3.  The number
+ * of samples to decode can be determined with sl_view_numsamples().
+ *
+ * Return number of samples decoded or -1 on error.
+ ************************************************************************/
+int64_t
+sl_msr_decode (SLlog *log, const SLRecordView *view, int32_t *output,
+               int64_t outputsamples)
+{
+  const char *record;
+  char net[SL_VIEW_CODESIZE];
+  char sta[SL_VIEW_CODESIZE];
+  char loc[SL_VIEW_CODESIZE];
+  char chan[SL_VIEW_CODESIZE];
+  char srcname[70]; /* Source name, "Net_Sta_Loc_Chan" */
+  int64_t samplecount;
+  int encoding;
+  int dataoffset;
+  int bigendian;
+  int swapflag;
+
+  if (!view || !view->record || !output || outputsamples < 0)
+    return -1;
+
+  record = view->record;
+
+  if (view->formatversion == 3)
+  {
+    encoding    = *pMS3FSDH_ENCODING (record);
+    samplecount = HO4u (*pMS3FSDH_NUMSAMPLES (record), view->swapflag);
+    dataoffset  = MS3FSDH_LENGTH + *pMS3FSDH_SIDLENGTH (record) +
+                 HO2u (*pMS3FSDH_EXTRALENGTH (record), view->swapflag);
+
+    /* Steim frames are always big endian, other encodings little endian */
+    bigendian = (encoding == DE_STEIM1 || encoding == DE_STEIM2);
+  }
+  else if (view->formatversion == 2 && view->b1000)
+  {
+    encoding    = *pMS2B1000_ENCODING (record + view->b1000);
+    bigendian   = *pMS2B1000_BYTEORDER (record + view->b1000);
+    samplecount = HO2u (*pMS2FSDH_NUMSAMPLES (record), view->swapflag);
+    dataoffset  = HO2u (*pMS2FSDH_DATAOFFSET (record), view->swapflag);
+  }
+  else
+  {
+    sl_log_rl (log, 2, 0, "%s(): No Blockette 1000 found!\n", __func__);
+    return -1;
+  }
+
+  if (samplecount == 0)
+    return 0;
+
+  if (dataoffset >= view->reclen)
+  {
+    sl_log_rl (log, 2, 0, "%s(): Data offset %d beyond record length %d\n",
+               __func__, dataoffset, view->reclen);
+    return -1;
+  }
+
+  if (samplecount > outputsamples || samplecount > INT32_MAX / (int64_t)sizeof (int32_t))
+  {
+    sl_log_rl (log, 2, 0, "%s(): Output buffer too small for %" PRId64 " samples\n",
+               __func__, samplecount);
+    return -1;
+  }
+
+  if (!SL_DECODABLE (encoding))
+  {
+    sl_log_rl (log, 2, 0, "Unable to unpack format %d\n", encoding);
+    return -1;
+  }
+
+  if ((encoding == DE_INT16 || encoding == DE_INT32) &&
+      samplecount * ((encoding == DE_INT16) ? 2 : 4) > view->reclen - dataoffset)
+  {
+    sl_log_rl (log, 2, 0, "%s(): %" PRId64 " samples exceed data length %d\n",
+               __func__, samplecount, view->reclen - dataoffset);
+    return -1;
+  }
+
+  /* Swap if the data byte order differs from the host order */
+  swapflag = (bigendian == sl_littleendianhost ());
+
+  srcname[0] = '\0';
+  if ((encoding == DE_STEIM1 || encoding == DE_STEIM2) &&
+      !sl_view_nslc (view, net, sta, loc, chan))
+  {
+    snprintf (srcname, sizeof (srcname), "%s_%s_%s_%s", net, sta, loc, chan);
+  }
+
+  return decode_samples (log, encoding, record + dataoffset, view->reclen - dataoffset,
+                         (int)samplecount, output, (int)(samplecount * sizeof (int32_t)),
+                         srcname, swapflag);
+} /* End of sl_msr_decode() */
+
+/************************************************************************
+ * sl_msr_decode_batch:
+ *
+ * Decode the data samples of 'nviews' records into a single contiguous
+ * 'output' buffer with room for 'outputsamples' samples, in the order
+ * of the records.  No memory is allocated.
+ *
+ * If 'offsets' is not NULL it must have room for (nviews + 1) values
+ * and is set to the index of the first sample of each record in
+ * 'output', followed by the total number of samples.
+ *
+ * Return total number of samples decoded or -1 on error.
+ ************************************************************************/
+int64_t
+sl_msr_decode_batch (SLlog *log, const SLRecordView *views, int nviews,
+                     int32_t *output, int64_t outputsamples, int64_t *offsets)
+{
+  int64_t total = 0;
+  int64_t nsamples;
+  int idx;
+
+  if (!views || nviews < 0 || !output)
+    return -1;
+
+  for (idx = 0; idx < nviews; idx++)
+  {
+    if (offsets)
+      offsets[idx] = total;
+
+    nsamples = sl_msr_decode (log, &views[idx], output + total, outputsamples - total);
+
+    if (nsamples < 0)
+      return -1;
+
+    total += nsamples;
+  }
+
+  if (offsets)
+    offsets[nviews] = total;
+
+  return total;
+} /* End of sl_msr_decode_batch() */
+
+/************************************************************************
+ * sl_decode_tracebatch:
+ *
+ * Decode the samples of 'nviews' records of the same channel, in time
+ * order, into a single contiguous array of 'sampletype' samples: 'i'
+ * for 32-bit integers, 'f' for floats or 'd' for doubles.
+ *
+ * Consecutive records are joined into a segment when the start time
+ * of a record is within half a sample period of the time following
+ * the last sample of the segment and the sample rate is the same,
+ * otherwise a new segment is started.  Records without samples are
+ * skipped.
+ *
+ * The samples are decoded with sl_msr_decode_batch() and converted in
+ * place.  The batch, segment table and samples are allocated as one
+ * block sized from the record headers, the samples are 16-byte
+ * aligned.  Free the batch with sl_free_tracebatch().
+ *
+ * Return a new SLTraceBatch on success and NULL on error.
+ ************************************************************************/
+SLTraceBatch *
+sl_decode_tracebatch (SLlog *log, const SLRecordView *views, int nviews,
+                      char sampletype)
+{
+  SLTraceBatch *batch;
+  SLSegment *segment = NULL;
+  char net[SL_VIEW_CODESIZE], sta[SL_VIEW_CODESIZE];
+  char loc[SL_VIEW_CODESIZE], chan[SL_VIEW_CODESIZE];
+  char nslc[4 * SL_VIEW_CODESIZE];
+  char firstnslc[4 * SL_VIEW_CODESIZE];
+  size_t samplesize;
+  size_t headersize;
+  int64_t totalsamples = 0;
+  int64_t *offsets;
+  int64_t count;
+  int64_t nsamples;
+  int64_t sidx;
+  int32_t *isamples;
+  double starttime;
+  double samprate;
+  double offset;
+  int idx;
+
+  if (!views || nviews <= 0)
+    return NULL;
+
+  if (sampletype == 'i' || sampletype == 'f')
+    samplesize = sizeof (int32_t);
+  else if (sampletype == 'd')
+    samplesize = sizeof (double);
+  else
+  {
+    sl_log_rl (log, 2, 0, "%s(): Unsupported sample type '%c'\n", __func__, sampletype);
+    return NULL;
+  }
+
+  /* Size the sample array from the headers and check the channel */
+  for (idx = 0; idx < nviews; idx++)
+  {
+    if ((count = sl_view_numsamples (&views[idx])) < 0 ||
+        sl_view_nslc (&views[idx], net, sta, loc, chan))
+    {
+      sl_log_rl (log, 2, 0, "%s(): Cannot read header of record %d\n", __func__, idx);
+      return NULL;
+    }
+
+    snprintf (nslc, sizeof (nslc), "%s_%s_%s_%s", net, sta, loc, chan);
+
+    if (idx == 0)
+    {
+      strcpy (firstnslc, nslc);
+    }
+    else if (strcmp (nslc, firstnslc))
+    {
+      sl_log_rl (log, 2, 0, "%s(): Record %d is for %s, expected %s\n",
+                 __func__, idx, nslc, firstnslc);
+      return NULL;
+    }
+
+    totalsamples += count;
+  }
+
+  /* One block for the batch, segment table, record sample offsets
+   * and 16-byte aligned samples */
+  headersize = sizeof (SLTraceBatch) + nviews * sizeof (SLSegment) +
+               (nviews + 1) * sizeof (int64_t);
+  headersize = (headersize + 15) & ~(size_t)15;
+
+  if ((batch = (SLTraceBatch *)malloc (headersize + totalsamples * samplesize)) == NULL)
+  {
+    sl_log_rl (log, 2, 0, "%s(): Cannot allocate memory for %" PRId64 " samples\n",
+               __func__, totalsamples);
+    return NULL;
+  }
+
+  batch->sampletype  = sampletype;
+  batch->numsamples  = 0;
+  batch->datasamples = (char *)batch + headersize;
+  batch->numsegments = 0;
+  batch->segments    = (SLSegment *)(batch + 1);
+
+  offsets  = (int64_t *)(batch->segments + nviews);
+  isamples = (int32_t *)batch->datasamples;
+
+  if ((totalsamples = sl_msr_decode_batch (log, views, nviews, isamples,
+                                           totalsamples, offsets)) < 0)
+  {
+    free (batch);
+    return NULL;
+  }
+
+  /* Convert in place, backwards for doubles as they are twice the size */
+  if (sampletype == 'f')
+  {
+    for (sidx = 0; sidx < totalsamples; sidx++)
+      ((float *)isamples)[sidx] = (float)isamples[sidx];
+  }
+  else if (sampletype == 'd')
+  {
+    for (sidx = totalsamples - 1; sidx >= 0; sidx--)
+      ((double *)isamples)[sidx] = (double)isamples[sidx];
+  }
+
+  for (idx = 0; idx < nviews; idx++)
+  {
+    nsamples = offsets[idx + 1] - offsets[idx];
+
+    if (nsamples == 0)
+      continue;
+
+    starttime = sl_view_depochstime (&views[idx]);
+    samprate  = sl_view_samprate (&views[idx]);
+
+    /* Offset from the time following the last sample of the segment */
+    if (segment && samprate > 0.0 && samprate == segment->samprate)
+    {
+      offset = starttime - (segment->starttime + segment->numsamples / samprate);
+
+      if (offset < 0.0)
+        offset = -offset;
+    }
+    else
+    {
+      offset = -1.0;
+    }
+
+    if (offset >= 0.0 && offset <= (0.5 / samprate))
+    {
+      segment->numsamples += nsamples;
+    }
+    else
+    {
+      segment = &batch->segments[batch->numsegments++];
+
+      segment->start      = offsets[idx];
+      segment->numsamples = nsamples;
+      segment->starttime  = starttime;
+      segment->samprate   = samprate;
+    }
+  }
+
+  batch->numsamples = totalsamples;
+
+  return batch;
+} /* End of sl_decode_tracebatch() */
+
+/************************************************************************
+ * sl_free_tracebatch:
+ *
+ * Free a SLTraceBatch allocated by sl_decode_tracebatch() and set the
+ * pointer to NULL.
+ ************************************************************************/
+void
+sl_free_tracebatch (SLTraceBatch **batch)
+{
+  if (batch == NULL || *batch == NULL)
+    return;
+
+  free (*batch);
+  *batch = NULL;
+} /* End of sl_free_tracebatch() */
+
+/************************************************************************
+ * decode_samples:
+ *
+ * Decode 'samplecount' samples of a supported encoding from the data
+ * section at 'dbuf' into the supplied buffer as 32-bit integers.  The
+ * SSE4.1 Steim decoders are used when the CPU supports them, tested on
+ * each call so that no state is set up and threads may decode
+ * concurrently.
+ *
+ * Return number of samples in output buffer on success, -1 on error.
+ ************************************************************************/
+static int
+decode_samples (SLlog *log, int encoding, const char *dbuf, int datasize,
+                int samplecount, int32_t *output, int outputlength,
+                char *srcname, int swapflag)
+{
+  switch (encoding)
+  {
+  case DE_STEIM1:
+#if SL_STEIM_SSE41
+    if (!decodedebug && __builtin_cpu_supports ("sse4.1"))
+      return decode_steim1_sse41 ((int32_t *)dbuf, datasize, samplecount,
+                                  output, outputlength, srcname, swapflag, log);
+#endif
+    return decode_steim1 ((int32_t *)dbuf, datasize, samplecount,
+                          output, outputlength, srcname, swapflag, log);
+
+  case DE_STEIM2:
+#if SL_STEIM_SSE41
+    if (!decodedebug && __builtin_cpu_supports ("sse4.1"))
+      return decode_steim2_sse41 ((int32_t *)dbuf, datasize, samplecount,
+                                  output, outputlength, srcname, swapflag, log);
+#endif
+    return decode_steim2 ((int32_t *)dbuf, datasize, samplecount,
+                          output, outputlength, srcname, swapflag, log);
+
+  case DE_INT32:
+    return decode_int32 ((int32_t *)dbuf, datasize, samplecount,
+                         output, outputlength, swapflag);
+
+  case DE_INT16:
+    return decode_int16 ((int16_t *)dbuf, datasize, samplecount,
+                         output, outputlength, swapflag);
+  }
+
+  return -1;
+} /* End of decode_samples() */
+
 /************************************************************************
  * decode_int16:
  *
  * Decode 16-bit integer data and place in supplied buffer as 32-bit
- * integers.
+ * integers.  The 'inputlength' bytes of input must hold all samples.
  *
- * Return number of samples in output buffer on success, -1 on error.
+ * Return number of samples in output buffer on success, or a negative
+ * value on error.
  ************************************************************************/
 static int
-decode_int16 (int16_t *input, int samplecount, int32_t *output,
-              int outputlength, int swapflag)
+decode_int16 (int16_t *input, int inputlength, int samplecount,
+              int32_t *output, int outputlength, int swapflag)
 {
   int16_t sample;
   int idx;
@@ -187,6 +602,9 @@ decode_int16 (int16_t *input, int samplecount, int32_t *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
+  if ((int64_t)samplecount * (int)sizeof (int16_t) > inputlength)
+    return MSD_BADSAMPCOUNT;
+
   for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (int32_t); idx++)
   {
     sample = input[idx];
@@ -206,13 +624,14 @@ decode_int16 (int16_t *input, int samplecount, int32_t *output,
  * decode_int32:
  *
  * Decode 32-bit integer data and place in supplied buffer as 32-bit
- * integers.
+ * integers.  The 'inputlength' bytes of input must hold all samples.
  *
- * Return number of samples in output buffer on success, -1 on error.
+ * Return number of samples in output buffer on success, or a negative
+ * value on error.
  ************************************************************************/
 static int
-decode_int32 (int32_t *input, int samplecount, int32_t *output,
-              int outputlength, int swapflag)
+decode_int32 (int32_t *input, int inputlength, int samplecount,
+              int32_t *output, int outputlength, int swapflag)
 {
   int32_t sample;
   int idx;
@@ -223,6 +642,9 @@ decode_int32 (int32_t *input, int samplecount, int32_t *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
+  if ((int64_t)samplecount * (int)sizeof (int32_t) > inputlength)
+    return MSD_BADSAMPCOUNT;
+
   for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (int32_t); idx++)
   {
     sample = input[idx];
@@ -632,3 +1054,318 @@ decode_steim2 (int32_t *input, int inputlength, int samplecount,
 
   return (outputptr - output);
 } /* End of decode_steim2() */
+
+#if SL_STEIM_SSE41
+/************************************************************************
+ * SSE4.1 Steim decoders
+ *
+ * Decoding is done in two phases for each frame: first all
+ * differences in the frame are expanded into a buffer, one 32-bit
+ * word at a time without branching on the nibble, then the samples
+ * are integrated with a vectorized prefix sum.  The lookup tables
+ * below are indexed by the nibble (and for Steim2 the dnib) of a
+ * word.
+ *
+ * Results are identical to decode_steim1() and decode_steim2(), which
+ * remain the reference implementations.
+ ************************************************************************/
+
+/* Differences per Steim1 word by nibble */
+static const int steim1_count[4] = {0, 4, 2, 1};
+
+/* Right shift sign extending the differences of a Steim1 word by nibble */
+static const int steim1_shift[4] = {0, 24, 16, 0};
+
+/* Byte shuffles placing each difference of a Steim1 word in the high
+ * bits of a 32-bit lane, by data byte order (little, big) and nibble */
+static const int8_t steim1_shuffle[2][4][16] = {
+    {{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, 0, -1, -1, -1, 1, -1, -1, -1, 2, -1, -1, -1, 3},
+     {-1, -1, 0, 1, -1, -1, 2, 3, -1, -1, -1, -1, -1, -1, -1, -1},
+     {0, 1, 2, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}},
+    {{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, 0, -1, -1, -1, 1, -1, -1, -1, 2, -1, -1, -1, 3},
+     {-1, -1, 1, 0, -1, -1, 3, 2, -1, -1, -1, -1, -1, -1, -1, -1},
+     {3, 2, 1, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}}};
+
+/* Steim2 words with nibble 10 or 11 are indexed by ((nibble - 2) * 4 + dnib),
+ * a count of 0 marks the undefined combinations */
+static const int steim2_count[8] = {0, 1, 2, 3, 5, 6, 7, 0};
+
+/* Right shift sign extending the differences by width (32 - width) */
+static const int steim2_shift[8] = {0, 2, 17, 22, 26, 27, 28, 0};
+
+/* Multipliers shifting each difference to the high bits of a lane */
+#define SL_P2(N) ((int32_t)(1U << (N)))
+static const int32_t steim2_mult[8][8] = {
+    {0, 0, 0, 0, 0, 0, 0, 0},
+    {SL_P2 (2), 0, 0, 0, 0, 0, 0, 0},
+    {SL_P2 (2), SL_P2 (17), 0, 0, 0, 0, 0, 0},
+    {SL_P2 (2), SL_P2 (12), SL_P2 (22), 0, 0, 0, 0, 0},
+    {SL_P2 (2), SL_P2 (8), SL_P2 (14), SL_P2 (20), SL_P2 (26), 0, 0, 0},
+    {SL_P2 (2), SL_P2 (7), SL_P2 (12), SL_P2 (17), SL_P2 (22), SL_P2 (27), 0, 0},
+    {SL_P2 (4), SL_P2 (8), SL_P2 (12), SL_P2 (16), SL_P2 (20), SL_P2 (24), SL_P2 (28), 0},
+    {0, 0, 0, 0, 0, 0, 0, 0}};
+#undef SL_P2
+
+/************************************************************************
+ * integrate_sse41:
+ *
+ * Integrate 'count' differences into 'output' starting from the
+ * sample value in 'last', which is updated to the last sample.
+ ************************************************************************/
+__attribute__ ((target ("sse4.1"))) static void
+integrate_sse41 (const int32_t *diff, int count, int32_t *output, int32_t *last)
+{
+  __m128i carry = _mm_set1_epi32 (*last);
+  __m128i x;
+  int32_t sample;
+  int idx = 0;
+
+  for (; idx + 4 <= count; idx += 4)
+  {
+    x     = _mm_loadu_si128 ((const __m128i *)(diff + idx));
+    x     = _mm_add_epi32 (x, _mm_slli_si128 (x, 4));
+    x     = _mm_add_epi32 (x, _mm_slli_si128 (x, 8));
+    x     = _mm_add_epi32 (x, carry);
+    carry = _mm_shuffle_epi32 (x, 0xFF);
+
+    _mm_storeu_si128 ((__m128i *)(output + idx), x);
+  }
+
+  sample = _mm_cvtsi128_si32 (carry);
+
+  for (; idx < count; idx++)
+  {
+    sample += diff[idx];
+    output[idx] = sample;
+  }
+
+  *last = sample;
+} /* End of integrate_sse41() */
+
+/************************************************************************
+ * decode_steim1_sse41:
+ *
+ * SSE4.1 version of decode_steim1(), same arguments and results.
+ ************************************************************************/
+__attribute__ ((target ("sse4.1"))) static int
+decode_steim1_sse41 (int32_t *input, int inputlength, int samplecount,
+                     int32_t *output, int outputlength, char *srcname,
+                     int swapflag, SLlog *log)
+{
+  int32_t *outputptr = output;
+  uint32_t frame[16];
+  int32_t diff[16 * 4 + 4]; /* 15 words of up to 4 differences, plus store overrun */
+  int32_t X0    = 0;
+  int32_t Xn    = 0;
+  int32_t last  = 0;
+  int maxframes = inputlength / 64;
+  int frameidx;
+  int startnibble;
+  int nibble;
+  int widx;
+  int ndiff;
+  __m128i word;
+
+  if (inputlength <= 0)
+    return 0;
+
+  if (!input || !output || outputlength <= 0 || maxframes <= 0)
+    return -1;
+
+  swapflag = (swapflag) ? 1 : 0;
+
+  for (frameidx = 0; frameidx < maxframes && samplecount > 0; frameidx++)
+  {
+    memcpy (frame, input + (16 * frameidx), 64);
+
+    if (frameidx == 0)
+    {
+      if (swapflag)
+      {
+        sl_gswap4a (&frame[1]);
+        sl_gswap4a (&frame[2]);
+      }
+
+      X0 = frame[1];
+      Xn = frame[2];
+
+      startnibble = 3;
+    }
+    else
+    {
+      startnibble = 1;
+    }
+
+    if (swapflag)
+      sl_gswap4a (&frame[0]);
+
+    /* Expand differences until enough for the remaining samples */
+    ndiff = 0;
+    for (widx = startnibble; widx < 16 && ndiff < samplecount; widx++)
+    {
+      nibble = EXTRACTBITRANGE (frame[0], (30 - (2 * widx)), 2);
+
+      word = _mm_cvtsi32_si128 ((int32_t)frame[widx]);
+      word = _mm_shuffle_epi8 (word, _mm_loadu_si128 ((const __m128i *)steim1_shuffle[swapflag][nibble]));
+      word = _mm_sra_epi32 (word, _mm_cvtsi32_si128 (steim1_shift[nibble]));
+
+      _mm_storeu_si128 ((__m128i *)(diff + ndiff), word);
+      ndiff += steim1_count[nibble];
+    }
+
+    if (ndiff > samplecount)
+      ndiff = samplecount;
+
+    /* The first difference is replaced by the forward integration constant */
+    if (outputptr == output && ndiff > 0)
+    {
+      diff[0] = X0;
+      last    = 0;
+    }
+
+    integrate_sse41 (diff, ndiff, outputptr, &last);
+
+    outputptr += ndiff;
+    samplecount -= ndiff;
+  }
+
+  if (outputptr != output && *(outputptr - 1) != Xn)
+  {
+    sl_log_rl (log, 1, 0, "%s: Warning: Data integrity check for Steim1 failed, Last sample=%d, Xn=%d\n",
+               srcname, *(outputptr - 1), Xn);
+  }
+
+  return (outputptr - output);
+} /* End of decode_steim1_sse41() */
+
+/************************************************************************
+ * decode_steim2_sse41:
+ *
+ * SSE4.1 version of decode_steim2(), same arguments and results.
+ ************************************************************************/
+__attribute__ ((target ("sse4.1"))) static int
+decode_steim2_sse41 (int32_t *input, int inputlength, int samplecount,
+                     int32_t *output, int outputlength, char *srcname,
+                     int swapflag, SLlog *log)
+{
+  int32_t *outputptr = output;
+  uint32_t frame[16];
+  int32_t diff[16 * 7 + 8]; /* 15 words of up to 7 differences, plus store overrun */
+  int32_t X0    = 0;
+  int32_t Xn    = 0;
+  int32_t last  = 0;
+  int maxframes = inputlength / 64;
+  int frameidx;
+  int startnibble;
+  int nibble;
+  int widx;
+  int ndiff;
+  int code;
+  uint32_t value;
+  __m128i word;
+  __m128i shift;
+
+  if (inputlength <= 0)
+    return 0;
+
+  if (!input || !output || outputlength <= 0 || maxframes <= 0)
+    return -1;
+
+  swapflag = (swapflag) ? 1 : 0;
+
+  for (frameidx = 0; frameidx < maxframes && samplecount > 0; frameidx++)
+  {
+    memcpy (frame, input + (16 * frameidx), 64);
+
+    if (frameidx == 0)
+    {
+      if (swapflag)
+      {
+        sl_gswap4a (&frame[1]);
+        sl_gswap4a (&frame[2]);
+      }
+
+      X0 = frame[1];
+      Xn = frame[2];
+
+      startnibble = 3;
+    }
+    else
+    {
+      startnibble = 1;
+    }
+
+    if (swapflag)
+      sl_gswap4a (&frame[0]);
+
+    /* Expand differences until enough for the remaining samples */
+    ndiff = 0;
+    for (widx = startnibble; widx < 16 && ndiff < samplecount; widx++)
+    {
+      nibble = EXTRACTBITRANGE (frame[0], (30 - (2 * widx)), 2);
+
+      if (nibble < 2)
+      {
+        /* Four 1-byte differences, or none */
+        word = _mm_cvtsi32_si128 ((int32_t)frame[widx]);
+        word = _mm_shuffle_epi8 (word, _mm_loadu_si128 ((const __m128i *)steim1_shuffle[swapflag][nibble]));
+        word = _mm_srai_epi32 (word, 24);
+
+        _mm_storeu_si128 ((__m128i *)(diff + ndiff), word);
+        ndiff += (nibble) ? 4 : 0;
+        continue;
+      }
+
+      value = frame[widx];
+      if (swapflag)
+        sl_gswap4a (&value);
+
+      code = (nibble - 2) * 4 + (value >> 30);
+
+      if (steim2_count[code] == 0)
+      {
+        sl_log_rl (log, 2, 0, "%s: Impossible Steim2 dnib=%s for nibble=%s\n", srcname,
+                   (nibble == 2) ? "00" : "11", (nibble == 2) ? "10" : "11");
+
+        return -1;
+      }
+
+      /* Broadcast word, shift each difference to the top and sign extend */
+      word  = _mm_set1_epi32 ((int32_t)value);
+      shift = _mm_cvtsi32_si128 (steim2_shift[code]);
+
+      _mm_storeu_si128 ((__m128i *)(diff + ndiff),
+                        _mm_sra_epi32 (_mm_mullo_epi32 (word, _mm_loadu_si128 ((const __m128i *)steim2_mult[code])), shift));
+      _mm_storeu_si128 ((__m128i *)(diff + ndiff + 4),
+                        _mm_sra_epi32 (_mm_mullo_epi32 (word, _mm_loadu_si128 ((const __m128i *)(steim2_mult[code] + 4))), shift));
+
+      ndiff += steim2_count[code];
+    }
+
+    if (ndiff > samplecount)
+      ndiff = samplecount;
+
+    /* The first difference is replaced by the forward integration constant */
+    if (outputptr == output && ndiff > 0)
+    {
+      diff[0] = X0;
+      last    = 0;
+    }
+
+    integrate_sse41 (diff, ndiff, outputptr, &last);
+
+    outputptr += ndiff;
+    samplecount -= ndiff;
+  }
+
+  if (outputptr != output && *(outputptr - 1) != Xn)
+  {
+    sl_log_rl (log, 1, 0, "%s: Warning: Data integrity check for Steim2 failed, Last sample=%d, Xn=%d\n",
+               srcname, *(outputptr - 1), Xn);
+  }
+
+  return (outputptr - output);
+} /* End of decode_steim2_sse41() */
+#endif /* SL_STEIM_SSE41 */
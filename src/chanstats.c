@@ -0,0 +1,457 @@
+/***************************************************************************
+ * chanstats.c
+ * Routines to track data latency and continuity per channel.
+ *
+ * A channel is identified by its network, station, location and
+ * channel codes.  The statistics are kept in an open addressing hash
+ * table of fixed size entries, each record is an O(1) update:
+ *
+ * latency: wall clock time at arrival minus the time of the last sample
+ * gaps/overlaps: record start time compared to the time of the next
+ *   expected sample after the previous record, tolerating half a
+ *   sample period
+ * rate: records per second over CS_RATEWINDOW second windows
+ *
+ * The latencies of all records are also counted in a histogram over
+ * all channels, for the latency distribution of the whole process.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chanstats.h"
+
+static ChanStat *cs_lookup (ChanStats *cs, const char *net, const char *sta,
+			    const char *loc, const char *chan);
+static uint32_t cs_hash (const char *net, const char *sta,
+			 const char *loc, const char *chan);
+static double cs_quantile (ChanStats *cs, double quantile);
+
+/* Upper bounds of the latency histogram buckets, set by cs_new() */
+static double latencybounds[CS_LATENCYBOUNDS];
+
+
+/***************************************************************************
+ * cs_new:
+ *
+ * Allocate a new, empty channel statistics table.
+ *
+ * Returns the table on success and NULL on error.
+ ***************************************************************************/
+ChanStats *
+cs_new (void)
+{
+  static const double steps[5] = { 1.0, 1.585, 2.512, 3.981, 6.310 };
+  ChanStats *cs;
+  double decade = 1e-5;
+  int idx;
+
+  if ( ! (cs = (ChanStats *) calloc (1, sizeof (ChanStats))) )
+    {
+      sl_log (2, 0, "cannot allocate memory for channel statistics\n");
+      return NULL;
+    }
+
+  for ( idx = 0; idx < CS_LATENCYBOUNDS; idx++ )
+    {
+      if ( idx > 0 && idx % 5 == 0 )
+	decade *= 10.0;
+
+      latencybounds[idx] = decade * steps[idx % 5];
+    }
+
+  return cs;
+}  /* End of cs_new() */
+
+
+/***************************************************************************
+ * cs_free:
+ *
+ * Free a channel statistics table.
+ ***************************************************************************/
+void
+cs_free (ChanStats *cs)
+{
+  if ( ! cs )
+    return;
+
+  free (cs->slots);
+  free (cs);
+}  /* End of cs_free() */
+
+
+/***************************************************************************
+ * cs_update:
+ *
+ * Update the statistics of the channel of a data record received at
+ * 'now' (epoch seconds).
+ *
+ * Returns 0 on success and -1 if the record cannot be parsed or on
+ * allocation error.
+ ***************************************************************************/
+int
+cs_update (ChanStats *cs, const SLpacket *slpack, double now)
+{
+  SLRecordView view;
+  ChanStat *stat;
+  SLnstime starttime;
+  SLnstime lastsample;
+  SLnstime period;
+  SLnstime offset;
+  int lower, upper, middle;
+  char net[SL_VIEW_CODESIZE], sta[SL_VIEW_CODESIZE];
+  char loc[SL_VIEW_CODESIZE], chan[SL_VIEW_CODESIZE];
+
+  if ( sl_view_packet (&view, slpack) ||
+       sl_view_nslc (&view, net, sta, loc, chan) )
+    return -1;
+
+  if ( (starttime = sl_view_nstime (&view)) == SL_NSTERROR ||
+       (lastsample = sl_view_lastsamptime (&view)) == SL_NSTERROR )
+    return -1;
+
+  if ( ! (stat = cs_lookup (cs, net, sta, loc, chan)) )
+    return -1;
+
+  /* Compare the start to the next expected sample time */
+  if ( stat->records > 0 && (period = sl_view_sampleperiod (&view)) > 0 )
+    {
+      offset = starttime - (stat->lastsample + period);
+
+      if ( offset > period / 2 )
+	{
+	  stat->gaps++;
+	  stat->gaptime += offset;
+	}
+      else if ( offset < -(period / 2) )
+	{
+	  stat->overlaps++;
+	}
+    }
+
+  stat->lastsample = lastsample;
+  stat->latency = now - SL_NSTIME2EPOCH (lastsample);
+  stat->records++;
+
+  /* Count the latency in the first bucket with a bound not below it */
+  lower = 0;
+  upper = CS_LATENCYBOUNDS;
+  while ( lower < upper )
+    {
+      middle = (lower + upper) / 2;
+
+      if ( stat->latency > latencybounds[middle] )
+	lower = middle + 1;
+      else
+	upper = middle;
+    }
+
+  cs->latencycounts[lower]++;
+  cs->latencysum += stat->latency;
+
+  /* Records per second over fixed windows */
+  if ( stat->windowstart == 0.0 )
+    stat->windowstart = now;
+
+  stat->windowcount++;
+
+  if ( now - stat->windowstart >= CS_RATEWINDOW )
+    {
+      stat->rate = stat->windowcount / (now - stat->windowstart);
+      stat->windowstart = now;
+      stat->windowcount = 0;
+    }
+
+  return 0;
+}  /* End of cs_update() */
+
+
+/***************************************************************************
+ * cs_dump:
+ *
+ * Log the statistics of all channels.  The rate of channels without
+ * a complete rate window yet is that of the partial window.
+ ***************************************************************************/
+void
+cs_dump (ChanStats *cs, double now)
+{
+  ChanStat *stat;
+  uint32_t idx;
+
+  sl_log (0, 0, "Channel statistics, %u channels, latency p50 %.6f s, p99 %.6f s:\n",
+	  cs->count, cs_quantile (cs, 0.5), cs_quantile (cs, 0.99));
+
+  for ( idx = 0; idx < cs->size; idx++ )
+    {
+      stat = &cs->slots[idx];
+
+      if ( ! stat->hash )
+	continue;
+
+      sl_log (0, 0, "%s_%s_%s_%s latency %.1f s, %.3f rec/s, %llu records, "
+	      "%u gaps (%.3f s), %u overlaps\n",
+	      stat->net, stat->sta, stat->loc, stat->chan,
+	      stat->latency,
+	      ( stat->rate > 0.0 || now <= stat->windowstart ) ? stat->rate :
+	      stat->windowcount / (now - stat->windowstart),
+	      (unsigned long long) stat->records,
+	      stat->gaps, SL_NSTIME2EPOCH (stat->gaptime), stat->overlaps);
+    }
+}  /* End of cs_dump() */
+
+
+/***************************************************************************
+ * cs_metrics:
+ *
+ * Write the statistics of all channels to a metrics file.
+ ***************************************************************************/
+void
+cs_metrics (ChanStats *cs, MetricsFile *mf)
+{
+  static const struct
+  {
+    const char *name;
+    const char *type;
+    const char *help;
+  } families[] = {
+    { "slarchive_channel_latency_seconds", "gauge",
+      "Wall clock minus last sample time at arrival of the last record" },
+    { "slarchive_channel_records_total", "counter", "Records received" },
+    { "slarchive_channel_records_per_second", "gauge",
+      "Records per second over the last complete window" },
+    { "slarchive_channel_gaps_total", "counter", "Gaps between consecutive records" },
+    { "slarchive_channel_gap_seconds_total", "counter", "Total time of gaps" },
+    { "slarchive_channel_overlaps_total", "counter", "Overlaps between consecutive records" },
+    { "slarchive_channel_last_sample_timestamp_seconds", "gauge",
+      "Time of the last sample received" }
+  };
+  ChanStat *stat;
+  char labels[METRICS_LABELLEN];
+  char bound[32];
+  uint64_t count;
+  uint32_t idx;
+  int family;
+
+  metrics_family (mf, "slarchive_latency_seconds", "histogram",
+		  "Wall clock minus last sample time at arrival of data records");
+
+  for ( count = 0, idx = 0; idx <= CS_LATENCYBOUNDS; idx++ )
+    {
+      count += cs->latencycounts[idx];
+
+      if ( idx < CS_LATENCYBOUNDS )
+	snprintf (bound, sizeof (bound), "%.4g", latencybounds[idx]);
+      else
+	strcpy (bound, "+Inf");
+
+      metrics_labels (labels, sizeof (labels), "le", bound, NULL);
+      metrics_count (mf, "slarchive_latency_seconds_bucket", labels, count);
+    }
+
+  metrics_value (mf, "slarchive_latency_seconds_sum", NULL, cs->latencysum);
+  metrics_count (mf, "slarchive_latency_seconds_count", NULL, count);
+
+  for ( family = 0; family < 7; family++ )
+    {
+      metrics_family (mf, families[family].name, families[family].type,
+		      families[family].help);
+
+      for ( idx = 0; idx < cs->size; idx++ )
+	{
+	  stat = &cs->slots[idx];
+
+	  if ( ! stat->hash )
+	    continue;
+
+	  metrics_labels (labels, sizeof (labels), "network", stat->net,
+			  "station", stat->sta, "location", stat->loc,
+			  "channel", stat->chan, NULL);
+
+	  switch ( family )
+	    {
+	    case 0:
+	      metrics_value (mf, families[family].name, labels, stat->latency);
+	      break;
+	    case 1:
+	      metrics_count (mf, families[family].name, labels, stat->records);
+	      break;
+	    case 2:
+	      metrics_value (mf, families[family].name, labels, stat->rate);
+	      break;
+	    case 3:
+	      metrics_count (mf, families[family].name, labels, stat->gaps);
+	      break;
+	    case 4:
+	      metrics_value (mf, families[family].name, labels,
+			     SL_NSTIME2EPOCH (stat->gaptime));
+	      break;
+	    case 5:
+	      metrics_count (mf, families[family].name, labels, stat->overlaps);
+	      break;
+	    case 6:
+	      metrics_value (mf, families[family].name, labels,
+			     SL_NSTIME2EPOCH (stat->lastsample));
+	      break;
+	    }
+	}
+    }
+}  /* End of cs_metrics() */
+
+
+/***************************************************************************
+ * cs_lookup:
+ *
+ * Find the entry of a channel, adding it if not found.  The table is
+ * doubled in size as needed to keep it at most half full.
+ *
+ * Returns the entry on success and NULL on allocation error.
+ ***************************************************************************/
+static ChanStat *
+cs_lookup (ChanStats *cs, const char *net, const char *sta,
+	   const char *loc, const char *chan)
+{
+  ChanStat *oldslots;
+  ChanStat *stat;
+  uint32_t oldsize;
+  uint32_t hash;
+  uint32_t idx;
+  uint32_t jdx;
+
+  hash = cs_hash (net, sta, loc, chan);
+
+  if ( cs->size )
+    {
+      idx = hash & (cs->size - 1);
+
+      while ( (stat = &cs->slots[idx])->hash )
+	{
+	  if ( stat->hash == hash &&
+	       ! strcmp (stat->chan, chan) && ! strcmp (stat->sta, sta) &&
+	       ! strcmp (stat->net, net) && ! strcmp (stat->loc, loc) )
+	    return stat;
+
+	  idx = (idx + 1) & (cs->size - 1);
+	}
+    }
+
+  /* Grow the table when it would be more than half full */
+  if ( (cs->count + 1) * 2 > cs->size )
+    {
+      oldslots = cs->slots;
+      oldsize  = cs->size;
+
+      cs->size = ( oldsize ) ? oldsize * 2 : 256;
+
+      if ( ! (cs->slots = (ChanStat *) calloc (cs->size, sizeof (ChanStat))) )
+	{
+	  sl_log (2, 0, "cannot allocate memory for channel statistics\n");
+	  cs->slots = oldslots;
+	  cs->size  = oldsize;
+	  return NULL;
+	}
+
+      for ( jdx = 0; jdx < oldsize; jdx++ )
+	{
+	  if ( ! oldslots[jdx].hash )
+	    continue;
+
+	  idx = oldslots[jdx].hash & (cs->size - 1);
+	  while ( cs->slots[idx].hash )
+	    idx = (idx + 1) & (cs->size - 1);
+
+	  cs->slots[idx] = oldslots[jdx];
+	}
+
+      free (oldslots);
+    }
+
+  idx = hash & (cs->size - 1);
+  while ( cs->slots[idx].hash )
+    idx = (idx + 1) & (cs->size - 1);
+
+  stat = &cs->slots[idx];
+  strcpy (stat->net, net);
+  strcpy (stat->sta, sta);
+  strcpy (stat->loc, loc);
+  strcpy (stat->chan, chan);
+  stat->hash = hash;
+  cs->count++;
+
+  return stat;
+}  /* End of cs_lookup() */
+
+
+/***************************************************************************
+ * cs_quantile:
+ *
+ * Estimate a quantile of the latency histogram by interpolating
+ * linearly within the bucket containing it.
+ *
+ * Returns the estimated latency in seconds, 0 if no records have been
+ * counted.
+ ***************************************************************************/
+static double
+cs_quantile (ChanStats *cs, double quantile)
+{
+  uint64_t total = 0;
+  double rank;
+  double cumulative = 0.0;
+  double lower;
+  int idx;
+
+  for ( idx = 0; idx <= CS_LATENCYBOUNDS; idx++ )
+    total += cs->latencycounts[idx];
+
+  if ( total == 0 )
+    return 0.0;
+
+  rank = quantile * total;
+
+  for ( idx = 0; idx < CS_LATENCYBOUNDS; idx++ )
+    {
+      if ( cumulative + cs->latencycounts[idx] >= rank && cs->latencycounts[idx] )
+	{
+	  lower = ( idx ) ? latencybounds[idx - 1] : 0.0;
+
+	  return lower + (latencybounds[idx] - lower) *
+	    (rank - cumulative) / cs->latencycounts[idx];
+	}
+
+      cumulative += cs->latencycounts[idx];
+    }
+
+  /* In the +Inf bucket, the largest bound is the best estimate */
+  return latencybounds[CS_LATENCYBOUNDS - 1];
+}  /* End of cs_quantile() */
+
+
+/***************************************************************************
+ * cs_hash:
+ *
+ * Calculate a 32-bit FNV-1a hash of channel codes, never 0 as that
+ * marks unused entries.
+ ***************************************************************************/
+static uint32_t
+cs_hash (const char *net, const char *sta, const char *loc, const char *chan)
+{
+  const char *codes[4];
+  const char *cptr;
+  uint32_t hash = 2166136261u;
+  int idx;
+
+  codes[0] = net;
+  codes[1] = sta;
+  codes[2] = loc;
+  codes[3] = chan;
+
+  for ( idx = 0; idx < 4; idx++ )
+    {
+      for ( cptr = codes[idx]; *cptr; cptr++ )
+	hash = (hash ^ (uint8_t) *cptr) * 16777619u;
+
+      hash = (hash ^ '_') * 16777619u;
+    }
+
+  return ( hash ) ? hash : 1;
+}  /* End of cs_hash() */
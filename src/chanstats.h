@@ -0,0 +1,53 @@
+
+#ifndef CHANSTATS_H
+#define CHANSTATS_H
+
+#include <stdint.h>
+#include <libslink.h>
+
+#include "metrics.h"
+
+/* Rate window for records per second (seconds) */
+#define CS_RATEWINDOW 60.0
+
+/* Latency histogram bucket bounds, 5 per decade from 10 us to 1000 s */
+#define CS_LATENCYBOUNDS 41
+
+/* Statistics of one channel, a fixed size table entry */
+typedef struct ChanStat_s
+{
+  char     net[SL_VIEW_CODESIZE];
+  char     sta[SL_VIEW_CODESIZE];
+  char     loc[SL_VIEW_CODESIZE];
+  char     chan[SL_VIEW_CODESIZE];
+  SLnstime lastsample;    /* Time of the last sample received */
+  SLnstime gaptime;       /* Total time of gaps */
+  double   latency;       /* Wall clock minus last sample time at arrival (seconds) */
+  double   windowstart;   /* Start of the current rate window */
+  double   rate;          /* Records per second in the last complete window */
+  uint64_t records;       /* Records received */
+  uint32_t windowcount;   /* Records received in the current rate window */
+  uint32_t gaps;          /* Gaps between consecutive records */
+  uint32_t overlaps;      /* Overlaps between consecutive records */
+  uint32_t hash;          /* Hash of the codes, 0 for unused entries */
+}
+ChanStat;
+
+/* Open addressing hash table of channel statistics */
+typedef struct ChanStats_s
+{
+  ChanStat *slots;
+  uint32_t  size;         /* Number of slots, a power of 2 */
+  uint32_t  count;        /* Number of channels */
+  uint64_t  latencycounts[CS_LATENCYBOUNDS + 1]; /* Latency histogram, last is +Inf */
+  double    latencysum;   /* Sum of all latencies */
+}
+ChanStats;
+
+extern ChanStats *cs_new (void);
+extern void cs_free (ChanStats *cs);
+extern int  cs_update (ChanStats *cs, const SLpacket *slpack, double now);
+extern void cs_dump (ChanStats *cs, double now);
+extern void cs_metrics (ChanStats *cs, MetricsFile *mf);
+
+#endif
@@ -37,7 +37,6 @@ static DataStreamGroup *ds_getstream (DataStream *datastream, int reclen,
 static int ds_openfile (DataStream *datastream, const char *filename);
 static int ds_closeidle (DataStream *datastream, int idletimeout);
 static void ds_shutdown (DataStream *datastream);
-static double sl_msr_lastsamptime (SLMSrecord *msr);
 static char sl_typecode (int type);
 
 
@@ -46,19 +45,20 @@ static char sl_typecode (int type);
  *
  * Save miniSEED records in a custom directory/file structure.  The
  * appropriate directories and files are created if nesecessary.  If
- * files already exist they are appended to.  If 'msr' is NULL then
+ * files already exist they are appended to.  If 'view' is NULL then
  * ds_shutdown() will be called to close all open files and free all
  * associated memory.
  *
  * Returns 0 on success, -1 on error.
  ***************************************************************************/
 extern int
-ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
+ds_streamproc (DataStream *datastream, const SLRecordView *view, long suffix)
 {
   DataStreamGroup *foundgroup = NULL;
   char *tptr;
   char tstr[20];
-  char net[3], sta[6], loc[3], chan[4];
+  char net[SL_VIEW_CODESIZE], sta[SL_VIEW_CODESIZE];
+  char loc[SL_VIEW_CODESIZE], chan[SL_VIEW_CODESIZE];
   char filename[MAX_FILENAME_LEN] = "";
   char definition[MAX_FILENAME_LEN] = "";
   char pathformat[MAX_FILENAME_LEN] = "";
@@ -72,11 +72,14 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
   int tdy;
   char *w, *p, def;
   double dsamprate = 0.0;
+  uint16_t year, day;
+  uint8_t hour, min, sec;
+  uint32_t nsec;
 
-  int reclen = SLRECSIZE;
+  int reclen;
 
   /* Special case for stream shutdown */
-  if ( ! msr )
+  if ( ! view )
     {
       sl_log (1, 2, "Closing archive for %s\n", datastream->path);
 
@@ -91,6 +94,17 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
       return -1;
     }
 
+  reclen = view->reclen;
+
+  if ( sl_view_nslc (view, net, sta, loc, chan) ||
+       sl_view_btime (view, &year, &day, &hour, &min, &sec, &nsec) )
+    {
+      sl_log (2, 0, "ds_streamproc(): cannot determine record source or time\n");
+      return -1;
+    }
+
+  SL_PROBE_START (expandstart);
+
   /* Create a copy of the specified path, it will be modified during parsing */
   snprintf (pathformat, sizeof(pathformat), "%s", datastream->path);
   pathformat[sizeof(pathformat)-1] = '\0';
@@ -138,7 +152,6 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 	  p = w + 1;
 	  break;
 	case 'n' :
-	  sl_strncpclean (net, msr->fsdh.network, 2);
 	  strncat (filename, net, (sizeof(filename) - fnlen));
 	  if ( def ) strncat (definition, net, (sizeof(definition) - fnlen));
 	  if ( nondefflags > 0 )
@@ -151,7 +164,6 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 	  p = w + 1;
 	  break;
 	case 's' :
-	  sl_strncpclean (sta, msr->fsdh.station, 5);
 	  strncat (filename, sta, (sizeof(filename) - fnlen));
 	  if ( def ) strncat (definition, sta, (sizeof(definition) - fnlen));
 	  if ( nondefflags > 0 )
@@ -164,7 +176,6 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 	  p = w + 1;
 	  break;
 	case 'l' :
-	  sl_strncpclean (loc, msr->fsdh.location, 2);
 	  strncat (filename, loc, (sizeof(filename) - fnlen));
 	  if ( def ) strncat (definition, loc, (sizeof(definition) - fnlen));
 	  if ( nondefflags > 0 )
@@ -177,7 +188,6 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 	  p = w + 1;
 	  break;
 	case 'c' :
-	  sl_strncpclean (chan, msr->fsdh.channel, 3);
 	  strncat (filename, chan, (sizeof(filename) - fnlen));
 	  if ( def ) strncat (definition, chan, (sizeof(definition) - fnlen));
 	  if ( nondefflags > 0 )
@@ -190,7 +200,7 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 	  p = w + 1;
 	  break;
 	case 'Y' :
-	  snprintf (tstr, sizeof(tstr), "%04d", (int) msr->fsdh.start_time.year);
+	  snprintf (tstr, sizeof(tstr), "%04d", (int) year);
 	  strncat (filename, tstr, (sizeof(filename) - fnlen));
 	  if ( def ) strncat (definition, tstr, (sizeof(definition) - fnlen));
 	  if ( nondefflags > 0 )
@@ -203,7 +213,7 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 	  p = w + 1;
 	  break;
 	case 'y' :
-	  tdy = (int) msr->fsdh.start_time.year;
+	  tdy = (int) year;
 	  while ( tdy > 100 )
 	    {
 	      tdy -= 100;
@@ -221,7 +231,7 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 	  p = w + 1;
 	  break;
 	case 'j' :
-	  snprintf (tstr, sizeof(tstr), "%03d", (int) msr->fsdh.start_time.day);
+	  snprintf (tstr, sizeof(tstr), "%03d", (int) day);
 	  strncat (filename, tstr, (sizeof(filename) - fnlen));
 	  if ( def ) strncat (definition, tstr, (sizeof(definition) - fnlen));
 	  if ( nondefflags > 0 )
@@ -234,7 +244,7 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 	  p = w + 1;
 	  break;
 	case 'H' :
-	  snprintf (tstr, sizeof(tstr), "%02d", (int) msr->fsdh.start_time.hour);
+	  snprintf (tstr, sizeof(tstr), "%02d", (int) hour);
 	  strncat (filename, tstr, (sizeof(filename) - fnlen));
 	  if ( def ) strncat (definition, tstr, (sizeof(definition) - fnlen));
 	  if ( nondefflags > 0 )
@@ -247,7 +257,7 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 	  p = w + 1;
 	  break;
 	case 'M' :
-	  snprintf (tstr, sizeof(tstr), "%02d", (int) msr->fsdh.start_time.min);
+	  snprintf (tstr, sizeof(tstr), "%02d", (int) min);
 	  strncat (filename, tstr, (sizeof(filename) - fnlen));
 	  if ( def ) strncat (definition, tstr, (sizeof(definition) - fnlen));
 	  if ( nondefflags > 0 )
@@ -260,7 +270,7 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 	  p = w + 1;
 	  break;
 	case 'S' :
-	  snprintf (tstr, sizeof(tstr), "%02d", (int) msr->fsdh.start_time.sec);
+	  snprintf (tstr, sizeof(tstr), "%02d", (int) sec);
 	  strncat (filename, tstr, (sizeof(filename) - fnlen));
 	  if ( def ) strncat (definition, tstr, (sizeof(definition) - fnlen));
 	  if ( nondefflags > 0 )
@@ -273,7 +283,7 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 	  p = w + 1;
 	  break;
 	case 'F' :
-	  snprintf (tstr, sizeof(tstr), "%04d", (int) msr->fsdh.start_time.fract);
+	  snprintf (tstr, sizeof(tstr), "%04d", (int) (nsec / 100000));
 	  strncat (filename, tstr, (sizeof(filename) - fnlen));
 	  if ( def ) strncat (definition, tstr, (sizeof(definition) - fnlen));
 	  if ( nondefflags > 0 )
@@ -286,7 +296,7 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 	  p = w + 1;
 	  break;
 	case 'q' :
-	  snprintf (tstr, sizeof(tstr), "%c", msr->fsdh.dhq_indicator);
+	  snprintf (tstr, sizeof(tstr), "%c", sl_view_quality (view));
 	  strncat (filename, tstr, (sizeof(filename) - fnlen));
 	  if ( def ) strncat (definition, tstr, (sizeof(definition) - fnlen));
 	  if ( nondefflags > 0 )
@@ -299,7 +309,7 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 	  p = w + 1;
 	  break;
 	case 'L' :
-	  snprintf (tstr, sizeof(tstr), "%d", SLRECSIZE);
+	  snprintf (tstr, sizeof(tstr), "%d", reclen);
 	  strncat (filename, tstr, (sizeof(filename) - fnlen));
 	  if ( def ) strncat (definition, tstr, (sizeof(definition) - fnlen));
 	  if ( nondefflags > 0 )
@@ -312,7 +322,7 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 	  p = w + 1;
 	  break;
 	case 'r' :
-	  sl_msr_dsamprate (msr, &dsamprate);
+	  dsamprate = sl_view_samprate (view);
 	  snprintf (tstr, sizeof(tstr), "%ld", (long int) (dsamprate+0.5));
 	  strncat (filename, tstr, (sizeof(filename) - fnlen));
 	  if ( def ) strncat (definition, tstr, (sizeof(definition) - fnlen));
@@ -326,7 +336,7 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 	  p = w + 1;
 	  break;
 	case 'R' :
-	  sl_msr_dsamprate (msr, &dsamprate);
+	  dsamprate = sl_view_samprate (view);
 	  snprintf (tstr, sizeof(tstr), "%.6f", dsamprate);
 	  strncat (filename, tstr, (sizeof(filename) - fnlen));
 	  if ( def ) strncat (definition, tstr, (sizeof(definition) - fnlen));
@@ -386,9 +396,13 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
   *(filename + sizeof(filename) - 1) = '\0';
   *(definition + sizeof(definition) - 1) = '\0';
 
+  SL_PROBE_END (expandstart, "path_expand");
+
   /* Check for previously used stream entry, otherwise create it */
+  SL_PROBE_START (getstreamstart);
   foundgroup = ds_getstream (datastream, reclen, definition, filename,
 			     nondefflags, globmatch);
+  SL_PROBE_END (getstreamstart, "ds_getstream");
 
   if ( foundgroup != NULL )
     {
@@ -400,15 +414,15 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 	   datastream->futureinitflag &&
 	   foundgroup->lastsample < 0 )
 	{
-	  int overlap = (int) ((-1.0 * foundgroup->lastsample) - sl_msr_depochstime(msr));
+	  SLnstime overlap = (-1 * foundgroup->lastsample) - sl_view_nstime (view);
 
-	  if ( overlap > datastream->futureinit )
+	  if ( overlap > (SLnstime) datastream->futureinit * SL_NSTMODULUS )
 	    {
 	      if ( foundgroup->futureinitprint )
 		{
 		  sl_log (2, 0,
 			  "%d sec. overlap of existing archive data in %s, skipping\n",
-			  overlap, foundgroup->filename);
+			  (int) (overlap / SL_NSTMODULUS), foundgroup->filename);
 		  foundgroup->futureinitprint = 0;  /* Suppress further messages */
 		}
 
@@ -423,15 +437,15 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 	   datastream->futurecontflag &&
 	   foundgroup->lastsample > 0 )
 	{
-	  int overlap = (int) (foundgroup->lastsample - sl_msr_depochstime(msr));
+	  SLnstime overlap = foundgroup->lastsample - sl_view_nstime (view);
 
-          if ( overlap > datastream->futurecont )
+          if ( overlap > (SLnstime) datastream->futurecont * SL_NSTMODULUS )
 	    {
 	      if ( foundgroup->futurecontprint )
 		{
 		  sl_log (2, 0,
 			  "%d sec. overlap of continuous data for %s, skipping\n",
-			  overlap, foundgroup->filename);
+			  (int) (overlap / SL_NSTMODULUS), foundgroup->filename);
 		  foundgroup->futurecontprint = 0;  /* Suppress further messages */
 		}
 
@@ -445,11 +459,12 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
       sl_log (1, 3, "Writing data to data stream file %s\n", foundgroup->filename);
 
       /* Try up to 10 times to write the data out, could be interrupted by signal */
+      SL_PROBE_START (writestart);
       writebytes = 0;
       writeloops = 0;
       while ( writeloops < 10 )
         {
-	  rv = write (foundgroup->filed, msr->msrecord+writebytes, reclen-writebytes);
+	  rv = write (foundgroup->filed, view->record+writebytes, reclen-writebytes);
 
 	  if ( rv > 0 )
 	    writebytes += rv;
@@ -464,6 +479,7 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 		{
 		  sl_log (2, 1, "ds_streamproc: failed to write record: %s (%s)\n",
 			  strerror(errno), foundgroup->filename);
+		  datastream->writeerrors++;
 		  return -1;
 		}
 	      else
@@ -475,28 +491,65 @@ ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix)
 
 	  writeloops++;
         }
+      SL_PROBE_END (writestart, "write");
 
       if ( writeloops >= 10 )
 	{
 	  sl_log (2, 0, "ds_streamproc: Tried 10 times to write record, interrupted each time\n");
+	  datastream->writeerrors++;
 	  return -1;
 	}
 
       /* Update mod time for this entry */
       foundgroup->modtime = time (NULL);
+      datastream->records++;
 
       /* Update time of last sample if future checking */
       if ( datastream->packettype == SLDATA &&
 	   (datastream->futureinitflag || datastream->futurecontflag) )
-	foundgroup->lastsample = sl_msr_lastsamptime (msr);
+	{
+	  foundgroup->lastsample = sl_view_lastsamptime (view);
+
+	  if ( foundgroup->lastsample == SL_NSTERROR )
+	    foundgroup->lastsample = 0;
+	}
 
       return 0;
     }
 
+  datastream->writeerrors++;
   return -1;
 }  /* End of ds_streamproc() */
 
 
+/***************************************************************************
+ * ds_sync:
+ *
+ * Flush the data written to all open stream files to storage.  Files
+ * closed as idle or at shutdown are synced before closing if the
+ * syncflag of the DataStream is set.
+ *
+ * Returns 0 on success, -1 if any file could not be synced.
+ ***************************************************************************/
+extern int
+ds_sync (DataStream *datastream)
+{
+  DataStreamGroup *curgroup;
+  int retval = 0;
+
+  for ( curgroup = datastream->grouproot; curgroup != NULL; curgroup = curgroup->next )
+    {
+      if ( curgroup->filed && fsync (curgroup->filed) )
+	{
+	  sl_log (2, 0, "ds_sync(), syncing %s, %s\n", curgroup->filename, strerror (errno));
+	  retval = -1;
+	}
+    }
+
+  return retval;
+}  /* End of ds_sync() */
+
+
 /***************************************************************************
  * ds_getstream:
  *
@@ -526,6 +579,7 @@ ds_getstream (DataStream *datastream, int reclen,
   curtime = time (NULL);
 
   /* Traverse the stream chain looking for matching streams */
+  SL_PROBE_START (lookupstart);
   while (searchgroup != NULL)
     {
       DataStreamGroup *nextgroup  = (DataStreamGroup *) searchgroup->next;
@@ -542,6 +596,7 @@ ds_getstream (DataStream *datastream, int reclen,
       prevgroup = searchgroup;
       searchgroup = nextgroup;
     }
+  SL_PROBE_END (lookupstart, "stream_lookup");
 
   /* If no matching stream entry was found but the format included
      non-defining flags, try to use globmatch to find a matching file
@@ -595,7 +650,7 @@ ds_getstream (DataStream *datastream, int reclen,
       foundgroup->defkey = strdup (defkey);
       foundgroup->filed = 0;
       foundgroup->modtime = curtime;
-      foundgroup->lastsample = 0.0;
+      foundgroup->lastsample = 0;
       foundgroup->futurecontprint = datastream->futurecontflag;
       foundgroup->futureinitprint = datastream->futureinitflag;
       strncpy (foundgroup->filename, filename, sizeof(foundgroup->filename));
@@ -625,7 +680,9 @@ ds_getstream (DataStream *datastream, int reclen,
     }
 
   /* Close idle stream files */
+  SL_PROBE_START (idlestart);
   ds_closeidle (datastream, datastream->idletimeout);
+  SL_PROBE_END (idlestart, "ds_closeidle");
 
   /* If no file is open, well, open it */
   if ( foundgroup->filed == 0 )
@@ -634,7 +691,11 @@ ds_getstream (DataStream *datastream, int reclen,
 
       sl_log (1, 2, "Opening data stream file %s\n", filename);
 
-      if ( (foundgroup->filed = ds_openfile (datastream, filename)) == -1 )
+      SL_PROBE_START (openstart);
+      foundgroup->filed = ds_openfile (datastream, filename);
+      SL_PROBE_END (openstart, "ds_openfile");
+
+      if ( foundgroup->filed == -1 )
 	{
 	  /* Do not complain if the call was interrupted (signals are used for shutdown) */
 	  if ( errno == EINTR )
@@ -662,7 +723,7 @@ ds_getstream (DataStream *datastream, int reclen,
 	{
 	  if ( filepos >= reclen )
 	    {
-	      SLMSrecord *lmsr = NULL;
+	      SLRecordView lview;
 	      char *lrecord;
 
 	      sl_log (1, 2, "Reading last record in existing file\n");
@@ -683,18 +744,18 @@ ds_getstream (DataStream *datastream, int reclen,
 		  return NULL;
 		}
 
-	      if ( sl_msr_parse (NULL, lrecord, &lmsr, 0, 0) != NULL )
+	      if ( sl_view_init (&lview, lrecord, reclen) == 0 &&
+		   sl_view_lastsamptime (&lview) != SL_NSTERROR )
 		{
 		  /* A negative last sample time means it came from an existing file */
-		  foundgroup->lastsample = (-1 * sl_msr_lastsamptime (lmsr));
+		  foundgroup->lastsample = (-1 * sl_view_lastsamptime (&lview));
 		}
 	      else
 		{
 		  /* Zero means last sample time is unknown, disabling checks */
-		  foundgroup->lastsample = 0.0;
+		  foundgroup->lastsample = 0;
 		}
 
-	      sl_msr_free (&lmsr);
 	      free (lrecord);
 	    }
 	}
@@ -792,6 +853,7 @@ ds_openfile (DataStream *datastream, const char *filename)
     }
 
   /* Parse filename into path components */
+  SL_PROBE_START (mkdirstart);
   sl_strparse (filename, "/", &dplist);
   dpptr = dplist;
 
@@ -839,9 +901,14 @@ ds_openfile (DataStream *datastream, const char *filename)
 
   /* Free path component list */
   sl_strparse (NULL, NULL, &dplist);
+  SL_PROBE_END (mkdirstart, "mkdir");
 
   /* Open file */
-  if ( (oret = open (filename, flags, mode)) != -1 )
+  SL_PROBE_START (openstart);
+  oret = open (filename, flags, mode);
+  SL_PROBE_END (openstart, "open");
+
+  if ( oret != -1 )
     {
       ds_openfilecount++;
     }
@@ -889,7 +956,10 @@ ds_closeidle (DataStream *datastream, int idletimeout)
 	      datastream->grouproot = searchgroup->next;
 	    }
 
-	  /* Close the associated file */
+	  /* Close the associated file, synced first if requested */
+	  if ( datastream->syncflag && fsync (searchgroup->filed) )
+	    sl_log (2, 0, "ds_closeidle(), syncing data stream file, %s\n", strerror (errno));
+
 	  if ( close (searchgroup->filed) )
 	    sl_log (2, 0, "ds_closeidle(), closing data stream file, %s\n", strerror (errno));
 	  else
@@ -934,40 +1004,24 @@ ds_shutdown (DataStream *datastream)
       sl_log (1, 3, "Shutting down stream with key: %s\n", prevgroup->defkey);
 
       if ( prevgroup->filed )
-	if ( close (prevgroup->filed) )
-	  sl_log (2, 0, "ds_shutdown(), closing data stream file, %s\n",
-		  strerror (errno));
+	{
+	  if ( datastream->syncflag && fsync (prevgroup->filed) )
+	    sl_log (2, 0, "ds_shutdown(), syncing data stream file, %s\n",
+		    strerror (errno));
+
+	  if ( close (prevgroup->filed) )
+	    sl_log (2, 0, "ds_shutdown(), closing data stream file, %s\n",
+		    strerror (errno));
+	  else
+	    ds_openfilecount--;
+	}
 
       free (prevgroup->defkey);
       free (prevgroup);
     }
-}  /* End of ds_shutdown() */
-
 
-/***************************************************************************
- * sl_msr_lastsamptime:
- *
- * Calculate the time of the last sample in the record; this is the actual
- * last sample time and *not* the time "covered" by the last sample.
- *
- * Returns the time of the last sample as a double precision epoch time.
- ***************************************************************************/
-double
-sl_msr_lastsamptime (SLMSrecord *msr)
-{
-  double startepoch;
-  double dsamprate;
-  double span = 0.0;
-
-  sl_msr_dsamprate (msr, &dsamprate);
-
-  if ( dsamprate )
-    span = (double) (msr->fsdh.num_samples - 1 ) * (1.0 / dsamprate);
-
-  startepoch = sl_msr_depochstime(msr);
-
-  return (startepoch + span);
-}  /* End of sl_msr_lastsamptime() */
+  datastream->grouproot = NULL;
+}  /* End of ds_shutdown() */
 
 
 /***************************************************************************
@@ -22,7 +22,7 @@ typedef struct DataStreamGroup_s
   char   *defkey;
   int     filed;
   time_t  modtime;
-  double  lastsample;
+  SLnstime lastsample;
   char    futurecontprint;
   char    futureinitprint;
   char    filename[MAX_FILENAME_LEN];
@@ -39,13 +39,18 @@ typedef struct DataStream_s
   int     futurecont;
   char    futureinitflag;
   int     futureinit;
+  char    syncflag;
+  uint64_t records;
+  uint64_t writeerrors;
   struct  DataStreamGroup_s *grouproot;
 }
 DataStream;
 
-/* Global maximum number of open files */
+/* Global maximum number of open files and number of open files */
 extern int ds_maxopenfiles;
+extern int ds_openfilecount;
 
-extern int ds_streamproc (DataStream *datastream, SLMSrecord *msr, long suffix);
+extern int ds_streamproc (DataStream *datastream, const SLRecordView *view, long suffix);
+extern int ds_sync (DataStream *datastream);
 
 #endif
@@ -0,0 +1,201 @@
+/***************************************************************************
+ * metrics.c
+ * Routines to write metrics in the Prometheus text exposition format.
+ *
+ * The metrics are written to a text file, for example for the
+ * textfile collector of the Prometheus node exporter.  Each update is
+ * written to a temporary file that is renamed over the metrics file,
+ * so a scrape never reads a partial file.
+ *
+ * The values themselves are plain counters kept by the caller, in the
+ * collection thread, the routines here only format them.
+ ***************************************************************************/
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include <libslink.h>
+
+#include "metrics.h"
+
+
+/***************************************************************************
+ * metrics_open:
+ *
+ * Start writing a new version of the metrics file 'filename'.  The
+ * metrics are written to a temporary file, the file name with ".tmp"
+ * appended, until metrics_close() is called.
+ *
+ * Returns a MetricsFile on success and NULL on error.
+ ***************************************************************************/
+MetricsFile *
+metrics_open (const char *filename)
+{
+  MetricsFile *mf;
+  size_t length = strlen (filename) + 5;
+
+  if ( ! (mf = (MetricsFile *) calloc (1, sizeof (MetricsFile))) ||
+       ! (mf->tempname = (char *) malloc (length)) )
+    {
+      sl_log (2, 0, "cannot allocate memory for metrics file\n");
+      free (mf);
+      return NULL;
+    }
+
+  mf->filename = (char *) filename;
+  snprintf (mf->tempname, length, "%s.tmp", filename);
+
+  if ( ! (mf->fp = fopen (mf->tempname, "w")) )
+    {
+      sl_log (2, 0, "cannot open metrics file %s: %s\n", mf->tempname, strerror (errno));
+      free (mf->tempname);
+      free (mf);
+      return NULL;
+    }
+
+  return mf;
+}  /* End of metrics_open() */
+
+
+/***************************************************************************
+ * metrics_close:
+ *
+ * Finish writing the metrics file and replace the previous version.
+ * The MetricsFile is freed.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+metrics_close (MetricsFile *mf)
+{
+  int retval = 0;
+
+  if ( ! mf )
+    return -1;
+
+  if ( ferror (mf->fp) | fclose (mf->fp) )
+    {
+      sl_log (2, 0, "cannot write metrics file %s: %s\n", mf->tempname, strerror (errno));
+      remove (mf->tempname);
+      retval = -1;
+    }
+  else if ( rename (mf->tempname, mf->filename) )
+    {
+      sl_log (2, 0, "cannot rename metrics file %s: %s\n", mf->tempname, strerror (errno));
+      remove (mf->tempname);
+      retval = -1;
+    }
+
+  free (mf->tempname);
+  free (mf);
+
+  return retval;
+}  /* End of metrics_close() */
+
+
+/***************************************************************************
+ * metrics_family:
+ *
+ * Write the HELP and TYPE lines of a metric, must precede all of its
+ * values.  The 'type' is "counter" or "gauge".
+ ***************************************************************************/
+void
+metrics_family (MetricsFile *mf, const char *name, const char *type, const char *help)
+{
+  fprintf (mf->fp, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}  /* End of metrics_family() */
+
+
+/***************************************************************************
+ * metrics_value:
+ *
+ * Write a value of a metric.  The 'labels' are formatted by
+ * metrics_labels(), or NULL for none.
+ ***************************************************************************/
+void
+metrics_value (MetricsFile *mf, const char *name, const char *labels, double value)
+{
+  fprintf (mf->fp, "%s%s %.15g\n", name, (labels) ? labels : "", value);
+}  /* End of metrics_value() */
+
+
+/***************************************************************************
+ * metrics_count:
+ *
+ * Write an integer value of a metric, counters are written exactly.
+ ***************************************************************************/
+void
+metrics_count (MetricsFile *mf, const char *name, const char *labels, uint64_t value)
+{
+  fprintf (mf->fp, "%s%s %" PRIu64 "\n", name, (labels) ? labels : "", value);
+}  /* End of metrics_count() */
+
+
+/***************************************************************************
+ * metrics_labels:
+ *
+ * Format a label set, '{name="value",...}', into 'labels' from pairs of
+ * label name and value arguments terminated by NULL.  Backslashes,
+ * double quotes and new lines in the values are escaped.  Label sets
+ * longer than 'size' are truncated at a label boundary.
+ *
+ * Returns 'labels'.
+ ***************************************************************************/
+char *
+metrics_labels (char *labels, int size, ...)
+{
+  va_list argp;
+  const char *name;
+  const char *value;
+  int length = 0;
+  int mark;
+
+  va_start (argp, size);
+
+  labels[length++] = '{';
+
+  while ( (name = va_arg (argp, const char *)) != NULL )
+    {
+      value = va_arg (argp, const char *);
+      mark = length;
+
+      length += snprintf (labels + length, size - length, "%s%s=\"",
+			  (mark > 1) ? "," : "", name);
+
+      for ( ; value && *value && length < size - 3; value++ )
+	{
+	  if ( *value == '\\' || *value == '"' )
+	    labels[length++] = '\\';
+
+	  if ( *value == '\n' )
+	    {
+	      labels[length++] = '\\';
+	      labels[length++] = 'n';
+	    }
+	  else
+	    labels[length++] = *value;
+	}
+
+      if ( length >= size - 3 )
+	{
+	  length = mark;
+	  break;
+	}
+
+      labels[length++] = '"';
+    }
+
+  va_end (argp);
+
+  if ( length == 1 )
+    length = 0;
+  else
+    labels[length++] = '}';
+
+  labels[length] = '\0';
+
+  return labels;
+}  /* End of metrics_labels() */
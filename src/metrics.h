@@ -0,0 +1,30 @@
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Maximum length of a formatted label set */
+#define METRICS_LABELLEN 256
+
+/* A metrics file being written, see metrics_open() */
+typedef struct MetricsFile_s
+{
+  FILE   *fp;
+  char   *filename;
+  char   *tempname;
+}
+MetricsFile;
+
+extern MetricsFile *metrics_open (const char *filename);
+extern int  metrics_close (MetricsFile *mf);
+extern void metrics_family (MetricsFile *mf, const char *name,
+			    const char *type, const char *help);
+extern void metrics_value (MetricsFile *mf, const char *name,
+			   const char *labels, double value);
+extern void metrics_count (MetricsFile *mf, const char *name,
+			   const char *labels, uint64_t value);
+extern char *metrics_labels (char *labels, int size, ...);
+
+#endif
@@ -14,21 +14,45 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <signal.h>
 #include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/select.h>
 
 #include <libslink.h>
 
 #include "dsarchive.h"
+#include "metrics.h"
+#include "chanstats.h"
 
 #define PACKAGE   "slarchive"
 #define VERSION   "3.2"
 
-static void packet_handler (char *msrecord, int packet_type, int seqnum);
+/* Response timeout (seconds) for parallel connections, negotiation
+ * blocks the other connections for at most this long per command */
+#define NCRESPTIMEOUT 5
+
+static int  packet_handler (const SLpacket *slpack);
+static int  collect (SLpacket **slpack);
+static int  splitstreams (int count);
+static void syncstate (void);
+static void commitstate (void);
+static void savestate (void);
+static void writemetrics (void);
+static int  startcheckpoint (void);
+static int  checkpoint (void);
+static void stopcheckpoint (void);
+static void *checkpointer (void *arg);
 static int  parameter_proc (int argcount, char **argvec);
 static char *getoptval (int argcount, char **argvec, int argopt);
 static int  addarchive(const char *path, const char *layout);
 static void term_handler (int sig);
+static void dump_handler (int sig);
+#ifdef SL_PROBES
+static void reset_handler (int sig);
+#endif
 static void print_timelog (const char *msg);
 static void usage (int level);
 
@@ -42,18 +66,63 @@ DSArchive;
 static short int verbose  = 0;   /* flag to control general verbosity */
 static short int ppackets = 0;   /* flag to control printing of data packets */
 static int stateint       = 0;   /* packet interval to save statefile */
+static int stateperiod    = 0;   /* time interval to save statefile (seconds) */
 static char *statefile    = 0;	 /* state file for saving/restoring stream states */
+static char *journalfile  = 0;	 /* binary state journal, updated for every packet */
+static int journalint     = 1;   /* interval to sync the state journal (seconds) */
+static int durable        = 0;   /* save state of archived data only, 2: synced data */
+static int connections    = 1;   /* number of parallel connections to the server */
+static int crccheck       = 0;   /* verify CRC of miniSEED 3 records */
+static char *crcfile      = 0;   /* file to quarantine records failing the CRC check */
+static FILE *crcfp        = 0;
 
 static SLCD *slconn;	         /* connection parameters */
+static SLCD **slconns;           /* parallel connections, streams split from slconn */
+static SLCD *lastconn;           /* connection that returned the last packet */
 static DSArchive *dsarchive;
 
+/* Background state checkpointing, see startcheckpoint() */
+static pthread_t statethread;
+static pthread_mutex_t statelock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t statecond  = PTHREAD_COND_INITIALIZER;
+static SLCD *statesnap    = 0;   /* snapshot of the stream states to save */
+static int statepending   = 0;   /* snapshot is waiting to be saved */
+static int stateshutdown  = 0;   /* checkpoint thread should exit */
+static double statesnaptime = 0.0;  /* time the pending snapshot was taken */
+static double statesavetime = 0.0;  /* snapshot time of the last saved checkpoint */
+static double statesavedur  = 0.0;  /* time needed to save the last checkpoint */
+
+/* Metrics, counters are only updated and read by the main thread */
+static char *metricsfile  = 0;   /* Prometheus text format metrics file */
+static int metricsint     = 15;  /* interval to write the metrics file (seconds) */
+static uint64_t packetcount[SLKEEP + 1]; /* packets received by type */
+static uint64_t packetbytes[SLKEEP + 1]; /* record bytes received by type */
+static double savedtime   = 0.0; /* snapshot time of the last saved state */
+static double saveddur    = 0.0; /* time needed to save the last state */
+
+/* Per-channel latency and continuity statistics, see chanstats.c */
+static ChanStats *chanstats = 0;
+static volatile sig_atomic_t dumpstats = 0; /* log statistics, set by SIGUSR1 */
+#ifdef SL_PROBES
+static volatile sig_atomic_t resetprobes = 0; /* reset timing probes, set by SIGUSR2 */
+#endif
+
+/* Packet type names, dependent on the packet type values in libslink.h */
+static const char *typenames[] = { "Data", "Detection", "Calibration", "Timing",
+				   "Message", "General", "Request", "Info",
+				   "Info (terminated)", "KeepAlive" };
+
 int
 main (int argc, char **argv)
 {
   SLpacket *slpack;
-  int seqnum;
-  int ptype;
   int packetcnt = 0;
+  int collected;
+  int retval;
+  time_t journaltime = 0;
+  time_t metricstime = 0;
+  time_t statetime = 0;
+  time_t curtime = 0;
 
   /* Signal handling, use POSIX calls with standardized semantics */
   struct sigaction sa;
@@ -66,6 +135,14 @@ main (int argc, char **argv)
   sigaction (SIGQUIT, &sa, NULL);
   sigaction (SIGTERM, &sa, NULL);
 
+  sa.sa_handler = dump_handler;
+  sigaction (SIGUSR1, &sa, NULL);
+
+#ifdef SL_PROBES
+  sa.sa_handler = reset_handler;
+  sigaction (SIGUSR2, &sa, NULL);
+#endif
+
   sa.sa_handler = SIG_IGN;
   sigaction (SIGHUP, &sa, NULL);
   sigaction (SIGPIPE, &sa, NULL);
@@ -83,26 +160,114 @@ main (int argc, char **argv)
       return -1;
     }
 
-  /* Loop with the connection manager */
-  while ( sl_collect (slconn, &slpack) )
+  /* Split the stream list over parallel connections if requested */
+  if ( connections > 1 && splitstreams (connections) < 0 )
     {
-      ptype  = sl_packettype (slpack);
-      seqnum = sl_sequence (slpack);
+      sl_log (2, 0, "cannot split streams over %d connections\n", connections);
+      return -1;
+    }
 
-      packet_handler (slpack->msrecord, ptype, seqnum);
+  /* Start the background state checkpointing if requested */
+  if ( stateperiod && startcheckpoint () < 0 )
+    {
+      sl_log (2, 0, "cannot start state checkpointing\n");
+      return -1;
+    }
+
+  /* Collect without a sleeping reconnect delay, collect() waits */
+  if ( ! slconns )
+    slconn->netdly_nowait = 1;
 
-      if ( statefile && stateint )
+  /* Loop with the connection manager, collect() also returns without
+     a packet periodically so that the timed tasks below run when no
+     data is arriving */
+  while ( (collected = collect (&slpack)) != SLTERMINATE )
+    {
+      if ( collected == SLPACKET )
 	{
-	  if ( ++packetcnt >= stateint )
+	  SL_PROBE_START (handlerstart);
+	  retval = packet_handler (slpack);
+	  SL_PROBE_END (handlerstart, "packet_handler");
+
+	  if ( slpack->packettype >= 0 && slpack->packettype <= SLKEEP )
 	    {
-	      sl_savestate (slconn, statefile);
-	      packetcnt = 0;
+	      packetcount[slpack->packettype]++;
+	      packetbytes[slpack->packettype] += slpack->reclen;
 	    }
+
+	  if ( chanstats && slpack->packettype == SLDATA )
+	    cs_update (chanstats, slpack, sl_dtime ());
+
+	  /* Acknowledge the packet, only archived packets advance durable state */
+	  if ( durable )
+	    sl_ackpacket (lastconn, slpack, (retval == 0));
+
+	  if ( statefile && stateint )
+	    {
+	      if ( ++packetcnt >= stateint )
+		{
+		  savestate ();
+		  packetcnt = 0;
+		}
+	    }
+	}
+
+      if ( dumpstats )
+	{
+	  if ( chanstats )
+	    cs_dump (chanstats, sl_dtime ());
+
+	  SL_PROBE_DUMP (NULL);
+
+	  dumpstats = 0;
+	}
+
+#ifdef SL_PROBES
+      if ( resetprobes )
+	{
+	  sl_log (1, 0, "Resetting timing probes\n");
+	  sl_probe_reset ();
+	  resetprobes = 0;
+	}
+#endif
+
+      if ( stateperiod || journalfile || metricsfile )
+	curtime = time (NULL);
+
+      /* Hand a snapshot to the checkpoint thread, retried on the next
+	 pass if the previous snapshot is still being saved */
+      if ( stateperiod && curtime >= statetime )
+	{
+	  if ( checkpoint () == 0 )
+	    statetime = curtime + stateperiod;
+	}
+
+      if ( journalfile && curtime >= journaltime )
+	{
+	  if ( durable )
+	    commitstate ();
+
+	  sl_syncjournal (slconn);
+	  journaltime = curtime + journalint;
+	}
+
+      if ( metricsfile && curtime >= metricstime )
+	{
+	  writemetrics ();
+	  metricstime = curtime + metricsint;
 	}
     }
 
   /* Do all the necessary cleanup and exit */
-  if (slconn->link != -1)
+  if ( slconns )
+    {
+      int idx;
+
+      for ( idx = 0; idx < connections; idx++ )
+	if (slconns[idx]->link != -1)
+	  sl_disconnect (slconns[idx]);
+    }
+  else if (slconn->link != -1)
     sl_disconnect (slconn);
 
   if (dsarchive) {
@@ -114,21 +279,661 @@ main (int argc, char **argv)
     }
   }
 
+  if ( stateperiod )
+    stopcheckpoint ();
+
   if (statefile)
-    sl_savestate (slconn, statefile);
+    savestate ();
+
+  if (journalfile)
+    {
+      if ( durable )
+	{
+	  commitstate ();
+	  sl_syncjournal (slconn);
+	}
+
+      sl_closejournal (slconn);
+    }
+
+  if (metricsfile)
+    writemetrics ();
+
+  if (chanstats)
+    cs_free (chanstats);
+
+  if (crcfp)
+    fclose (crcfp);
 
   return 0;
 }  /* End of main() */
 
 
+/***************************************************************************
+ * collect:
+ *
+ * Return the next packet from the connection(s).  Each connection is
+ * polled in turn with sl_collect_nb() and, when none has a packet
+ * ready, select() is used to wait up to 0.1 seconds for data on any of
+ * them before returning without a packet.  A replay file is read with
+ * sl_collect(), which paces the packets and never waits on a socket.
+ *
+ * Returns SLPACKET and sets slpack when a packet was received,
+ * SLNOPACKET when no packet is ready, or SLTERMINATE when all
+ * connections are terminated.
+ ***************************************************************************/
+static int
+collect (SLpacket **slpack)
+{
+  static int nextconn = 0;
+  static char *done = NULL;
+  SLCD **conns = (slconns) ? slconns : &slconn;
+  int count = (slconns) ? connections : 1;
+  struct timeval tv;
+  fd_set readset;
+  fd_set writeset;
+  SOCKET maxfd;
+  int active;
+  int idx;
+  int polled;
+  int retval;
+
+  if ( slconn->replayfile )
+    {
+      lastconn = slconn;
+      return sl_collect (slconn, slpack);
+    }
+
+  if ( ! done && ! (done = (char *) calloc (count, 1)) )
+    {
+      sl_log (2, 0, "cannot allocate memory for connection flags\n");
+      return SLTERMINATE;
+    }
+
+  /* Poll each connection once, starting after the last to return a
+     packet, until the tick passes without a socket becoming ready */
+  for (;;)
+    {
+      active = 0;
+
+      for ( polled = 0; polled < count; polled++ )
+	{
+	  idx = nextconn;
+	  nextconn = (nextconn + 1) % count;
+
+	  if ( done[idx] )
+	    continue;
+
+	  retval = sl_collect_nb (conns[idx], slpack);
+
+	  if ( retval == SLPACKET )
+	    {
+	      lastconn = conns[idx];
+	      return SLPACKET;
+	    }
+
+	  if ( retval == SLTERMINATE )
+	    {
+	      if ( slconns )
+		sl_log (1, 1, "connection %d of %d terminated\n", idx + 1, count);
+	      done[idx] = 1;
+	      continue;
+	    }
+
+	  active++;
+	}
+
+      if ( ! active )
+	return SLTERMINATE;
+
+      /* Wait for data on any connection that is up or for a connection
+	 in progress to complete, without sockets this is a short sleep */
+      FD_ZERO (&readset);
+      FD_ZERO (&writeset);
+      maxfd = -1;
+      for ( idx = 0; idx < count; idx++ )
+	{
+	  if ( done[idx] || conns[idx]->link == -1 )
+	    continue;
+
+	  if ( conns[idx]->stat->sl_state == SL_DATA )
+	    FD_SET (conns[idx]->link, &readset);
+	  else if ( conns[idx]->stat->sl_state == SL_CONNECTING )
+	    FD_SET (conns[idx]->link, &writeset);
+	  else
+	    continue;
+
+	  if ( conns[idx]->link > maxfd )
+	    maxfd = conns[idx]->link;
+	}
+
+      tv.tv_sec  = 0;
+      tv.tv_usec = 100000;
+
+      /* Poll again right away when a socket is ready */
+      if ( select (maxfd + 1, &readset, &writeset, NULL, &tv) <= 0 )
+	return SLNOPACKET;
+    }
+}  /* End of collect() */
+
+
+/***************************************************************************
+ * splitstreams:
+ *
+ * Distribute the streams of the primary connection description over
+ * 'count' new connection descriptions for the same server, round-robin
+ * in stream list order.  Each new connection negotiates and tracks
+ * sequence numbers for its own subset; the primary connection keeps the
+ * complete stream list for state saving, see syncstate().
+ *
+ * Returns 0 on success, and -1 on failure.
+ ***************************************************************************/
+static int
+splitstreams (int count)
+{
+  SLstream *curstream;
+  SLstream *newstream;
+  SLCD *newconn;
+  int idx;
+
+  if ( ! slconn->multistation )
+    {
+      sl_log (2, 0, "parallel connections require multi-station mode (-l or -S)\n");
+      return -1;
+    }
+
+  if ( ! (slconns = (SLCD **) calloc (count, sizeof (SLCD *))) )
+    {
+      sl_log (2, 0, "cannot allocate memory for connections\n");
+      return -1;
+    }
+
+  for ( idx = 0; idx < count; idx++ )
+    {
+      if ( ! (newconn = sl_newslcd ()) )
+	return -1;
+
+      newconn->sladdr      = slconn->sladdr;
+      newconn->begin_time  = slconn->begin_time;
+      newconn->end_time    = slconn->end_time;
+      newconn->resume      = slconn->resume;
+      newconn->dialup      = slconn->dialup;
+      newconn->batchmode   = slconn->batchmode;
+      newconn->lastpkttime = slconn->lastpkttime;
+      newconn->keepalive   = slconn->keepalive;
+      newconn->iotimeout   = slconn->iotimeout;
+      newconn->resptimeout = NCRESPTIMEOUT;
+      newconn->netto       = slconn->netto;
+      newconn->netdly      = slconn->netdly;
+      newconn->netdly_backoff = slconn->netdly_backoff;
+      newconn->netdly_nowait = 1;   /* collect() paces the connections */
+      newconn->rcvbufsize  = slconn->rcvbufsize;
+      newconn->tcpnodelay  = slconn->tcpnodelay;
+      newconn->busypoll    = slconn->busypoll;
+      newconn->usertimeout = slconn->usertimeout;
+      newconn->durablestate = slconn->durablestate;
+      newconn->log         = slconn->log;
+
+      slconns[idx] = newconn;
+    }
+
+  idx = 0;
+  curstream = slconn->streams;
+  while ( curstream != NULL )
+    {
+      if ( sl_addstream (slconns[idx], curstream->net, curstream->sta,
+			 curstream->selectors, curstream->seqnum,
+			 curstream->timestamp) < 0 )
+	return -1;
+
+      /* The split stream updates the same state journal slot */
+      for ( newstream = slconns[idx]->streams; newstream->next; newstream = newstream->next );
+      newstream->jslot = curstream->jslot;
+
+      idx = (idx + 1) % count;
+      curstream = curstream->next;
+    }
+
+  for ( idx = 0; idx < count; idx++ )
+    {
+      if ( ! slconns[idx]->streams )
+	{
+	  sl_log (2, 0, "more connections (%d) than streams\n", count);
+	  return -1;
+	}
+    }
+
+  sl_log (1, 1, "split streams over %d connections to %s\n", count, slconn->sladdr);
+
+  return 0;
+}  /* End of splitstreams() */
+
+
+/***************************************************************************
+ * syncstate:
+ *
+ * Copy the sequence numbers and time stamps tracked by each of the
+ * parallel connections back into the complete stream list of the
+ * primary connection, merging them for sl_savestate().  Relies on the
+ * round-robin order used by splitstreams().
+ ***************************************************************************/
+static void
+syncstate (void)
+{
+  SLstream *curstream;
+  SLstream **cursors;
+  int idx;
+
+  if ( ! slconns )
+    return;
+
+  if ( ! (cursors = (SLstream **) malloc (connections * sizeof (SLstream *))) )
+    {
+      sl_log (2, 0, "cannot allocate memory to merge stream states\n");
+      return;
+    }
+
+  for ( idx = 0; idx < connections; idx++ )
+    cursors[idx] = slconns[idx]->streams;
+
+  idx = 0;
+  curstream = slconn->streams;
+  while ( curstream != NULL && cursors[idx] != NULL )
+    {
+      curstream->seqnum = cursors[idx]->seqnum;
+      curstream->nstime = cursors[idx]->nstime;
+      curstream->tsstale = 1;
+      curstream->durseqnum = cursors[idx]->durseqnum;
+      curstream->durnstime = cursors[idx]->durnstime;
+
+      cursors[idx] = cursors[idx]->next;
+      idx = (idx + 1) % connections;
+      curstream = curstream->next;
+    }
+
+  free (cursors);
+}  /* End of syncstate() */
+
+
+/***************************************************************************
+ * commitstate:
+ *
+ * Prepare the primary connection for saving state.  With durable
+ * state (-ds) the acknowledged state of the archived packets is
+ * committed; with -dsync only after all open archive files have been
+ * synced to storage, if syncing fails the previous durable state is
+ * kept.  The states of parallel connections are then merged with
+ * syncstate().
+ ***************************************************************************/
+static void
+commitstate (void)
+{
+  DSArchive *curdsa;
+  int synced = 1;
+  int idx;
+
+  if ( durable > 1 )
+    {
+      for ( curdsa = dsarchive; curdsa != NULL; curdsa = curdsa->next )
+	if ( ds_sync (&curdsa->datastream) )
+	  synced = 0;
+    }
+
+  if ( durable && synced )
+    {
+      if ( slconns )
+	{
+	  for ( idx = 0; idx < connections; idx++ )
+	    sl_commitacks (slconns[idx]);
+	}
+      else
+	sl_commitacks (slconn);
+    }
+
+  syncstate ();
+}  /* End of commitstate() */
+
+
+/***************************************************************************
+ * savestate:
+ *
+ * Commit and save the stream states to the state file in the main
+ * thread, timing the save for the metrics.
+ ***************************************************************************/
+static void
+savestate (void)
+{
+  double starttime;
+
+  commitstate ();
+
+  starttime = sl_dtime ();
+
+  if ( sl_savestate (slconn, statefile) == 0 )
+    {
+      saveddur  = sl_dtime () - starttime;
+      savedtime = starttime;
+    }
+}  /* End of savestate() */
+
+
+/***************************************************************************
+ * writemetrics:
+ *
+ * Write the metrics file: packets and bytes received by packet type,
+ * records archived and write errors per archive, open files and
+ * stream groups, reconnects, negotiation time and receive buffer fill
+ * per connection, the duration and age of the last state save and
+ * the per-channel statistics if tracked.
+ ***************************************************************************/
+static void
+writemetrics (void)
+{
+  MetricsFile *mf;
+  DSArchive *curdsa;
+  DataStreamGroup *curgroup;
+  SLCD *conn;
+  char labels[METRICS_LABELLEN];
+  char connid[12];
+  int groups;
+  int idx;
+
+  if ( ! (mf = metrics_open (metricsfile)) )
+    return;
+
+  metrics_family (mf, "slarchive_packets_total", "counter",
+		  "Packets received by packet type");
+  for ( idx = 0; idx <= SLKEEP; idx++ )
+    metrics_count (mf, "slarchive_packets_total",
+		   metrics_labels (labels, sizeof (labels), "type", typenames[idx], NULL),
+		   packetcount[idx]);
+
+  metrics_family (mf, "slarchive_bytes_total", "counter",
+		  "Record bytes received by packet type");
+  for ( idx = 0; idx <= SLKEEP; idx++ )
+    metrics_count (mf, "slarchive_bytes_total",
+		   metrics_labels (labels, sizeof (labels), "type", typenames[idx], NULL),
+		   packetbytes[idx]);
+
+  metrics_family (mf, "slarchive_records_archived_total", "counter",
+		  "Records written to each archive");
+  for ( curdsa = dsarchive; curdsa != NULL; curdsa = curdsa->next )
+    metrics_count (mf, "slarchive_records_archived_total",
+		   metrics_labels (labels, sizeof (labels), "archive", curdsa->datastream.path, NULL),
+		   curdsa->datastream.records);
+
+  metrics_family (mf, "slarchive_write_errors_total", "counter",
+		  "Records that could not be written to each archive");
+  for ( curdsa = dsarchive; curdsa != NULL; curdsa = curdsa->next )
+    metrics_count (mf, "slarchive_write_errors_total",
+		   metrics_labels (labels, sizeof (labels), "archive", curdsa->datastream.path, NULL),
+		   curdsa->datastream.writeerrors);
+
+  metrics_family (mf, "slarchive_archive_groups", "gauge",
+		  "Stream groups (files) currently tracked by each archive");
+  for ( curdsa = dsarchive; curdsa != NULL; curdsa = curdsa->next )
+    {
+      groups = 0;
+      for ( curgroup = curdsa->datastream.grouproot; curgroup != NULL; curgroup = curgroup->next )
+	groups++;
+
+      metrics_value (mf, "slarchive_archive_groups",
+		     metrics_labels (labels, sizeof (labels), "archive", curdsa->datastream.path, NULL),
+		     groups);
+    }
+
+  metrics_family (mf, "slarchive_open_files", "gauge", "Open archive files");
+  metrics_value (mf, "slarchive_open_files", NULL, ds_openfilecount);
+
+  metrics_family (mf, "slarchive_open_files_max", "gauge", "Maximum number of open archive files");
+  metrics_value (mf, "slarchive_open_files_max", NULL, ds_maxopenfiles);
+
+  metrics_family (mf, "slarchive_reconnects_total", "counter",
+		  "Lost connections that were re-established");
+  for ( idx = 0; idx < connections; idx++ )
+    {
+      conn = ( slconns ) ? slconns[idx] : slconn;
+      snprintf (connid, sizeof (connid), "%d", idx + 1);
+      metrics_count (mf, "slarchive_reconnects_total",
+		     metrics_labels (labels, sizeof (labels), "connection", connid, NULL),
+		     conn->stat->reconnect_count);
+    }
+
+  metrics_family (mf, "slarchive_negotiation_seconds", "gauge",
+		  "Time needed for the last stream negotiation");
+  for ( idx = 0; idx < connections; idx++ )
+    {
+      conn = ( slconns ) ? slconns[idx] : slconn;
+      snprintf (connid, sizeof (connid), "%d", idx + 1);
+      metrics_value (mf, "slarchive_negotiation_seconds",
+		     metrics_labels (labels, sizeof (labels), "connection", connid, NULL),
+		     conn->stat->negotiate_time);
+    }
+
+  metrics_family (mf, "slarchive_receive_buffer_bytes", "gauge",
+		  "Received data waiting in the receive buffer");
+  for ( idx = 0; idx < connections; idx++ )
+    {
+      conn = ( slconns ) ? slconns[idx] : slconn;
+      snprintf (connid, sizeof (connid), "%d", idx + 1);
+      metrics_value (mf, "slarchive_receive_buffer_bytes",
+		     metrics_labels (labels, sizeof (labels), "connection", connid, NULL),
+		     conn->stat->recptr - conn->stat->sendptr);
+    }
+
+  metrics_family (mf, "slarchive_receive_buffer_size_bytes", "gauge",
+		  "Size of the receive buffer");
+  metrics_value (mf, "slarchive_receive_buffer_size_bytes", NULL, BUFSIZE);
+
+  if ( statefile )
+    {
+      metrics_family (mf, "slarchive_state_save_seconds", "gauge",
+		      "Time needed for the last state file save");
+      metrics_value (mf, "slarchive_state_save_seconds", NULL, saveddur);
+
+      metrics_family (mf, "slarchive_state_age_seconds", "gauge",
+		      "Age of the state in the state file, -1 if not saved yet");
+      metrics_value (mf, "slarchive_state_age_seconds", NULL,
+		     ( savedtime > 0.0 ) ? sl_dtime () - savedtime : -1.0);
+    }
+
+  if ( chanstats )
+    cs_metrics (chanstats, mf);
+
+  metrics_family (mf, "slarchive_metrics_timestamp_seconds", "gauge",
+		  "Time the metrics were written");
+  metrics_value (mf, "slarchive_metrics_timestamp_seconds", NULL, sl_dtime ());
+
+  metrics_close (mf);
+}  /* End of writemetrics() */
+
+
+/***************************************************************************
+ * startcheckpoint:
+ *
+ * Start the background thread that saves the state file every
+ * 'stateperiod' seconds.  The collect loop hands it snapshots of the
+ * stream states via checkpoint(), the file is written by the thread so
+ * that collection is never blocked by file I/O.
+ *
+ * Returns 0 on success, and -1 on failure.
+ ***************************************************************************/
+static int
+startcheckpoint (void)
+{
+  SLstream *curstream;
+  sigset_t sigset;
+  sigset_t oldset;
+  int retval;
+
+  if ( ! (statesnap = sl_newslcd ()) )
+    return -1;
+
+  statesnap->log = NULL;
+
+  for ( curstream = slconn->streams; curstream != NULL; curstream = curstream->next )
+    {
+      if ( sl_addstream (statesnap, curstream->net, curstream->sta, NULL,
+			 curstream->seqnum, curstream->timestamp) < 0 )
+	return -1;
+    }
+
+  /* Signals are handled by the main thread only */
+  sigfillset (&sigset);
+  pthread_sigmask (SIG_BLOCK, &sigset, &oldset);
+
+  retval = pthread_create (&statethread, NULL, checkpointer, NULL);
+
+  pthread_sigmask (SIG_SETMASK, &oldset, NULL);
+
+  if ( retval )
+    {
+      sl_log (2, 0, "cannot create state checkpoint thread, %s\n", strerror (retval));
+      return -1;
+    }
+
+  sl_log (1, 1, "saving state to %s every %d seconds\n", statefile, stateperiod);
+
+  return 0;
+}  /* End of startcheckpoint() */
+
+
+/***************************************************************************
+ * checkpoint:
+ *
+ * Copy the current sequence numbers and time stamps into the snapshot
+ * and wake the checkpoint thread.  The copy is a few bytes per stream;
+ * if the thread is still saving the previous snapshot nothing is done.
+ *
+ * With -dsync the archive files are synced here, in the collect loop,
+ * by commitstate().  The data streams are written and closed by this
+ * thread so syncing them in the checkpoint thread would race with the
+ * archiving; the fsync() time blocks collection but only the state
+ * file write is moved to the thread.
+ *
+ * Returns 0 if a snapshot was taken and -1 if the thread was busy.
+ ***************************************************************************/
+static int
+checkpoint (void)
+{
+  SLstream *curstream;
+  SLstream *snapstream;
+
+  if ( pthread_mutex_trylock (&statelock) )
+    return -1;
+
+  commitstate ();
+
+  snapstream = statesnap->streams;
+  for ( curstream = slconn->streams; curstream != NULL && snapstream != NULL;
+	curstream = curstream->next )
+    {
+      /* The time stamp is formatted by sl_savestate() in the thread */
+      if ( durable )
+	{
+	  snapstream->seqnum = curstream->durseqnum;
+	  snapstream->nstime = curstream->durnstime;
+	}
+      else
+	{
+	  snapstream->seqnum = curstream->seqnum;
+	  snapstream->nstime = curstream->nstime;
+	}
+
+      snapstream->tsstale = 1;
+
+      snapstream = snapstream->next;
+    }
+
+  /* Results of the previous checkpoint for the metrics */
+  savedtime = statesavetime;
+  saveddur  = statesavedur;
+
+  statesnaptime = sl_dtime ();
+  statepending = 1;
+
+  pthread_cond_signal (&statecond);
+  pthread_mutex_unlock (&statelock);
+
+  return 0;
+}  /* End of checkpoint() */
+
+
+/***************************************************************************
+ * stopcheckpoint:
+ *
+ * Stop the checkpoint thread after any pending snapshot is saved.
+ ***************************************************************************/
+static void
+stopcheckpoint (void)
+{
+  pthread_mutex_lock (&statelock);
+  stateshutdown = 1;
+  pthread_cond_signal (&statecond);
+  pthread_mutex_unlock (&statelock);
+
+  pthread_join (statethread, NULL);
+
+  sl_freeslcd (statesnap);
+  statesnap = NULL;
+}  /* End of stopcheckpoint() */
+
+
+/***************************************************************************
+ * checkpointer:
+ *
+ * Checkpoint thread, save each snapshot handed over by checkpoint() to
+ * the state file.  The state age, the time between taking a snapshot
+ * and the snapshot being saved, is logged at verbosity 2 and above.
+ ***************************************************************************/
+static void *
+checkpointer (void *arg)
+{
+  pthread_mutex_lock (&statelock);
+
+  for (;;)
+    {
+      while ( ! statepending && ! stateshutdown )
+	pthread_cond_wait (&statecond, &statelock);
+
+      if ( statepending )
+	{
+	  double starttime = sl_dtime ();
+
+	  if ( sl_savestate (statesnap, statefile) == 0 )
+	    {
+	      statesavedur  = sl_dtime () - starttime;
+	      statesavetime = statesnaptime;
+	      sl_log (1, 2, "state checkpoint saved, state age %.3f seconds\n",
+		      sl_dtime () - statesnaptime);
+	    }
+
+	  statepending = 0;
+	}
+
+      if ( stateshutdown )
+	break;
+    }
+
+  pthread_mutex_unlock (&statelock);
+
+  return NULL;
+}  /* End of checkpointer() */
+
+
 /***************************************************************************
  * packet_handler:
  * Process a received packet based on packet type.
+ *
+ * Returns 0 if the packet was handled and -1 if writing it to any of
+ * the archives failed.  Packets that cannot be parsed or are rejected
+ * by the CRC check are not retried and count as handled.
  ***************************************************************************/
-static void
-packet_handler (char *msrecord, int packet_type, int seqnum)
+static int
+packet_handler (const SLpacket *slpack)
 {
   static SLMSrecord * msr = NULL;
+  SLRecordView view;
 
   double dtime;			/* Epoch time */
   double secfrac;		/* Fractional part of epoch time */
@@ -136,11 +941,7 @@ packet_handler (char *msrecord, int packet_type, int seqnum)
   char timestamp[36] = {0};
   struct tm *timep;
   int    archflag = 1;
-
-  /* The following is dependent on the packet type values in libslink.h */
-  char *type[]  = { "Data", "Detection", "Calibration", "Timing",
-		    "Message", "General", "Request", "Info",
-                    "Info (terminated)", "KeepAlive" };
+  int    retval = 0;
 
   if (verbose >= 1)
   {
@@ -154,19 +955,49 @@ packet_handler (char *msrecord, int packet_type, int seqnum)
 	      timep->tm_min, timep->tm_sec, secfrac);
 
     sl_log (1, 1, "%s, seq %d, Received %s blockette\n",
-	    timestamp, seqnum, type[packet_type]);
+	    timestamp, slpack->seqnum, typenames[slpack->packettype]);
   }
 
-  /* Parse data record and print requested detail if any */
-  sl_msr_parse (slconn->log, msrecord, &msr, 1, 0);
-
-  if (msr == NULL)
+  /* Validate the record, header fields are read in place */
+  SL_PROBE_START (viewstart);
+  if ( sl_view_packet (&view, slpack) )
   {
     sl_log (2, 0, "cannot parse miniSEED record\n");
-    return;
+    return 0;
   }
+  SL_PROBE_END (viewstart, "parse");
+
+  /* Verify the CRC of miniSEED 3 records, reject or quarantine on mismatch */
+  if ( crccheck && view.formatversion == 3 && sl_view_verifycrc (&view) != 1 )
+    {
+      char net[SL_VIEW_CODESIZE], sta[SL_VIEW_CODESIZE];
+      char loc[SL_VIEW_CODESIZE], chan[SL_VIEW_CODESIZE];
+      char srcname[4 * SL_VIEW_CODESIZE];
+
+      /* The header is suspect, the source identifier may not parse */
+      if ( sl_view_nslc (&view, net, sta, loc, chan) )
+	strcpy (srcname, "unknown");
+      else
+	snprintf (srcname, sizeof (srcname), "%s_%s_%s_%s", net, sta, loc, chan);
 
-  if ( ppackets )
+      if ( crcfile )
+	{
+	  if ( ! crcfp && ! (crcfp = fopen (crcfile, "ab")) )
+	    sl_log (2, 0, "cannot open quarantine file %s: %s\n", crcfile, strerror (errno));
+
+	  if ( crcfp && (fwrite (view.record, view.reclen, 1, crcfp) != 1 || fflush (crcfp)) )
+	    sl_log (2, 0, "cannot write to quarantine file %s: %s\n", crcfile, strerror (errno));
+	}
+
+      sl_log (2, 0, "%s, seq %d, CRC mismatch, record %s\n",
+	      srcname, slpack->seqnum, (crcfile) ? "quarantined" : "rejected");
+
+      archflag = 0;
+    }
+
+  /* Parse data record and print requested detail if any */
+  if ( ppackets && view.formatversion == 2 &&
+       sl_msr_parse (slconn->log, slpack->msrecord, &msr, 1, 0) )
     sl_msr_print (slconn->log, msr, ppackets - 1);
 
   /* Write packet to all archives in archive definition chain */
@@ -175,13 +1006,18 @@ packet_handler (char *msrecord, int packet_type, int seqnum)
     DSArchive *curdsa = dsarchive;
 
     while ( curdsa != NULL ) {
-      curdsa->datastream.packettype = packet_type;
+      curdsa->datastream.packettype = slpack->packettype;
 
-      ds_streamproc (&curdsa->datastream, msr, 0);
+      SL_PROBE_START (archivestart);
+      if ( ds_streamproc (&curdsa->datastream, &view, 0) )
+	retval = -1;
+      SL_PROBE_END (archivestart, "ds_streamproc");
 
       curdsa = curdsa->next;
     }
   }
+
+  return retval;
 }  /* End of packet_handler() */
 
 
@@ -271,6 +1107,43 @@ parameter_proc (int argcount, char **argvec)
 	{
 	  slconn->netto = atoi (getoptval(argcount, argvec, optind++));
 	}
+      else if (strcmp (argvec[optind], "-nb") == 0)
+	{
+	  slconn->netdly_backoff = 1;
+	}
+      else if (strcmp (argvec[optind], "-nc") == 0)
+	{
+	  connections = atoi (getoptval(argcount, argvec, optind++));
+	}
+      else if (strcmp (argvec[optind], "-rb") == 0)
+	{
+	  slconn->rcvbufsize = atoi (getoptval(argcount, argvec, optind++));
+	}
+      else if (strcmp (argvec[optind], "-nodelay") == 0)
+	{
+	  slconn->tcpnodelay = 1;
+	}
+      else if (strcmp (argvec[optind], "-bp") == 0)
+	{
+	  slconn->busypoll = atoi (getoptval(argcount, argvec, optind++));
+	}
+      else if (strcmp (argvec[optind], "-ut") == 0)
+	{
+	  slconn->usertimeout = atoi (getoptval(argcount, argvec, optind++));
+	}
+      else if (strcmp (argvec[optind], "-R") == 0)
+	{
+	  slconn->replayfile = getoptval(argcount, argvec, optind++);
+	}
+      else if (strcmp (argvec[optind], "-crc") == 0)
+	{
+	  crccheck = 1;
+	}
+      else if (strcmp (argvec[optind], "-crcq") == 0)
+	{
+	  crccheck = 1;
+	  crcfile = getoptval(argcount, argvec, optind++);
+	}
       else if (strcmp (argvec[optind], "-k") == 0)
 	{
 	  slconn->keepalive = atoi (getoptval(argcount, argvec, optind++));
@@ -330,6 +1203,28 @@ parameter_proc (int argcount, char **argvec)
 	{
 	  statefile = getoptval(argcount, argvec, optind++);
 	}
+      else if (strcmp (argvec[optind], "-j") == 0)
+	{
+	  journalfile = getoptval(argcount, argvec, optind++);
+	}
+      else if (strcmp (argvec[optind], "-M") == 0)
+	{
+	  metricsfile = getoptval(argcount, argvec, optind++);
+	}
+      else if (strcmp (argvec[optind], "-cs") == 0)
+	{
+	  if ( ! chanstats && ! (chanstats = cs_new ()) )
+	    return -1;
+	}
+      else if (strcmp (argvec[optind], "-ds") == 0)
+	{
+	  if ( ! durable )
+	    durable = 1;
+	}
+      else if (strcmp (argvec[optind], "-dsync") == 0)
+	{
+	  durable = 2;
+	}
       else if (strcmp (argvec[optind], "-tw") == 0)
 	{
 	  timewin = getoptval(argcount, argvec, optind++);
@@ -350,6 +1245,43 @@ parameter_proc (int argcount, char **argvec)
 	}
     }
 
+  if ( connections < 1 || connections > 64 )
+    {
+      fprintf (stderr, "Number of connections must be between 1 and 64\n");
+      exit (1);
+    }
+
+  /* A replay file stands in for the server */
+  if ( slconn->replayfile )
+    {
+      char *rate;
+      char *tail;
+
+      /* A rate may follow the last ':' unless the argument names a file */
+      if ( access (slconn->replayfile, F_OK) &&
+	   (rate = strrchr (slconn->replayfile, ':')) )
+	{
+	  *rate++ = '\0';
+	  slconn->replayrate = strtod (rate, &tail);
+
+	  if ( tail == rate || *tail || slconn->replayrate < 0.0 ||
+	       slconn->replayrate > 1e9 )
+	    {
+	      fprintf (stderr, "Replay rate specified incorrectly: %s\n", rate);
+	      exit (1);
+	    }
+	}
+
+      if ( connections > 1 )
+	{
+	  fprintf (stderr, "Parallel connections (-nc) cannot be used with replay (-R)\n");
+	  exit (1);
+	}
+
+      if ( ! slconn->sladdr )
+	slconn->sladdr = slconn->replayfile;
+    }
+
   /* Make sure a server was specified */
   if ( ! slconn->sladdr )
     {
@@ -448,7 +1380,16 @@ parameter_proc (int argcount, char **argvec)
 
 	  stateint = (unsigned int) strtoul (tptr, &tail, 0);
 
-	  if ( *tail || (stateint < 0 || stateint > 1e9) )
+	  /* An 's' suffix specifies a time interval in seconds */
+	  if ( *tail == 's' && *(tail+1) == '\0' && tail != tptr )
+	    {
+	      stateperiod = stateint;
+	      stateint = 0;
+	      tail++;
+	    }
+
+	  if ( *tail || (stateint < 0 || stateint > 1e9) ||
+	       stateperiod < 0 || stateperiod > 86400 )
 	    {
 	      sl_log (2, 0, "state saving interval specified incorrectly\n");
 	      return -1;
@@ -461,6 +1402,52 @@ parameter_proc (int argcount, char **argvec)
 	}
     }
 
+  /* Check if interval was specified for writing metrics */
+  if (metricsfile && (tptr = strchr (metricsfile, ':')) != NULL)
+    {
+      char *tail;
+
+      *tptr++ = '\0';
+
+      metricsint = (int) strtol (tptr, &tail, 0);
+
+      if ( *tail || metricsint < 1 || metricsint > 86400 )
+	{
+	  sl_log (2, 0, "metrics interval specified incorrectly\n");
+	  return -1;
+	}
+    }
+
+  /* Saved state only advances for packets written to the archive(s) */
+  if ( durable )
+    slconn->durablestate = 1;
+
+  /* Attach the state journal, recovering sequence numbers if it exists */
+  if (journalfile)
+    {
+      /* Check if interval was specified for journal syncing */
+      if ((tptr = strchr (journalfile, ':')) != NULL)
+	{
+	  char *tail;
+
+	  *tptr++ = '\0';
+
+	  journalint = (int) strtol (tptr, &tail, 0);
+
+	  if ( *tail || journalint < 0 || journalint > 86400 )
+	    {
+	      sl_log (2, 0, "state journal sync interval specified incorrectly\n");
+	      return -1;
+	    }
+	}
+
+      if (sl_openjournal (slconn, journalfile) < 0)
+	{
+	  sl_log (2, 0, "cannot open state journal %s\n", journalfile);
+	  return -1;
+	}
+    }
+
   /* If no archiving is specified print a warning */
   if ( !dsarchive ) {
     sl_log (1, 0, "WARNING: no archiving method was specified\n");
@@ -474,6 +1461,7 @@ parameter_proc (int argcount, char **argvec)
       curdsa->datastream.futurecont = futurecont;
       curdsa->datastream.futureinitflag = futureinitflag;
       curdsa->datastream.futureinit = futureinit;
+      curdsa->datastream.syncflag = (durable > 1);
       curdsa = curdsa->next;
     }
   }
@@ -571,8 +1559,39 @@ addarchive ( const char *path, const char *layout )
 static void
 term_handler (int sig)
 {
+  int idx;
+
   sl_terminate (slconn);
+
+  if ( slconns )
+    for ( idx = 0; idx < connections; idx++ )
+      sl_terminate (slconns[idx]);
+}
+
+
+/***************************************************************************
+ * dump_handler:
+ * Signal handler routine to request a dump of the channel statistics
+ * and timing probes.
+ ***************************************************************************/
+static void
+dump_handler (int sig)
+{
+  dumpstats = 1;
+}
+
+
+#ifdef SL_PROBES
+/***************************************************************************
+ * reset_handler:
+ * Signal handler routine to request a reset of the timing probes.
+ ***************************************************************************/
+static void
+reset_handler (int sig)
+{
+  resetprobes = 1;
 }
+#endif
 
 
 /***************************************************************************
@@ -585,11 +1604,12 @@ print_timelog (const char *msg)
 {
   char timestr[100];
   time_t loc_time;
+  struct tm tms;
 
-  /* Build local time string and cut off the newline */
+  /* Build local time string, reentrant for the checkpoint thread */
   time(&loc_time);
-  strcpy(timestr, asctime(localtime(&loc_time)));
-  timestr[strlen(timestr) - 1] = '\0';
+  localtime_r(&loc_time, &tms);
+  strftime(timestr, sizeof(timestr), "%a %b %e %H:%M:%S %Y", &tms);
 
   fprintf (stdout, "%s - %s", timestr, msg);
 }
@@ -615,13 +1635,33 @@ usage (int level)
 	   " -nd delay       Network re-connect delay (seconds), default 30\n"
 	   " -nt timeout     Network timeout (seconds), re-establish connection if no\n"
 	   "                   data/keepalives are received in this time, default 600\n"
+	   " -nb             Back off exponentially between re-connect attempts\n"
+	   " -nc count       Split the stream list over this many connections\n"
+	   " -rb bytes       Socket receive buffer size\n"
+	   " -nodelay        Disable Nagle's algorithm (TCP_NODELAY)\n"
+	   " -bp usecs       Busy poll the socket for this long (SO_BUSY_POLL)\n"
+	   " -ut msecs       TCP user timeout (TCP_USER_TIMEOUT)\n"
 	   " -k interval     Send keepalive (heartbeat) packets this often (seconds)\n"
-	   " -x sfile[:int]  Save/restore stream state information to this file\n"
+	   " -x sfile[:int]  Save/restore stream state information to this file, every\n"
+	   "                   int packets, or int seconds in the background if int\n"
+	   "                   ends with 's'\n"
+	   " -j jfile[:int]  Keep stream state in this binary journal, updated for every\n"
+	   "                   packet and synced every int seconds, default 1\n"
+	   " -M mfile[:int]  Write metrics in Prometheus text format to this file every\n"
+	   "                   int seconds, default 15\n"
+	   " -cs             Track latency, gaps and rate per channel, logged on SIGUSR1\n"
+	   "                   and included in the metrics file\n"
+	   " -ds             Only save state for packets written to the archive(s)\n"
+	   " -dsync          As -ds and sync archive files before saving state\n"
 	   " -i timeout      Idle stream entries might be closed (seconds), default 300\n"
 	   " -d              Configure the connection in dial-up mode\n"
 	   " -b              Configure the connection in batch mode\n"
 	   " -Fi[:overlap]   Initially check (existing files) that data records are newer\n"
 	   " -Fc[:overlap]   Continuously check that data records are newer\n"
+	   " -R file[:rate]  Replay packets from a SeedLink capture or miniSEED file\n"
+	   "                   instead of connecting, rate in packets/second\n"
+	   " -crc            Verify CRC of miniSEED 3 records, do not archive corrupt records\n"
+	   " -crcq file      Verify CRC as -crc and append corrupt records to this file\n"
 	   "\n"
 	   " ## Data stream selection ##\n"
 	   " -s selectors    Selectors for uni/all-station or default for multi-station mode\n"